@@ -272,8 +272,12 @@ drm_gem_handle_delete(struct drm_file *filp, u32 handle)
 	}
 	dev = obj->dev;
 
-	/* Release reference and decrement refcount. */
-	idr_remove(&filp->object_idr, handle);
+	/*
+	 * Hide the handle from lookups, but keep its number reserved until
+	 * the driver has been told about the close. Drivers caching lookups
+	 * by handle can then drop them before the number gets reused.
+	 */
+	idr_replace(&filp->object_idr, NULL, handle);
 	spin_unlock(&filp->table_lock);
 
 	if (drm_core_check_feature(dev, DRIVER_PRIME))
@@ -282,6 +286,12 @@ drm_gem_handle_delete(struct drm_file *filp, u32 handle)
 
 	if (dev->driver->gem_close_object)
 		dev->driver->gem_close_object(obj, filp);
+
+	/* Release reference and decrement refcount. */
+	spin_lock(&filp->table_lock);
+	idr_remove(&filp->object_idr, handle);
+	spin_unlock(&filp->table_lock);
+
 	drm_gem_object_handle_unreference_unlocked(obj);
 
 	return 0;
@@ -37,18 +37,107 @@
 #include <linux/hash.h>
 #include <linux/slab.h>
 #include <linux/export.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
 
-int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+/*
+ * The table grows when the number of items exceeds the number of buckets and
+ * shrinks (never below the order it was created with) when it drops under a
+ * quarter of that. Resizing is incremental: a new table is allocated next to
+ * the current one and every insertion or removal moves a few buckets over,
+ * so no single caller pays for rehashing the whole table. Items added while
+ * a rehash is in progress go straight into the new table.
+ *
+ * Lookups don't take any lock. Moving a bucket is wrapped in a seqcount, and
+ * a lookup which raced with a move and missed is simply retried. A lookup
+ * which finds its key never needs to retry. The old table is freed after a
+ * RCU grace period once the last bucket has been moved.
+ *
+ * Callers of the insert and remove functions still need to serialize against
+ * each other, as before. Since they may do so with a spinlock, only tables of
+ * up to a page are allocated in place, without sleeping. Larger ones, or
+ * those that failed in place, are allocated by resize_work and picked up by
+ * the next insertion or removal. After that allocation fails too, resizes are
+ * held off for DRM_HT_RESIZE_BACKOFF.
+ */
+/*
+ * Readers spin in read_seqcount_begin() while a batch of buckets is being
+ * moved, so batches are kept small: with the load factor kept under two
+ * items per bucket, a batch is a few dozen list operations. The batch also
+ * runs with preemption disabled, since writers serialized by a mutex could
+ * otherwise be scheduled out in the middle of it.
+ */
+#define DRM_HT_REHASH_BUCKETS 8
+#define DRM_HT_RESIZE_BACKOFF HZ
+
+struct drm_ht_table {
+	struct rcu_head rcu;
+	unsigned int order;
+	unsigned int rehash;	/* Buckets of the old table moved into this one */
+	struct hlist_head heads[];
+};
+
+static struct drm_ht_table *drm_ht_alloc_table(unsigned int order, gfp_t gfp)
 {
-	unsigned int size = 1 << order;
+	size_t size = sizeof(struct drm_ht_table) +
+		(sizeof(struct hlist_head) << order);
+	struct drm_ht_table *tbl;
 
-	ht->order = order;
-	ht->table = NULL;
-	if (size <= PAGE_SIZE / sizeof(*ht->table))
-		ht->table = kcalloc(size, sizeof(*ht->table), GFP_KERNEL);
+	tbl = NULL;
+	if (size <= PAGE_SIZE || !(gfp & __GFP_WAIT))
+		tbl = kzalloc(size, gfp);
 	else
-		ht->table = vzalloc(size*sizeof(*ht->table));
-	if (!ht->table) {
+		tbl = vzalloc(size);
+	if (!tbl)
+		return NULL;
+
+	tbl->order = order;
+	return tbl;
+}
+
+static void drm_ht_free_table_rcu(struct rcu_head *head)
+{
+	kvfree(container_of(head, struct drm_ht_table, rcu));
+}
+
+static void drm_ht_resize_work(struct work_struct *work)
+{
+	struct drm_open_hash *ht =
+		container_of(work, struct drm_open_hash, resize_work);
+	struct drm_ht_table *tbl;
+
+	tbl = drm_ht_alloc_table(READ_ONCE(ht->resize_order),
+				 GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl) {
+		WRITE_ONCE(ht->resize_retry, jiffies + DRM_HT_RESIZE_BACKOFF);
+		return;
+	}
+
+	/* A spare nobody picked up was never visible to lookups */
+	kvfree(xchg(&ht->spare, tbl));
+}
+
+int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+{
+	struct drm_ht_table *tbl;
+
+	/* hash_long() can't produce a 0 bit key. */
+	if (order == 0)
+		order = 1;
+
+	ht->min_order = order;
+	ht->count = 0;
+	ht->resizes = 0;
+	seqcount_init(&ht->rehash_seq);
+	RCU_INIT_POINTER(ht->future_tbl, NULL);
+	INIT_WORK(&ht->resize_work, drm_ht_resize_work);
+	ht->spare = NULL;
+	ht->resize_order = order;
+	ht->resize_retry = jiffies;
+
+	tbl = drm_ht_alloc_table(order, GFP_KERNEL);
+	RCU_INIT_POINTER(ht->tbl, tbl);
+	if (!tbl) {
 		DRM_ERROR("Out of memory for hash table\n");
 		return -ENOMEM;
 	}
@@ -56,30 +145,55 @@ int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
 }
 EXPORT_SYMBOL(drm_ht_create);
 
-void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
+static inline struct drm_ht_table *drm_ht_table(struct drm_open_hash *ht)
+{
+	return rcu_dereference_raw(ht->tbl);
+}
+
+static inline struct drm_ht_table *drm_ht_future_table(struct drm_open_hash *ht)
+{
+	return rcu_dereference_raw(ht->future_tbl);
+}
+
+static inline struct hlist_head *drm_ht_bucket(struct drm_ht_table *tbl,
+					       unsigned long key)
+{
+	return &tbl->heads[hash_long(key, tbl->order)];
+}
+
+static void drm_ht_verbose_list_in(struct drm_ht_table *tbl,
+				   unsigned long key, int *count)
 {
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
 	unsigned int hashed_key;
-	int count = 0;
 
-	hashed_key = hash_long(key, ht->order);
+	hashed_key = hash_long(key, tbl->order);
 	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key, hashed_key);
-	h_list = &ht->table[hashed_key];
+	h_list = &tbl->heads[hashed_key];
 	hlist_for_each_entry(entry, h_list, head)
-		DRM_DEBUG("count %d, key: 0x%08lx\n", count++, entry->key);
+		DRM_DEBUG("count %d, key: 0x%08lx\n", (*count)++, entry->key);
 }
 
-static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
-					  unsigned long key)
+void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
+{
+	struct drm_ht_table *future = drm_ht_future_table(ht);
+	int count = 0;
+
+	drm_ht_verbose_list_in(drm_ht_table(ht), key, &count);
+	/* During a rehash the key's items may be in either table */
+	if (future) {
+		DRM_DEBUG("Rehashing to order %u\n", future->order);
+		drm_ht_verbose_list_in(future, key, &count);
+	}
+}
+
+static struct hlist_node *drm_ht_find_key_in(struct drm_ht_table *tbl,
+					     unsigned long key)
 {
 	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry(entry, h_list, head) {
+	hlist_for_each_entry_rcu(entry, drm_ht_bucket(tbl, key), head) {
 		if (entry->key == key)
 			return &entry->head;
 		if (entry->key > key)
@@ -88,39 +202,42 @@ static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
 	return NULL;
 }
 
+static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
+					  unsigned long key)
+{
+	struct drm_ht_table *future = drm_ht_future_table(ht);
+	struct hlist_node *list;
+
+	list = drm_ht_find_key_in(drm_ht_table(ht), key);
+	if (!list && future)
+		list = drm_ht_find_key_in(future, key);
+	return list;
+}
+
 static struct hlist_node *drm_ht_find_key_rcu(struct drm_open_hash *ht,
 					      unsigned long key)
 {
-	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
+	struct hlist_node *list;
+	unsigned int seq;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry_rcu(entry, h_list, head) {
-		if (entry->key == key)
-			return &entry->head;
-		if (entry->key > key)
-			break;
-	}
-	return NULL;
+	do {
+		seq = read_seqcount_begin(&ht->rehash_seq);
+		list = drm_ht_find_key(ht, key);
+	} while (!list && read_seqcount_retry(&ht->rehash_seq, seq));
+
+	return list;
 }
 
-int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+/* Insert @item keeping the chain sorted, called with the writer lock held. */
+static void drm_ht_link_item(struct drm_ht_table *tbl,
+			     struct drm_hash_item *item)
 {
+	struct hlist_head *h_list = drm_ht_bucket(tbl, item->key);
 	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	struct hlist_node *parent;
-	unsigned int hashed_key;
-	unsigned long key = item->key;
+	struct hlist_node *parent = NULL;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	parent = NULL;
 	hlist_for_each_entry(entry, h_list, head) {
-		if (entry->key == key)
-			return -EINVAL;
-		if (entry->key > key)
+		if (entry->key > item->key)
 			break;
 		parent = &entry->head;
 	}
@@ -129,6 +246,100 @@ int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 	} else {
 		hlist_add_head_rcu(&item->head, h_list);
 	}
+}
+
+static void drm_ht_start_resize(struct drm_open_hash *ht, unsigned int order)
+{
+	struct drm_ht_table *future = NULL;
+
+	if (time_before(jiffies, READ_ONCE(ht->resize_retry)))
+		return;
+
+	if (READ_ONCE(ht->spare)) {
+		future = xchg(&ht->spare, NULL);
+		if (future && future->order != order) {
+			/* The load changed while it was allocated */
+			call_rcu(&future->rcu, drm_ht_free_table_rcu);
+			future = NULL;
+		}
+	}
+
+	/* We may be called atomically, only small tables are allocated here */
+	if (!future && !work_pending(&ht->resize_work) &&
+	    (sizeof(struct hlist_head) << order) <= PAGE_SIZE)
+		future = drm_ht_alloc_table(order, GFP_NOWAIT | __GFP_NOWARN);
+
+	if (!future) {
+		WRITE_ONCE(ht->resize_order, order);
+		schedule_work(&ht->resize_work);
+		return;
+	}
+
+	rcu_assign_pointer(ht->future_tbl, future);
+}
+
+static void drm_ht_rehash(struct drm_open_hash *ht)
+{
+	struct drm_ht_table *tbl = drm_ht_table(ht);
+	struct drm_ht_table *future = drm_ht_future_table(ht);
+	unsigned int size = 1 << tbl->order;
+	unsigned int end = min(future->rehash + DRM_HT_REHASH_BUCKETS, size);
+
+	preempt_disable();
+	write_seqcount_begin(&ht->rehash_seq);
+	for (; future->rehash < end; future->rehash++) {
+		struct hlist_head *h_list = &tbl->heads[future->rehash];
+		struct drm_hash_item *entry;
+		struct hlist_node *tmp;
+
+		hlist_for_each_entry_safe(entry, tmp, h_list, head) {
+			hlist_del_rcu(&entry->head);
+			drm_ht_link_item(future, entry);
+		}
+	}
+
+	if (future->rehash == size) {
+		rcu_assign_pointer(ht->tbl, future);
+		RCU_INIT_POINTER(ht->future_tbl, NULL);
+		ht->resizes++;
+	}
+	write_seqcount_end(&ht->rehash_seq);
+	preempt_enable();
+
+	if (future->rehash == size)
+		call_rcu(&tbl->rcu, drm_ht_free_table_rcu);
+}
+
+/*
+ * Called by writers after every insertion and removal to start a resize if
+ * the load factor is off, or to make progress on an ongoing one.
+ */
+static void drm_ht_maybe_resize(struct drm_open_hash *ht)
+{
+	struct drm_ht_table *tbl = drm_ht_table(ht);
+	unsigned long size = 1UL << tbl->order;
+
+	if (drm_ht_future_table(ht)) {
+		drm_ht_rehash(ht);
+		return;
+	}
+
+	if (ht->count > size)
+		drm_ht_start_resize(ht, tbl->order + 1);
+	else if (tbl->order > ht->min_order && ht->count < size / 4)
+		drm_ht_start_resize(ht, tbl->order - 1);
+}
+
+int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+{
+	struct drm_ht_table *future = drm_ht_future_table(ht);
+
+	if (drm_ht_find_key(ht, item->key))
+		return -EINVAL;
+
+	drm_ht_link_item(future ? future : drm_ht_table(ht), item);
+	ht->count++;
+	drm_ht_maybe_resize(ht);
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_insert_item);
@@ -183,6 +394,8 @@ int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 	list = drm_ht_find_key(ht, key);
 	if (list) {
 		hlist_del_init_rcu(list);
+		ht->count--;
+		drm_ht_maybe_resize(ht);
 		return 0;
 	}
 	return -EINVAL;
@@ -191,18 +404,67 @@ int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 {
 	hlist_del_init_rcu(&item->head);
+	ht->count--;
+	drm_ht_maybe_resize(ht);
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_remove_item);
 
 void drm_ht_remove(struct drm_open_hash *ht)
 {
-	if (ht->table) {
-		if ((PAGE_SIZE / sizeof(*ht->table)) >> ht->order)
-			kfree(ht->table);
-		else
-			vfree(ht->table);
-		ht->table = NULL;
+	struct drm_ht_table *tbl = drm_ht_table(ht);
+	struct drm_ht_table *future = drm_ht_future_table(ht);
+
+	cancel_work_sync(&ht->resize_work);
+	kvfree(ht->spare);
+	ht->spare = NULL;
+
+	if (tbl) {
+		kvfree(tbl);
+		RCU_INIT_POINTER(ht->tbl, NULL);
+	}
+	if (future) {
+		kvfree(future);
+		RCU_INIT_POINTER(ht->future_tbl, NULL);
 	}
 }
 EXPORT_SYMBOL(drm_ht_remove);
+
+/**
+ * drm_ht_dump_stats - dump hash table load statistics to a seq_file
+ * @m: seq_file to dump to
+ * @ht: hash table to dump
+ *
+ * Callers must hold the lock that serializes insertions and removals. Used
+ * for the map_hash debugfs file of every device, drivers with tables of
+ * their own can add it to their debugfs files.
+ */
+int drm_ht_dump_stats(struct seq_file *m, struct drm_open_hash *ht)
+{
+	struct drm_ht_table *tbl = drm_ht_table(ht);
+	struct drm_ht_table *future = drm_ht_future_table(ht);
+	unsigned int size = 1 << tbl->order;
+	unsigned int i, used = 0, longest = 0;
+
+	for (i = 0; i < size; i++) {
+		struct drm_hash_item *entry;
+		unsigned int len = 0;
+
+		hlist_for_each_entry(entry, &tbl->heads[i], head)
+			len++;
+		if (len)
+			used++;
+		longest = max(longest, len);
+	}
+
+	seq_printf(m, "items: %lu, buckets %u, used %u, longest chain %u\n",
+		   ht->count, size, used, longest);
+	seq_printf(m, "load factor: %lu.%02lu, resizes %lu\n",
+		   ht->count / size, (ht->count % size) * 100 / size,
+		   ht->resizes);
+	if (future)
+		seq_printf(m, "rehashing to %u buckets: %u/%u moved\n",
+			   1 << future->order, future->rehash, size);
+	return 0;
+}
+EXPORT_SYMBOL(drm_ht_dump_stats);
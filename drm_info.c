@@ -110,6 +110,23 @@ int drm_vm_info(struct seq_file *m, void *data)
 	return 0;
 }
 
+/**
+ * Called when "/sys/kernel/debug/dri/.../map_hash" is read.
+ *
+ * Prints the load of the drm_device::map_hash table.
+ */
+int drm_map_hash_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	int ret;
+
+	mutex_lock(&dev->struct_mutex);
+	ret = drm_ht_dump_stats(m, &dev->map_hash);
+	mutex_unlock(&dev->struct_mutex);
+	return ret;
+}
+
 /**
  * Called when "/proc/dri/.../bufs" is read.
  */
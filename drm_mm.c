@@ -30,10 +30,9 @@
  * Generic simple memory manager implementation. Intended to be used as a base
  * class implementation for more advanced memory managers.
  *
- * Note that the algorithm used is quite simple and there might be substantial
- * performance gains if a smarter free list is implemented. Currently it is just an
- * unordered stack of free regions. This could easily be improved if an RB-tree
- * is used instead. At least if we expect heavy fragmentation.
+ * Free regions are kept on a most-recently-freed stack and additionally indexed
+ * by two rb-trees, one sorted by hole size and one sorted by hole address, so
+ * that best-fit and top-down searches don't need to walk every hole.
  *
  * Aligned allocations can also see improvement.
  *
@@ -46,6 +45,8 @@
 #include <linux/slab.h>
 #include <linux/seq_file.h>
 #include <linux/export.h>
+#include <linux/rbtree_augmented.h>
+#include <linux/math64.h>
 
 /**
  * DOC: Overview
@@ -70,10 +71,19 @@
  *
  * drm_mm maintains a stack of most recently freed holes, which of all
  * simplistic datastructures seems to be a fairly decent approach to clustering
- * allocations and avoiding too much fragmentation. This means free space
- * searches are O(num_holes). Given that all the fancy features drm_mm supports
- * something better would be fairly complex and since gfx thrashing is a fairly
- * steep cliff not a real concern. Removing a node again is O(1).
+ * allocations and avoiding too much fragmentation. The default search walks
+ * this stack, but gives up in O(1) if no hole is big enough. In addition all
+ * holes are kept in an rb-tree sorted by size, which is used for
+ * DRM_MM_SEARCH_BEST, and in an rb-tree sorted by address and augmented with
+ * the largest hole size in each subtree, which is used for DRM_MM_SEARCH_BELOW.
+ * Both of these searches are O(log(num_holes)) as long as the first candidate
+ * hole also satisfies the alignment and color constraints. Inserting and
+ * removing a node is O(log(num_holes)).
+ *
+ * Range restricted searches only benefit from the trees with
+ * DRM_MM_SEARCH_BELOW, which starts at the highest hole below the end of the
+ * range and stops at its start. The default and DRM_MM_SEARCH_BEST searches
+ * skip holes outside of the range one by one.
  *
  * drm_mm supports a few features: Alignment and range restrictions can be
  * supplied. Further more every &drm_mm_node has a color value (which is just an
@@ -84,7 +94,10 @@
  *
  * Two behaviors are supported for searching and allocating: bottom-up and top-down.
  * The default is bottom-up. Top-down allocation can be used if the memory area
- * has different restrictions, or just to reduce fragmentation.
+ * has different restrictions, or just to reduce fragmentation. Top-down
+ * searches (DRM_MM_SEARCH_BELOW) pick the suitable hole at the highest
+ * address. They used to walk the hole stack in reverse, i.e. pick the least
+ * recently freed suitable hole, which wasn't necessarily the topmost one.
  *
  * Finally iteration helpers to walk all nodes and all holes are provided as are
  * some basic allocator dumpers for debugging.
@@ -103,6 +116,181 @@ static struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_
 						unsigned long end,
 						enum drm_mm_search_flags flags);
 
+#define HOLE_SIZE(NODE) ((NODE)->hole_size)
+#define HOLE_ADDR(NODE) (__drm_mm_hole_node_start(NODE))
+
+static inline struct drm_mm_node *rb_hole_size_to_node(struct rb_node *rb)
+{
+	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_size);
+}
+
+static inline struct drm_mm_node *rb_hole_addr_to_node(struct rb_node *rb)
+{
+	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_addr);
+}
+
+static inline unsigned long rb_subtree_max_hole(struct rb_node *rb)
+{
+	return rb ? rb_hole_addr_to_node(rb)->subtree_max_hole : 0;
+}
+
+static unsigned long compute_subtree_max_hole(struct drm_mm_node *node)
+{
+	unsigned long max = HOLE_SIZE(node);
+
+	max = max_t(unsigned long, max,
+		    rb_subtree_max_hole(node->rb_hole_addr.rb_left));
+	max = max_t(unsigned long, max,
+		    rb_subtree_max_hole(node->rb_hole_addr.rb_right));
+
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, augment_callbacks, struct drm_mm_node,
+		     rb_hole_addr, unsigned long, subtree_max_hole,
+		     compute_subtree_max_hole)
+
+static void insert_hole_size(struct rb_root *root, struct drm_mm_node *node)
+{
+	struct rb_node **link = &root->rb_node, *rb = NULL;
+	unsigned long x = HOLE_SIZE(node);
+
+	while (*link) {
+		rb = *link;
+		if (x < HOLE_SIZE(rb_hole_size_to_node(rb)))
+			link = &rb->rb_left;
+		else
+			link = &rb->rb_right;
+	}
+
+	rb_link_node(&node->rb_hole_size, rb, link);
+	rb_insert_color(&node->rb_hole_size, root);
+}
+
+static void insert_hole_addr(struct rb_root *root, struct drm_mm_node *node)
+{
+	struct rb_node **link = &root->rb_node, *rb = NULL;
+	unsigned long start = HOLE_ADDR(node), size = HOLE_SIZE(node);
+	struct drm_mm_node *parent;
+
+	while (*link) {
+		rb = *link;
+		parent = rb_hole_addr_to_node(rb);
+		if (parent->subtree_max_hole < size)
+			parent->subtree_max_hole = size;
+		if (start < HOLE_ADDR(parent))
+			link = &rb->rb_left;
+		else
+			link = &rb->rb_right;
+	}
+
+	node->subtree_max_hole = size;
+	rb_link_node(&node->rb_hole_addr, rb, link);
+	rb_insert_augmented(&node->rb_hole_addr, root, &augment_callbacks);
+}
+
+/*
+ * Index the hole following @node in the size and address trees. The hole
+ * size is cached in the node since the key of the size tree must not change
+ * while the node is linked into it, and the end of the hole depends upon the
+ * next node in the list.
+ */
+static void add_hole(struct drm_mm_node *node)
+{
+	struct drm_mm *mm = node->mm;
+
+	node->hole_size =
+		__drm_mm_hole_node_end(node) - __drm_mm_hole_node_start(node);
+
+	insert_hole_size(&mm->holes_size, node);
+	insert_hole_addr(&mm->holes_addr, node);
+}
+
+static void rm_hole(struct drm_mm_node *node)
+{
+	struct drm_mm *mm = node->mm;
+
+	rb_erase(&node->rb_hole_size, &mm->holes_size);
+	rb_erase_augmented(&node->rb_hole_addr, &mm->holes_addr,
+			   &augment_callbacks);
+	node->hole_size = 0;
+}
+
+/* Smallest hole which is at least @size big. */
+static struct drm_mm_node *best_hole(const struct drm_mm *mm,
+				     unsigned long size)
+{
+	struct rb_node *rb = mm->holes_size.rb_node;
+	struct drm_mm_node *best = NULL;
+
+	while (rb) {
+		struct drm_mm_node *node = rb_hole_size_to_node(rb);
+
+		if (size <= HOLE_SIZE(node)) {
+			best = node;
+			rb = rb->rb_left;
+		} else {
+			rb = rb->rb_right;
+		}
+	}
+
+	return best;
+}
+
+static unsigned long largest_hole(const struct drm_mm *mm)
+{
+	return rb_subtree_max_hole(mm->holes_addr.rb_node);
+}
+
+/* Hole with the highest start address below @end. */
+static struct drm_mm_node *find_hole_below(const struct drm_mm *mm,
+					   unsigned long end)
+{
+	struct rb_node *rb = mm->holes_addr.rb_node;
+	struct drm_mm_node *best = NULL;
+
+	while (rb) {
+		struct drm_mm_node *node = rb_hole_addr_to_node(rb);
+
+		if (HOLE_ADDR(node) < end) {
+			best = node;
+			rb = rb->rb_right;
+		} else {
+			rb = rb->rb_left;
+		}
+	}
+
+	return best;
+}
+
+static inline bool usable_hole_addr(struct rb_node *rb, unsigned long size)
+{
+	return rb && rb_hole_addr_to_node(rb)->subtree_max_hole >= size;
+}
+
+/*
+ * Step to the next lower hole in the address tree, skipping all subtrees
+ * which don't contain a hole of at least @size. The returned hole itself
+ * might still be too small, callers need to check it.
+ */
+static struct drm_mm_node *next_hole_high_addr(struct drm_mm_node *entry,
+					       unsigned long size)
+{
+	struct rb_node *parent, *rb = &entry->rb_hole_addr;
+
+	if (usable_hole_addr(rb->rb_left, size)) {
+		rb = rb->rb_left;
+		while (usable_hole_addr(rb->rb_right, size))
+			rb = rb->rb_right;
+		return rb_hole_addr_to_node(rb);
+	}
+
+	while ((parent = rb_parent(rb)) && rb == parent->rb_left)
+		rb = parent;
+
+	return rb_hole_addr_to_node(parent);
+}
+
 static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 				 struct drm_mm_node *node,
 				 unsigned long size, unsigned alignment,
@@ -136,6 +324,7 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 	BUG_ON(adj_start < hole_start);
 	BUG_ON(adj_end > hole_end);
 
+	rm_hole(hole_node);
 	if (adj_start == hole_start) {
 		hole_node->hole_follows = 0;
 		list_del(&hole_node->hole_stack);
@@ -149,6 +338,8 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 
 	INIT_LIST_HEAD(&node->hole_stack);
 	list_add(&node->node_list, &hole_node->node_list);
+	if (hole_node->hole_follows)
+		add_hole(hole_node);
 
 	BUG_ON(node->start + node->size > adj_end);
 
@@ -156,6 +347,7 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 	if (__drm_mm_hole_node_start(node) < hole_end) {
 		list_add(&node->hole_stack, &mm->hole_stack);
 		node->hole_follows = 1;
+		add_hole(node);
 	}
 }
 
@@ -190,18 +382,23 @@ int drm_mm_reserve_node(struct drm_mm *mm, struct drm_mm_node *node)
 		node->mm = mm;
 		node->allocated = 1;
 
+		rm_hole(hole);
+
 		INIT_LIST_HEAD(&node->hole_stack);
 		list_add(&node->node_list, &hole->node_list);
 
 		if (node->start == hole_start) {
 			hole->hole_follows = 0;
 			list_del_init(&hole->hole_stack);
+		} else {
+			add_hole(hole);
 		}
 
 		node->hole_follows = 0;
 		if (end != hole_end) {
 			list_add(&node->hole_stack, &mm->hole_stack);
 			node->hole_follows = 1;
+			add_hole(node);
 		}
 
 		return 0;
@@ -280,6 +477,7 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 		}
 	}
 
+	rm_hole(hole_node);
 	if (adj_start == hole_start) {
 		hole_node->hole_follows = 0;
 		list_del(&hole_node->hole_stack);
@@ -293,6 +491,8 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 
 	INIT_LIST_HEAD(&node->hole_stack);
 	list_add(&node->node_list, &hole_node->node_list);
+	if (hole_node->hole_follows)
+		add_hole(hole_node);
 
 	BUG_ON(node->start < start);
 	BUG_ON(node->start < adj_start);
@@ -303,6 +503,7 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 	if (__drm_mm_hole_node_start(node) < hole_end) {
 		list_add(&node->hole_stack, &mm->hole_stack);
 		node->hole_follows = 1;
+		add_hole(node);
 	}
 }
 
@@ -371,6 +572,7 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 		BUG_ON(__drm_mm_hole_node_start(node) ==
 		       __drm_mm_hole_node_end(node));
 		list_del(&node->hole_stack);
+		rm_hole(node);
 	} else
 		BUG_ON(__drm_mm_hole_node_start(node) !=
 		       __drm_mm_hole_node_end(node));
@@ -379,10 +581,13 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	if (!prev_node->hole_follows) {
 		prev_node->hole_follows = 1;
 		list_add(&prev_node->hole_stack, &mm->hole_stack);
-	} else
+	} else {
 		list_move(&prev_node->hole_stack, &mm->hole_stack);
+		rm_hole(prev_node);
+	}
 
 	list_del(&node->node_list);
+	add_hole(prev_node);
 	node->allocated = 0;
 }
 EXPORT_SYMBOL(drm_mm_remove_node);
@@ -408,40 +613,33 @@ static struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
 						      unsigned long color,
 						      enum drm_mm_search_flags flags)
 {
-	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	unsigned long adj_start;
-	unsigned long adj_end;
-	unsigned long best_size;
-
-	BUG_ON(mm->scanned_blocks);
-
-	best = NULL;
-	best_size = ~0UL;
-
-	__drm_mm_for_each_hole(entry, mm, adj_start, adj_end,
-			       flags & DRM_MM_SEARCH_BELOW) {
-		unsigned long hole_size = adj_end - adj_start;
-
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
-				continue;
-		}
+	return drm_mm_search_free_in_range_generic(mm, size, alignment, color,
+						   0, ~0UL, flags);
+}
 
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
-			continue;
+static bool drm_mm_hole_fits(const struct drm_mm *mm,
+			     struct drm_mm_node *entry,
+			     unsigned long size,
+			     unsigned alignment,
+			     unsigned long color,
+			     unsigned long start,
+			     unsigned long end)
+{
+	unsigned long adj_start = drm_mm_hole_node_start(entry);
+	unsigned long adj_end = drm_mm_hole_node_end(entry);
 
-		if (!(flags & DRM_MM_SEARCH_BEST))
-			return entry;
+	if (adj_start < start)
+		adj_start = start;
+	if (adj_end > end)
+		adj_end = end;
 
-		if (hole_size < best_size) {
-			best = entry;
-			best_size = hole_size;
-		}
+	if (mm->color_adjust) {
+		mm->color_adjust(entry, color, &adj_start, &adj_end);
+		if (adj_end <= adj_start)
+			return false;
 	}
 
-	return best;
+	return check_free_hole(adj_start, adj_end, size, alignment);
 }
 
 static struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_mm *mm,
@@ -453,44 +651,52 @@ static struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_
 							enum drm_mm_search_flags flags)
 {
 	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	unsigned long adj_start;
-	unsigned long adj_end;
-	unsigned long best_size;
 
 	BUG_ON(mm->scanned_blocks);
 
-	best = NULL;
-	best_size = ~0UL;
+	if (largest_hole(mm) < size)
+		return NULL;
 
-	__drm_mm_for_each_hole(entry, mm, adj_start, adj_end,
-			       flags & DRM_MM_SEARCH_BELOW) {
-		unsigned long hole_size = adj_end - adj_start;
+	if (flags & DRM_MM_SEARCH_BEST) {
+		/* Walk up the size tree, starting at the smallest fit. */
+		for (entry = best_hole(mm, size); entry;
+		     entry = rb_hole_size_to_node(rb_next(&entry->rb_hole_size))) {
+			if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+					     start, end))
+				return entry;
+		}
 
-		if (adj_start < start)
-			adj_start = start;
-		if (adj_end > end)
-			adj_end = end;
+		return NULL;
+	}
+
+	if (flags & DRM_MM_SEARCH_BELOW) {
+		/* Walk down the address tree, starting below @end. */
+		for (entry = find_hole_below(mm, end); entry;
+		     entry = next_hole_high_addr(entry, size)) {
+			if (drm_mm_hole_node_end(entry) <= start)
+				break;
 
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
+			if (HOLE_SIZE(entry) < size)
 				continue;
+
+			if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+					     start, end))
+				return entry;
 		}
 
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
+		return NULL;
+	}
+
+	list_for_each_entry(entry, &mm->hole_stack, hole_stack) {
+		if (HOLE_SIZE(entry) < size)
 			continue;
 
-		if (!(flags & DRM_MM_SEARCH_BEST))
+		if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+				     start, end))
 			return entry;
-
-		if (hole_size < best_size) {
-			best = entry;
-			best_size = hole_size;
-		}
 	}
 
-	return best;
+	return NULL;
 }
 
 /**
@@ -506,7 +712,15 @@ void drm_mm_replace_node(struct drm_mm_node *old, struct drm_mm_node *new)
 {
 	list_replace(&old->node_list, &new->node_list);
 	list_replace(&old->hole_stack, &new->hole_stack);
+	if (old->hole_follows) {
+		rb_replace_node(&old->rb_hole_size, &new->rb_hole_size,
+				&old->mm->holes_size);
+		rb_replace_node(&old->rb_hole_addr, &new->rb_hole_addr,
+				&old->mm->holes_addr);
+	}
 	new->hole_follows = old->hole_follows;
+	new->hole_size = old->hole_size;
+	new->subtree_max_hole = old->subtree_max_hole;
 	new->mm = old->mm;
 	new->start = old->start;
 	new->size = old->size;
@@ -679,7 +893,7 @@ EXPORT_SYMBOL(drm_mm_scan_add_block);
  * corrupted.
  *
  * When the scan list is empty, the selected memory nodes can be freed. An
- * immediately following drm_mm_search_free with !DRM_MM_SEARCH_BEST will then
+ * immediately following drm_mm_search_free with DRM_MM_SEARCH_DEFAULT will then
  * return the just freed block (because its at the top of the free_stack list).
  *
  * Returns:
@@ -734,6 +948,8 @@ EXPORT_SYMBOL(drm_mm_clean);
 void drm_mm_init(struct drm_mm * mm, unsigned long start, unsigned long size)
 {
 	INIT_LIST_HEAD(&mm->hole_stack);
+	mm->holes_size = RB_ROOT;
+	mm->holes_addr = RB_ROOT;
 	mm->scanned_blocks = 0;
 
 	/* Clever trick to avoid a special case in the free hole tracking. */
@@ -747,6 +963,7 @@ void drm_mm_init(struct drm_mm * mm, unsigned long start, unsigned long size)
 	mm->head_node.start = start + size;
 	mm->head_node.size = start - mm->head_node.start;
 	list_add_tail(&mm->head_node.hole_stack, &mm->hole_stack);
+	add_hole(&mm->head_node);
 
 	mm->color_adjust = NULL;
 }
@@ -766,6 +983,19 @@ void drm_mm_takedown(struct drm_mm * mm)
 }
 EXPORT_SYMBOL(drm_mm_takedown);
 
+/*
+ * Fragmentation is the share of free space which can't be handed out in one
+ * piece, i.e. 0 if all free space is in a single hole.
+ */
+static unsigned long drm_mm_fragmentation(const struct drm_mm *mm,
+					  unsigned long total_free)
+{
+	if (!total_free)
+		return 0;
+
+	return 100 - div64_u64(100ULL * largest_hole(mm), total_free);
+}
+
 static unsigned long drm_mm_debug_hole(struct drm_mm_node *entry,
 				       const char *prefix)
 {
@@ -793,8 +1023,10 @@ void drm_mm_debug_table(struct drm_mm *mm, const char *prefix)
 {
 	struct drm_mm_node *entry;
 	unsigned long total_used = 0, total_free = 0, total = 0;
+	unsigned long nodes = 0, holes = 0;
 
 	total_free += drm_mm_debug_hole(&mm->head_node, prefix);
+	holes += mm->head_node.hole_follows;
 
 	drm_mm_for_each_node(entry, mm) {
 		printk(KERN_DEBUG "%s 0x%08lx-0x%08lx: %8lu: used\n",
@@ -802,11 +1034,16 @@ void drm_mm_debug_table(struct drm_mm *mm, const char *prefix)
 			entry->size);
 		total_used += entry->size;
 		total_free += drm_mm_debug_hole(entry, prefix);
+		holes += entry->hole_follows;
+		nodes++;
 	}
 	total = total_free + total_used;
 
 	printk(KERN_DEBUG "%s total: %lu, used %lu free %lu\n", prefix, total,
 		total_used, total_free);
+	printk(KERN_DEBUG "%s nodes: %lu, holes %lu, largest hole %lu, fragmentation %lu%%\n",
+		prefix, nodes, holes, largest_hole(mm),
+		drm_mm_fragmentation(mm, total_free));
 }
 EXPORT_SYMBOL(drm_mm_debug_table);
 
@@ -836,8 +1073,10 @@ int drm_mm_dump_table(struct seq_file *m, struct drm_mm *mm)
 {
 	struct drm_mm_node *entry;
 	unsigned long total_used = 0, total_free = 0, total = 0;
+	unsigned long nodes = 0, holes = 0;
 
 	total_free += drm_mm_dump_hole(m, &mm->head_node);
+	holes += mm->head_node.hole_follows;
 
 	drm_mm_for_each_node(entry, mm) {
 		seq_printf(m, "0x%08lx-0x%08lx: 0x%08lx: used\n",
@@ -845,10 +1084,15 @@ int drm_mm_dump_table(struct seq_file *m, struct drm_mm *mm)
 				entry->size);
 		total_used += entry->size;
 		total_free += drm_mm_dump_hole(m, entry);
+		holes += entry->hole_follows;
+		nodes++;
 	}
 	total = total_free + total_used;
 
 	seq_printf(m, "total: %lu, used %lu free %lu\n", total, total_used, total_free);
+	seq_printf(m, "nodes: %lu, holes %lu, largest hole %lu, fragmentation %lu%%\n",
+		   nodes, holes, largest_hole(mm),
+		   drm_mm_fragmentation(mm, total_free));
 	return 0;
 }
 EXPORT_SYMBOL(drm_mm_dump_table);
@@ -29,6 +29,8 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -66,8 +68,20 @@
  * open-file with the offset of the node will fail with -EACCES. To revoke
  * access again, use drm_vma_node_revoke(). However, the caller is responsible
  * for destroying already existing mappings, if required.
+ *
+ * drm_vma_node_is_allowed() doesn't take any shared lock in the common case, as
+ * it runs on every mmap(). The file rb-tree is walked under RCU and the result
+ * is validated against a seqcount which writers bump under the node's
+ * write-lock. A lockless walk might observe the rb-tree in the middle of a
+ * rotation, hence it is bounded in depth and retried under the read-lock if a
+ * writer raced with it. Offset lookups still take the manager's read-lock:
+ * their callers need to take a reference on the object behind the node, which
+ * is only safe while the node can't be removed.
  */
 
+/* Upper bound on the depth of a valid rb-tree, see lib/rbtree.c */
+#define DRM_VMA_MAX_DEPTH	(2 * BITS_PER_LONG)
+
 /**
  * drm_vma_offset_manager_init - Initialize new offset-manager
  * @mgr: Manager object
@@ -346,8 +360,10 @@ int drm_vma_node_allow(struct drm_vma_offset_node *node, struct file *filp)
 
 	new->vm_filp = filp;
 	new->vm_count = 1;
+	write_seqcount_begin(&node->vm_files_seq);
 	rb_link_node(&new->vm_rb, parent, iter);
 	rb_insert_color(&new->vm_rb, &node->vm_files);
+	write_seqcount_end(&node->vm_files_seq);
 	new = NULL;
 
 unlock:
@@ -382,8 +398,10 @@ void drm_vma_node_revoke(struct drm_vma_offset_node *node, struct file *filp)
 		entry = rb_entry(iter, struct drm_vma_offset_file, vm_rb);
 		if (filp == entry->vm_filp) {
 			if (!--entry->vm_count) {
+				write_seqcount_begin(&node->vm_files_seq);
 				rb_erase(&entry->vm_rb, &node->vm_files);
-				kfree(entry);
+				write_seqcount_end(&node->vm_files_seq);
+				kfree_rcu(entry, rcu);
 			}
 			break;
 		} else if (filp > entry->vm_filp) {
@@ -397,6 +415,33 @@ void drm_vma_node_revoke(struct drm_vma_offset_node *node, struct file *filp)
 }
 EXPORT_SYMBOL(drm_vma_node_revoke);
 
+static bool __drm_vma_node_is_allowed(struct drm_vma_offset_node *node,
+				      struct file *filp, unsigned int depth,
+				      bool *valid)
+{
+	struct drm_vma_offset_file *entry;
+	struct rb_node *iter;
+
+	iter = rcu_dereference_raw(node->vm_files.rb_node);
+	while (likely(iter)) {
+		if (unlikely(!depth--)) {
+			*valid = false;
+			return false;
+		}
+
+		entry = rb_entry(iter, struct drm_vma_offset_file, vm_rb);
+		if (filp == entry->vm_filp)
+			break;
+		else if (filp > entry->vm_filp)
+			iter = rcu_dereference_raw(iter->rb_right);
+		else
+			iter = rcu_dereference_raw(iter->rb_left);
+	}
+
+	*valid = true;
+	return iter;
+}
+
 /**
  * drm_vma_node_is_allowed - Check whether an open-file is granted access
  * @node: Node to check
@@ -413,24 +458,23 @@ EXPORT_SYMBOL(drm_vma_node_revoke);
 bool drm_vma_node_is_allowed(struct drm_vma_offset_node *node,
 			     struct file *filp)
 {
-	struct drm_vma_offset_file *entry;
-	struct rb_node *iter;
+	unsigned int seq;
+	bool allowed, valid;
 
-	read_lock(&node->vm_lock);
+	rcu_read_lock();
+	seq = read_seqcount_begin(&node->vm_files_seq);
+	allowed = __drm_vma_node_is_allowed(node, filp, DRM_VMA_MAX_DEPTH,
+					    &valid);
+	valid &= !read_seqcount_retry(&node->vm_files_seq, seq);
+	rcu_read_unlock();
 
-	iter = node->vm_files.rb_node;
-	while (likely(iter)) {
-		entry = rb_entry(iter, struct drm_vma_offset_file, vm_rb);
-		if (filp == entry->vm_filp)
-			break;
-		else if (filp > entry->vm_filp)
-			iter = iter->rb_right;
-		else
-			iter = iter->rb_left;
-	}
+	if (likely(valid))
+		return allowed;
 
+	read_lock(&node->vm_lock);
+	allowed = __drm_vma_node_is_allowed(node, filp, UINT_MAX, &valid);
 	read_unlock(&node->vm_lock);
 
-	return iter;
+	return allowed;
 }
 EXPORT_SYMBOL(drm_vma_node_is_allowed);
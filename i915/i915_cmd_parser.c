@@ -25,6 +25,8 @@
  *
  */
 
+#include <linux/bsearch.h>
+#include <linux/jhash.h>
 #include "i915_drv.h"
 
 /**
@@ -569,34 +571,55 @@ static bool validate_regs_sorted(struct intel_engine_cs *ring)
 			     ring->master_reg_count);
 }
 
-struct cmd_node {
-	const struct drm_i915_cmd_descriptor *desc;
-	struct hlist_node node;
-};
-
 /*
  * Different command ranges have different numbers of bits for the opcode. For
  * example, MI commands use bits 31:23 while 3D commands use bits 31:16. The
  * problem is that, for example, MI commands use bits 22:16 for other fields
- * such as GGTT vs PPGTT bits. If we include those bits in the mask then when
- * we mask a command from a batch it could hash to the wrong bucket due to
- * non-opcode bits being set. But if we don't include those bits, some 3D
- * commands may hash to the same bucket due to not including opcode bits that
- * make the command unique. For now, we will risk hashing to the same bucket.
+ * such as GGTT vs PPGTT bits. So the decoder indexes on bits 31:23 only, which
+ * is the full opcode for MI commands and never picks up non-opcode bits from
+ * any client. Each of the 512 slots lists the descriptors whose opcode shares
+ * those bits; MI commands, the bulk of most batches, resolve on the first
+ * compare, while 3D commands from the same pipeline share a slot and are told
+ * apart by their full mask.
  *
- * If we attempt to generate a perfect hash, we should be able to look at bits
- * 31:29 of a command from a batch buffer and use the full mask for that
- * client. The existing INSTR_CLIENT_MASK/SHIFT defines can be used for this.
+ * The descriptors are packed into one array per ring, ordered by slot, with
+ * cmd_index.first[] holding the start of each slot. Within a slot, entries from
+ * later tables come first so that ring specific descriptors override the
+ * common ones.
  */
-#define CMD_HASH_MASK STD_MI_OPCODE_MASK
+static inline unsigned int cmd_index_slot(u32 cmd_header)
+{
+	return cmd_header >> I915_CMD_INDEX_SHIFT;
+}
 
-static int init_hash_table(struct intel_engine_cs *ring,
-			   const struct drm_i915_cmd_table *cmd_tables,
-			   int cmd_table_count)
+static int init_cmd_index(struct intel_engine_cs *ring,
+			  const struct drm_i915_cmd_table *cmd_tables,
+			  int cmd_table_count)
 {
+	const struct drm_i915_cmd_descriptor **descs;
+	u16 *first = ring->cmd_index.first;
+	unsigned int slot, total = 0;
 	int i, j;
 
-	hash_init(ring->cmd_hash);
+	memset(ring->cmd_index.first, 0, sizeof(ring->cmd_index.first));
+
+	for (i = 0; i < cmd_table_count; i++) {
+		const struct drm_i915_cmd_table *table = &cmd_tables[i];
+
+		for (j = 0; j < table->count; j++)
+			first[cmd_index_slot(table->table[j].cmd.value)]++;
+
+		total += table->count;
+	}
+
+	descs = kmalloc_array(total, sizeof(*descs), GFP_KERNEL);
+	if (!descs)
+		return -ENOMEM;
+
+	/* Turn the counts into the end of each slot, then fill backwards */
+	for (slot = 1; slot < I915_CMD_INDEX_SIZE; slot++)
+		first[slot] += first[slot - 1];
+	first[I915_CMD_INDEX_SIZE] = total;
 
 	for (i = 0; i < cmd_table_count; i++) {
 		const struct drm_i915_cmd_table *table = &cmd_tables[i];
@@ -604,31 +627,20 @@ static int init_hash_table(struct intel_engine_cs *ring,
 		for (j = 0; j < table->count; j++) {
 			const struct drm_i915_cmd_descriptor *desc =
 				&table->table[j];
-			struct cmd_node *desc_node =
-				kmalloc(sizeof(*desc_node), GFP_KERNEL);
-
-			if (!desc_node)
-				return -ENOMEM;
 
-			desc_node->desc = desc;
-			hash_add(ring->cmd_hash, &desc_node->node,
-				 desc->cmd.value & CMD_HASH_MASK);
+			descs[--first[cmd_index_slot(desc->cmd.value)]] = desc;
 		}
 	}
 
+	ring->cmd_index.descs = descs;
+
 	return 0;
 }
 
-static void fini_hash_table(struct intel_engine_cs *ring)
+static void fini_cmd_index(struct intel_engine_cs *ring)
 {
-	struct hlist_node *tmp;
-	struct cmd_node *desc_node;
-	int i;
-
-	hash_for_each_safe(ring->cmd_hash, i, tmp, desc_node, node) {
-		hash_del(&desc_node->node);
-		kfree(desc_node);
-	}
+	kfree(ring->cmd_index.descs);
+	ring->cmd_index.descs = NULL;
 }
 
 /**
@@ -716,15 +728,20 @@ int i915_cmd_parser_init_ring(struct intel_engine_cs *ring)
 	BUG_ON(!validate_cmds_sorted(ring, cmd_tables, cmd_table_count));
 	BUG_ON(!validate_regs_sorted(ring));
 
-	if (hash_empty(ring->cmd_hash)) {
-		ret = init_hash_table(ring, cmd_tables, cmd_table_count);
+	if (!ring->cmd_index.descs) {
+		ret = init_cmd_index(ring, cmd_tables, cmd_table_count);
 		if (ret) {
 			DRM_ERROR("CMD: cmd_parser_init failed!\n");
-			fini_hash_table(ring);
 			return ret;
 		}
 	}
 
+	if (!ring->needs_cmd_parser) {
+		hash_init(ring->cmd_cache.hash);
+		INIT_LIST_HEAD(&ring->cmd_cache.lru);
+		ring->cmd_cache.count = 0;
+	}
+
 	ring->needs_cmd_parser = true;
 
 	return 0;
@@ -742,18 +759,21 @@ void i915_cmd_parser_fini_ring(struct intel_engine_cs *ring)
 	if (!ring->needs_cmd_parser)
 		return;
 
-	fini_hash_table(ring);
+	i915_cmd_parser_cache_flush(ring);
+	fini_cmd_index(ring);
 }
 
 static const struct drm_i915_cmd_descriptor*
 find_cmd_in_table(struct intel_engine_cs *ring,
 		  u32 cmd_header)
 {
-	struct cmd_node *desc_node;
+	unsigned int slot = cmd_index_slot(cmd_header);
+	unsigned int i;
 
-	hash_for_each_possible(ring->cmd_hash, desc_node, node,
-			       cmd_header & CMD_HASH_MASK) {
-		const struct drm_i915_cmd_descriptor *desc = desc_node->desc;
+	for (i = ring->cmd_index.first[slot];
+	     i < ring->cmd_index.first[slot + 1]; i++) {
+		const struct drm_i915_cmd_descriptor *desc =
+			ring->cmd_index.descs[i];
 		u32 masked_cmd = desc->cmd.mask & cmd_header;
 		u32 masked_value = desc->cmd.value & desc->cmd.mask;
 
@@ -795,18 +815,26 @@ find_cmd(struct intel_engine_cs *ring,
 	return default_desc;
 }
 
-static bool valid_reg(const u32 *table, int count, u32 addr)
+static int cmp_reg(const void *key, const void *elt)
 {
-	if (table && count != 0) {
-		int i;
+	u32 a = *(const u32 *)key;
+	u32 b = *(const u32 *)elt;
 
-		for (i = 0; i < count; i++) {
-			if (table[i] == addr)
-				return true;
-		}
-	}
+	if (a < b)
+		return -1;
+	return a > b;
+}
 
-	return false;
+/*
+ * The register tables are checked to be sorted at ring init, see
+ * validate_regs_sorted(), so the whitelist can be binary searched.
+ */
+static bool valid_reg(const u32 *table, int count, u32 addr)
+{
+	if (!table || count == 0)
+		return false;
+
+	return bsearch(&addr, table, count, sizeof(*table), cmp_reg) != NULL;
 }
 
 static u32 *vmap_batch(struct drm_i915_gem_object *obj)
@@ -952,6 +980,123 @@ static bool check_cmd(const struct intel_engine_cs *ring,
 
 #define LENGTH_BIAS 2
 
+/*
+ * Validated batch cache
+ *
+ * Userspace tends to resubmit identical batches (e.g. the same blit or state
+ * setup every frame), and each of them pays for a full walk through the
+ * parser. Batches that pass are remembered per ring by their contents, up to
+ * and including the MI_BATCH_BUFFER_END. The lookup key is a hash of the
+ * first few dwords salted with the parser version, and a hit is only taken
+ * after comparing the complete validated range against the stored copy. A
+ * batch rewritten by the CPU or the GPU since it was last parsed therefore
+ * simply misses, whichever domain the write went through, and an entry can
+ * never vouch for contents that were not themselves parsed.
+ */
+#define CMD_CACHE_KEY_DWORDS 16
+#define CMD_CACHE_MAX_DWORDS ((4 * PAGE_SIZE) / sizeof(u32))
+#define CMD_CACHE_MAX_ENTRIES 64
+
+struct cmd_cache_entry {
+	struct hlist_node node;
+	struct list_head lru;
+	u32 key;
+	u32 length;
+	bool is_master;
+	u32 cmds[];
+};
+
+static u32 cmd_cache_key(const u32 *cmd, const u32 *batch_end)
+{
+	u32 count = min_t(u32, batch_end - cmd, CMD_CACHE_KEY_DWORDS);
+
+	return jhash2(cmd, count, i915_cmd_parser_get_version());
+}
+
+static void cmd_cache_remove(struct intel_engine_cs *ring,
+			     struct cmd_cache_entry *entry)
+{
+	hash_del(&entry->node);
+	list_del(&entry->lru);
+	ring->cmd_cache.count--;
+	kfree(entry);
+}
+
+static bool cmd_cache_lookup(struct intel_engine_cs *ring, u32 key,
+			     const u32 *cmd, const u32 *batch_end,
+			     bool is_master)
+{
+	struct cmd_cache_entry *entry;
+
+	hash_for_each_possible(ring->cmd_cache.hash, entry, node, key) {
+		if (entry->key != key)
+			continue;
+
+		/* Master-only commands are rejected for everyone else */
+		if (entry->is_master && !is_master)
+			continue;
+
+		if (entry->length > batch_end - cmd)
+			continue;
+
+		if (memcmp(entry->cmds, cmd, entry->length * sizeof(u32)))
+			continue;
+
+		list_move(&entry->lru, &ring->cmd_cache.lru);
+		return true;
+	}
+
+	return false;
+}
+
+static void cmd_cache_insert(struct intel_engine_cs *ring, u32 key,
+			     const u32 *cmd, u32 length, bool is_master)
+{
+	struct cmd_cache_entry *entry;
+
+	if (length > CMD_CACHE_MAX_DWORDS)
+		return;
+
+	entry = kmalloc(sizeof(*entry) + length * sizeof(u32),
+			GFP_KERNEL | __GFP_NORETRY | __GFP_NOWARN);
+	if (!entry)
+		return;
+
+	if (ring->cmd_cache.count >= CMD_CACHE_MAX_ENTRIES) {
+		cmd_cache_remove(ring,
+				 list_last_entry(&ring->cmd_cache.lru,
+						 struct cmd_cache_entry, lru));
+		ring->cmd_cache.evictions++;
+	}
+
+	entry->key = key;
+	entry->length = length;
+	entry->is_master = is_master;
+	memcpy(entry->cmds, cmd, length * sizeof(u32));
+
+	hash_add(ring->cmd_cache.hash, &entry->node, key);
+	list_add(&entry->lru, &ring->cmd_cache.lru);
+	ring->cmd_cache.count++;
+}
+
+/**
+ * i915_cmd_parser_cache_flush() - drop all validated batches for a ring
+ * @ring: the ring whose cache to empty
+ *
+ * Frees every entry in the ring's validated batch cache. Called with
+ * struct_mutex held, or during ring teardown.
+ */
+void i915_cmd_parser_cache_flush(struct intel_engine_cs *ring)
+{
+	struct cmd_cache_entry *entry, *next;
+
+	if (!ring->needs_cmd_parser)
+		return;
+
+	list_for_each_entry_safe(entry, next, &ring->cmd_cache.lru, lru)
+		cmd_cache_remove(ring, entry);
+}
+
 /**
  * i915_parse_cmds() - parse a submitted batch buffer for privilege violations
  * @ring: the ring on which the batch is to execute
@@ -960,7 +1105,8 @@ static bool check_cmd(const struct intel_engine_cs *ring,
  * @is_master: is the submitting process the drm master?
  *
  * Parses the specified batch buffer looking for privilege violations as
- * described in the overview.
+ * described in the overview. Batches identical to one that already passed on
+ * this ring are accepted from the validated batch cache without a parse.
  *
  * Return: non-zero if the parser finds violations or otherwise fails; -EACCES
  * if the batch appears legal but should use hardware parsing
@@ -971,8 +1117,9 @@ int i915_parse_cmds(struct intel_engine_cs *ring,
 		    bool is_master)
 {
 	int ret = 0;
-	u32 *cmd, *batch_base, *batch_end;
+	u32 *cmd, *batch_base, *batch_end, *batch_start;
 	struct drm_i915_cmd_descriptor default_desc = { 0 };
+	u32 key;
 	int needs_clflush = 0;
 	bool oacontrol_set = false; /* OACONTROL tracking. See check_cmd() */
 
@@ -994,6 +1141,14 @@ int i915_parse_cmds(struct intel_engine_cs *ring,
 
 	cmd = batch_base + (batch_start_offset / sizeof(*cmd));
 	batch_end = cmd + (batch_obj->base.size / sizeof(*batch_end));
+	batch_start = cmd;
+
+	key = cmd_cache_key(cmd, batch_end);
+	if (cmd_cache_lookup(ring, key, cmd, batch_end, is_master)) {
+		ring->cmd_cache.hits++;
+		goto out;
+	}
+	ring->cmd_cache.misses++;
 
 	while (cmd < batch_end) {
 		const struct drm_i915_cmd_descriptor *desc;
@@ -1052,6 +1207,11 @@ int i915_parse_cmds(struct intel_engine_cs *ring,
 		ret = -EINVAL;
 	}
 
+	if (ret == 0)
+		cmd_cache_insert(ring, key, batch_start,
+				 cmd - batch_start + 1, is_master);
+
+out:
 	vunmap(batch_base);
 
 	i915_gem_object_unpin_pages(batch_obj);
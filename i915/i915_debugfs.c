@@ -314,6 +314,10 @@ static int per_file_stats(int id, void *ptr, void *data)
 	struct file_stats *stats = data;
 	struct i915_vma *vma;
 
+	/* a handle in the middle of being closed */
+	if (obj == NULL)
+		return 0;
+
 	stats->count++;
 	stats->total += obj->base.size;
 
@@ -836,6 +840,157 @@ static int i915_interrupt_info(struct seq_file *m, void *data)
 	return 0;
 }
 
+static int i915_gem_retire_latency(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct intel_engine_cs *ring;
+	int i, j, ret;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		return ret;
+
+	for_each_ring(ring, dev_priv, i) {
+		seq_printf(m, "%s: retire irq %s\n", ring->name,
+			   yesno(ring->retire_irq));
+
+		for (j = 0; j < I915_RETIRE_LATENCY_BUCKETS; j++) {
+			if (!ring->retire_latency[j])
+				continue;
+
+			if (j == 0)
+				seq_puts(m, "        <1us");
+			else if (j == I915_RETIRE_LATENCY_BUCKETS - 1)
+				seq_printf(m, "  >=%7uus", 1 << (j - 1));
+			else
+				seq_printf(m, "  <%8uus", 1 << j);
+			seq_printf(m, ": %llu\n", ring->retire_latency[j]);
+		}
+	}
+
+	mutex_unlock(&dev->struct_mutex);
+
+	return 0;
+}
+
+static int i915_gem_wait_stats(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct intel_engine_cs *ring;
+	int i;
+
+	for_each_ring(ring, dev_priv, i) {
+		u64 waits = ring->wait_stats.waits;
+
+		seq_printf(m, "%s:\n", ring->name);
+		seq_printf(m, "  waits: %llu\n", waits);
+		seq_printf(m, "  spin hits: %llu\n", ring->wait_stats.spin_hits);
+		seq_printf(m, "  sleeps: %llu\n", ring->wait_stats.sleeps);
+		seq_printf(m, "  average wait: %lluns (recent %lluns)\n",
+			   waits ? div64_u64(ring->wait_stats.total_ns, waits) : 0,
+			   ring->wait_stats.avg_ns);
+	}
+
+	return 0;
+}
+
+static int i915_gem_ggtt_flushes(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	u64 batches;
+	int ret;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		return ret;
+
+	batches = dev_priv->gtt.stats.batches;
+	seq_printf(m, "GGTT flushes: %llu\n", dev_priv->gtt.stats.flushes);
+	seq_printf(m, "execbuf bind batches: %llu\n", batches);
+	seq_printf(m, "  flushes issued: %llu\n",
+		   dev_priv->gtt.stats.batch_flushes);
+	seq_printf(m, "  binds coalesced: %llu\n",
+		   dev_priv->gtt.stats.batched_binds);
+	if (batches)
+		seq_printf(m, "  binds per execbuf: %llu.%02llu\n",
+			   div64_u64(dev_priv->gtt.stats.batched_binds, batches),
+			   div64_u64(dev_priv->gtt.stats.batched_binds * 100,
+				     batches) % 100);
+
+	mutex_unlock(&dev->struct_mutex);
+
+	return 0;
+}
+
+static int i915_gem_reclaimable_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	enum { PURGEABLE, UNBOUND, INACTIVE, ACTIVE, PINNED, NUM_CLASSES };
+	static const char * const names[NUM_CLASSES] = {
+		[PURGEABLE] = "purgeable",
+		[UNBOUND] = "idle unbound",
+		[INACTIVE] = "idle bound",
+		[ACTIVE] = "active",
+		[PINNED] = "pinned",
+	};
+	u32 count[NUM_CLASSES] = {};
+	size_t size[NUM_CLASSES] = {};
+	struct drm_i915_gem_object *obj;
+	int ret, i;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		return ret;
+
+	list_for_each_entry(obj, &dev_priv->mm.unbound_list, global_list) {
+		if (obj->pages_pin_count || !obj->base.filp)
+			i = PINNED;
+		else if (obj->madv == I915_MADV_DONTNEED)
+			i = PURGEABLE;
+		else
+			i = UNBOUND;
+		size[i] += obj->base.size, ++count[i];
+	}
+
+	list_for_each_entry(obj, &dev_priv->mm.bound_list, global_list) {
+		if (i915_gem_obj_is_pinned(obj) || !obj->base.filp)
+			i = PINNED;
+		else if (obj->active)
+			i = ACTIVE;
+		else if (obj->madv == I915_MADV_DONTNEED)
+			i = PURGEABLE;
+		else
+			i = INACTIVE;
+		size[i] += obj->base.size, ++count[i];
+	}
+
+	for (i = 0; i < NUM_CLASSES; i++)
+		seq_printf(m, "%s: %u objects, %zu bytes%s\n",
+			   names[i], count[i], size[i],
+			   i < ACTIVE ? " reclaimable" : "");
+
+	seq_printf(m, "\nreaper watermark: %d MiB (%s)\n",
+		   i915.reap_watermark,
+		   i915_gem_reap_below_watermark() ? "below" : "above");
+	seq_printf(m, "reaper runs: %lu\n", dev_priv->mm.reap_stats.runs);
+	seq_printf(m, "reaper purged: %lu pages\n",
+		   dev_priv->mm.reap_stats.purged_pages);
+	seq_printf(m, "reaper released unbound: %lu pages\n",
+		   dev_priv->mm.reap_stats.unbound_pages);
+
+	mutex_unlock(&dev->struct_mutex);
+
+	return 0;
+}
+
 static int i915_gem_fence_regs_info(struct seq_file *m, void *data)
 {
 	struct drm_info_node *node = m->private;
@@ -1954,6 +2109,61 @@ static int i915_gen6_forcewake_count_info(struct seq_file *m, void *data)
 	return 0;
 }
 
+static int i915_forcewake_stats(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	static const char * const names[FW_DOMAIN_ID_COUNT] = {
+		[FW_DOMAIN_ID_RENDER] = "render",
+		[FW_DOMAIN_ID_MEDIA] = "media",
+		[FW_DOMAIN_ID_BLITTER] = "blitter",
+	};
+	struct intel_uncore_fw_stats stats[FW_DOMAIN_ID_COUNT];
+	unsigned long rate[FW_DOMAIN_ID_COUNT];
+	unsigned long batches;
+	u64 now;
+	int i;
+
+	if (!dev_priv->uncore.funcs.force_wake_get) {
+		seq_puts(m, "no forcewake\n");
+		return 0;
+	}
+
+	now = ktime_get_raw_ns();
+
+	spin_lock_irq(&dev_priv->uncore.lock);
+	for (i = 0; i < FW_DOMAIN_ID_COUNT; i++) {
+		struct intel_uncore_fw_stats *fw = &dev_priv->uncore.fw_stats[i];
+		u64 elapsed = now - fw->sample_ns;
+
+		/* wakes per second since the previous read of this file */
+		rate[i] = 0;
+		if (fw->sample_ns && elapsed)
+			rate[i] = div64_u64((u64)(fw->wakes - fw->sample_wakes) *
+					    NSEC_PER_SEC, elapsed);
+		fw->sample_wakes = fw->wakes;
+		fw->sample_ns = now;
+
+		stats[i] = *fw;
+	}
+	batches = dev_priv->uncore.fw_batches;
+	spin_unlock_irq(&dev_priv->uncore.lock);
+
+	seq_printf(m, "batches: %lu\n", batches);
+	for (i = 0; i < FW_DOMAIN_ID_COUNT; i++) {
+		if (!(dev_priv->uncore.fw_domains & BIT(i)))
+			continue;
+
+		seq_printf(m, "%s: %lu wakes, %lu wakes/s, avg ack %llu ns, max ack %llu ns\n",
+			   names[i], stats[i].wakes, rate[i],
+			   stats[i].wakes ? div64_u64(stats[i].ack_ns, stats[i].wakes) : 0,
+			   stats[i].max_ack_ns);
+	}
+
+	return 0;
+}
+
 static const char *swizzle_string(unsigned swizzle)
 {
 	switch (swizzle) {
@@ -2058,13 +2268,14 @@ static void gen8_ppgtt_info(struct seq_file *m, struct drm_device *dev)
 	struct drm_i915_private *dev_priv = dev->dev_private;
 	struct intel_engine_cs *ring;
 	struct i915_hw_ppgtt *ppgtt = dev_priv->mm.aliasing_ppgtt;
+	struct drm_file *file;
 	int unused, i;
 
-	if (!ppgtt)
-		return;
+	if (ppgtt) {
+		seq_printf(m, "Page directories: %d\n", ppgtt->num_pd_pages);
+		seq_printf(m, "Page tables: %d\n", ppgtt->num_pd_entries);
+	}
 
-	seq_printf(m, "Page directories: %d\n", ppgtt->num_pd_pages);
-	seq_printf(m, "Page tables: %d\n", ppgtt->num_pd_entries);
 	for_each_ring(ring, dev_priv, unused) {
 		seq_printf(m, "%s\n", ring->name);
 		for (i = 0; i < 4; i++) {
@@ -2075,6 +2286,17 @@ static void gen8_ppgtt_info(struct seq_file *m, struct drm_device *dev)
 			seq_printf(m, "\tPDP%d 0x%016llx\n", i, pdp);
 		}
 	}
+
+	if (ppgtt)
+		return;
+
+	list_for_each_entry_reverse(file, &dev->filelist, lhead) {
+		struct drm_i915_file_private *file_priv = file->driver_priv;
+
+		seq_printf(m, "proc: %s\n",
+			   get_pid_task(file->pid, PIDTYPE_PID)->comm);
+		idr_for_each(&file_priv->context_idr, per_file_ctx, m);
+	}
 }
 
 static void gen6_ppgtt_info(struct seq_file *m, struct drm_device *dev)
@@ -2674,6 +2896,33 @@ static int i915_shared_dplls_info(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static int i915_cmd_parser_cache_info(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct intel_engine_cs *ring;
+	int i, ret;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		return ret;
+
+	for_each_ring(ring, dev_priv, i) {
+		if (!ring->needs_cmd_parser)
+			continue;
+
+		seq_printf(m, "%s: %u entries, %llu hits, %llu misses, %llu evictions\n",
+			   ring->name, ring->cmd_cache.count,
+			   ring->cmd_cache.hits, ring->cmd_cache.misses,
+			   ring->cmd_cache.evictions);
+	}
+
+	mutex_unlock(&dev->struct_mutex);
+
+	return 0;
+}
+
 static int i915_wa_registers(struct seq_file *m, void *unused)
 {
 	int i;
@@ -4290,6 +4539,10 @@ static const struct drm_info_list i915_debugfs_list[] = {
 	{"i915_gem_pageflip", i915_gem_pageflip_info, 0},
 	{"i915_gem_request", i915_gem_request_info, 0},
 	{"i915_gem_seqno", i915_gem_seqno_info, 0},
+	{"i915_gem_retire_latency", i915_gem_retire_latency, 0},
+	{"i915_gem_wait_stats", i915_gem_wait_stats, 0},
+	{"i915_gem_ggtt_flushes", i915_gem_ggtt_flushes, 0},
+	{"i915_gem_reclaimable", i915_gem_reclaimable_info, 0},
 	{"i915_gem_fence_regs", i915_gem_fence_regs_info, 0},
 	{"i915_gem_interrupt", i915_interrupt_info, 0},
 	{"i915_gem_hws", i915_hws_info, 0, (void *)RCS},
@@ -4309,6 +4562,7 @@ static const struct drm_info_list i915_debugfs_list[] = {
 	{"i915_dump_lrc", i915_dump_lrc, 0},
 	{"i915_execlists", i915_execlists, 0},
 	{"i915_gen6_forcewake_count", i915_gen6_forcewake_count_info, 0},
+	{"i915_forcewake_stats", i915_forcewake_stats, 0},
 	{"i915_swizzle_info", i915_swizzle_info, 0},
 	{"i915_ppgtt_info", i915_ppgtt_info, 0},
 	{"i915_llc", i915_llc, 0},
@@ -4322,6 +4576,7 @@ static const struct drm_info_list i915_debugfs_list[] = {
 	{"i915_shared_dplls_info", i915_shared_dplls_info, 0},
 	{"i915_dp_mst_info", i915_dp_mst_info, 0},
 	{"i915_wa_registers", i915_wa_registers, 0},
+	{"i915_cmd_parser_cache", i915_cmd_parser_cache_info, 0},
 	{"i915_ddb_info", i915_ddb_info, 0},
 };
 #define I915_DEBUGFS_ENTRIES ARRAY_SIZE(i915_debugfs_list)
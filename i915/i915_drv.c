@@ -1572,6 +1572,7 @@ static struct drm_driver driver = {
 	.debugfs_cleanup = i915_debugfs_cleanup,
 #endif
 	.gem_free_object = i915_gem_free_object,
+	.gem_close_object = i915_gem_close_object,
 	.gem_vm_ops = &i915_gem_vm_ops,
 
 	.prime_handle_to_fd = drm_gem_prime_handle_to_fd,
@@ -554,6 +554,14 @@ struct intel_uncore_funcs {
 				uint64_t val, bool trace);
 };
 
+enum forcewake_domain_id {
+	FW_DOMAIN_ID_RENDER = 0,
+	FW_DOMAIN_ID_MEDIA,
+	FW_DOMAIN_ID_BLITTER,
+
+	FW_DOMAIN_ID_COUNT
+};
+
 struct intel_uncore {
 	spinlock_t lock; /** lock is also taken in irq contexts. */
 
@@ -567,6 +575,26 @@ struct intel_uncore {
 	unsigned fw_blittercount;
 
 	struct timer_list force_wake_timer;
+
+	/** Hardware wake routine, funcs.force_wake_get times it */
+	void (*fw_domains_get)(struct drm_i915_private *dev_priv,
+			       int fw_engine);
+	/** Domains the platform has separate wake bits for */
+	unsigned fw_domains;
+
+	/** Domains referenced by the current forcewake batch */
+	unsigned batch_domains;
+	unsigned long batch_irqflags;
+	unsigned long fw_batches;
+
+	struct intel_uncore_fw_stats {
+		unsigned long wakes;
+		u64 ack_ns;
+		u64 max_ack_ns;
+		/* previous debugfs sample, for the wakes/s rate */
+		unsigned long sample_wakes;
+		u64 sample_ns;
+	} fw_stats[FW_DOMAIN_ID_COUNT];
 };
 
 #define DEV_INFO_FOR_EACH_FLAG(func, sep) \
@@ -682,9 +710,26 @@ struct intel_context {
 		int unpin_count;
 	} engine[I915_NUM_RINGS];
 
+	/* Object handle to vma lookups for execbuffer, see eb_lookup_vmas() */
+	struct radix_tree_root handles_vma;
+	struct list_head handles_list;
+
 	struct list_head link;
 };
 
+/*
+ * One cached handle lookup: the vma that @handle resolves to in the address
+ * space of @ctx. Linked on both the context and the vma so that it can be
+ * dropped from either side. Protected by struct_mutex.
+ */
+struct i915_ctx_handle {
+	struct intel_context *ctx;
+	struct i915_vma *vma;
+	struct list_head ctx_link;
+	struct list_head vma_link;
+	u32 handle;
+};
+
 struct i915_fbc {
 	unsigned long size;
 	unsigned threshold;
@@ -1174,6 +1219,19 @@ struct i915_gem_mm {
 	 */
 	struct delayed_work idle_work;
 
+	/**
+	 * Background reaper: releases the pages of purgeable objects as soon
+	 * as they idle, and those of idle unbound objects while free system
+	 * memory is below i915.reap_watermark, so that direct reclaim finds
+	 * less to do under struct_mutex via the shrinker.
+	 */
+	struct work_struct reap_work;
+	struct {
+		unsigned long runs;
+		unsigned long purged_pages;
+		unsigned long unbound_pages;
+	} reap_stats;
+
 	/**
 	 * Are we in a non-interruptible section of code like
 	 * modesetting?
@@ -2300,6 +2358,7 @@ struct i915_params {
 	int enable_ips;
 	int invert_brightness;
 	int enable_cmd_parser;
+	int reap_watermark;
 	/* leave bools at the end to not create holes */
 	bool enable_hangcheck;
 	bool fastboot;
@@ -2441,6 +2500,9 @@ unsigned long i915_gem_shrink(struct drm_i915_private *dev_priv,
 #define I915_SHRINK_PURGEABLE 0x1
 #define I915_SHRINK_UNBOUND 0x2
 #define I915_SHRINK_BOUND 0x4
+#define I915_SHRINK_IDLE 0x8
+bool i915_gem_reap_below_watermark(void);
+void i915_gem_queue_reap(struct drm_i915_private *dev_priv);
 void *i915_gem_object_alloc(struct drm_device *dev);
 void i915_gem_object_free(struct drm_i915_gem_object *obj);
 void i915_gem_object_init(struct drm_i915_gem_object *obj,
@@ -2450,6 +2512,7 @@ struct drm_i915_gem_object *i915_gem_alloc_object(struct drm_device *dev,
 void i915_init_vm(struct drm_i915_private *dev_priv,
 		  struct i915_address_space *vm);
 void i915_gem_free_object(struct drm_gem_object *obj);
+void i915_gem_close_object(struct drm_gem_object *gem, struct drm_file *file);
 void i915_gem_vma_destroy(struct i915_vma *vma);
 
 #define PIN_MAPPABLE 0x1
@@ -2698,6 +2761,9 @@ int i915_switch_context(struct intel_engine_cs *ring,
 struct intel_context *
 i915_gem_context_get(struct drm_i915_file_private *file_priv, u32 id);
 void i915_gem_context_free(struct kref *ctx_ref);
+int i915_gem_context_cache_vma(struct intel_context *ctx, u32 handle,
+			       struct i915_vma *vma);
+void i915_gem_context_uncache(struct i915_ctx_handle *lut);
 struct drm_i915_gem_object *
 i915_gem_alloc_context_obj(struct drm_device *dev, size_t size);
 static inline void i915_gem_context_reference(struct intel_context *ctx)
@@ -2808,6 +2874,7 @@ const char *i915_cache_level_str(struct drm_i915_private *i915, int type);
 int i915_cmd_parser_get_version(void);
 int i915_cmd_parser_init_ring(struct intel_engine_cs *ring);
 void i915_cmd_parser_fini_ring(struct intel_engine_cs *ring);
+void i915_cmd_parser_cache_flush(struct intel_engine_cs *ring);
 bool i915_needs_cmd_parser(struct intel_engine_cs *ring);
 int i915_parse_cmds(struct intel_engine_cs *ring,
 		    struct drm_i915_gem_object *batch_obj,
@@ -2929,6 +2996,9 @@ extern void intel_display_print_error_state(struct drm_i915_error_state_buf *e,
 void gen6_gt_force_wake_get(struct drm_i915_private *dev_priv, int fw_engine);
 void gen6_gt_force_wake_put(struct drm_i915_private *dev_priv, int fw_engine);
 void assert_force_wake_inactive(struct drm_i915_private *dev_priv);
+void intel_uncore_forcewake_batch_begin(struct drm_i915_private *dev_priv,
+					int fw_domains);
+void intel_uncore_forcewake_batch_end(struct drm_i915_private *dev_priv);
 
 int sandybridge_pcode_read(struct drm_i915_private *dev_priv, u32 mbox, u32 *val);
 int sandybridge_pcode_write(struct drm_i915_private *dev_priv, u32 mbox, u32 val);
@@ -2979,6 +3049,14 @@ int vlv_freq_opcode(struct drm_i915_private *dev_priv, int val);
 #define I915_READ_NOTRACE(reg)		dev_priv->uncore.funcs.mmio_readl(dev_priv, (reg), false)
 #define I915_WRITE_NOTRACE(reg, val)	dev_priv->uncore.funcs.mmio_writel(dev_priv, (reg), (val), false)
 
+/* Raw 32-bit access, only valid between intel_uncore_forcewake_batch_begin()
+ * and _end() with the register's forcewake domain in the batch. No locking,
+ * forcewake, tracing or unclaimed register checking is done.
+ */
+#define I915_READ_FW(reg)	readl(dev_priv->regs + (reg))
+#define I915_WRITE_FW(reg, val)	writel((val), dev_priv->regs + (reg))
+#define POSTING_READ_FW(reg)	(void)I915_READ_FW(reg)
+
 /* Be very careful with read/write 64-bit values. On 32-bit machines, they
  * will be implemented using 2 32-bit writes in an arbitrary order with
  * an arbitrary delay between them. This can cause the hardware to
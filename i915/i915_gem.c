@@ -1193,6 +1193,57 @@ static bool can_wait_boost(struct drm_i915_file_private *file_priv)
 	return !atomic_xchg(&file_priv->rps_wait_boost, true);
 }
 
+/*
+ * Bounds on the optimistic spin in __i915_wait_seqno(). The budget follows
+ * twice the recent average wait on the ring, so rings that usually complete
+ * within a few microseconds are polled that long before paying for an irq
+ * enable and a wakeup. Rings whose waits are usually long only get the
+ * minimum, which keeps the average honest without burning the CPU.
+ */
+#define I915_SPIN_MIN_NS (2 * NSEC_PER_USEC)
+#define I915_SPIN_MAX_NS (20 * NSEC_PER_USEC)
+
+static bool i915_spin_seqno(struct intel_engine_cs *ring, u32 seqno,
+			    bool interruptible)
+{
+	u64 avg = ACCESS_ONCE(ring->wait_stats.avg_ns);
+	u64 budget, timeout;
+
+	/* Only worth it if the GPU is already executing this request */
+	if (!i915_seqno_passed(ring->get_seqno(ring, true), seqno - 1))
+		return false;
+
+	if (avg > I915_SPIN_MAX_NS)
+		budget = I915_SPIN_MIN_NS;
+	else
+		budget = clamp_t(u64, 2 * avg,
+				 I915_SPIN_MIN_NS, I915_SPIN_MAX_NS);
+
+	timeout = local_clock() + budget;
+	do {
+		if (i915_seqno_passed(ring->get_seqno(ring, true), seqno))
+			return true;
+
+		if (interruptible && signal_pending(current))
+			break;
+
+		cpu_relax();
+	} while (!need_resched() && local_clock() < timeout);
+
+	return false;
+}
+
+static void i915_wait_stats_update(struct intel_engine_cs *ring, s64 ns)
+{
+	u64 avg = ring->wait_stats.avg_ns;
+
+	/* Don't let a single stall swamp the average */
+	ns = min_t(s64, ns, NSEC_PER_MSEC);
+	ring->wait_stats.avg_ns = avg - (avg >> 3) + (ns >> 3);
+	ring->wait_stats.total_ns += ns;
+	ring->wait_stats.waits++;
+}
+
 /**
  * __i915_wait_seqno - wait until execution of seqno has finished
  * @ring: the ring expected to report seqno
@@ -1242,12 +1293,20 @@ int __i915_wait_seqno(struct intel_engine_cs *ring, u32 seqno,
 					 msecs_to_jiffies(100));
 	}
 
+	/* Record current time in case interrupted by signal, or wedged */
+	before = ktime_get_raw_ns();
+
+	if (i915_spin_seqno(ring, seqno, interruptible)) {
+		now = ktime_get_raw_ns();
+		ring->wait_stats.spin_hits++;
+		ret = 0;
+		goto out;
+	}
+
 	if (!irq_test_in_progress && WARN_ON(!ring->irq_get(ring)))
 		return -ENODEV;
 
-	/* Record current time in case interrupted by signal, or wedged */
 	trace_i915_gem_request_wait_begin(ring, seqno);
-	before = ktime_get_raw_ns();
 	for (;;) {
 		struct timer_list timer;
 
@@ -1303,6 +1362,11 @@ int __i915_wait_seqno(struct intel_engine_cs *ring, u32 seqno,
 		ring->irq_put(ring);
 
 	finish_wait(&ring->irq_queue, &wait);
+	ring->wait_stats.sleeps++;
+
+out:
+	if (ret == 0)
+		i915_wait_stats_update(ring, now - before);
 
 	if (timeout) {
 		s64 tres = *timeout - (now - before);
@@ -2075,6 +2139,10 @@ i915_gem_shrink(struct drm_i915_private *dev_priv,
 			    !i915_gem_object_is_purgeable(obj))
 				continue;
 
+			if (flags & I915_SHRINK_IDLE &&
+			    (obj->active || i915_gem_obj_is_pinned(obj)))
+				continue;
+
 			drm_gem_object_reference(&obj->base);
 
 			/* For the unbound phase, this should be a no-op! */
@@ -2094,6 +2162,67 @@ i915_gem_shrink(struct drm_i915_private *dev_priv,
 	return count;
 }
 
+static unsigned long i915_gem_reap_target(void)
+{
+	unsigned long watermark, free;
+
+	if (i915.reap_watermark <= 0)
+		return 0;
+
+	watermark = (unsigned long)i915.reap_watermark << (20 - PAGE_SHIFT);
+	free = global_page_state(NR_FREE_PAGES);
+
+	return free < watermark ? watermark - free : 0;
+}
+
+bool i915_gem_reap_below_watermark(void)
+{
+	return i915_gem_reap_target() != 0;
+}
+
+/**
+ * i915_gem_queue_reap - kick the background reaper
+ * @dev_priv: i915 device
+ *
+ * Called whenever an object may have become reclaimable without the
+ * shrinker being asked. The reaper runs on the system workqueue so that
+ * waiting for struct_mutex there never delays request retirement.
+ */
+void i915_gem_queue_reap(struct drm_i915_private *dev_priv)
+{
+	schedule_work(&dev_priv->mm.reap_work);
+}
+
+static void
+i915_gem_reap_work_handler(struct work_struct *work)
+{
+	struct drm_i915_private *dev_priv =
+		container_of(work, typeof(*dev_priv), mm.reap_work);
+	struct drm_device *dev = dev_priv->dev;
+	unsigned long target, freed;
+
+	mutex_lock(&dev->struct_mutex);
+
+	/* Only ever touch idle objects here, we must not stall on the GPU */
+	freed = i915_gem_shrink(dev_priv, LONG_MAX,
+				I915_SHRINK_BOUND |
+				I915_SHRINK_UNBOUND |
+				I915_SHRINK_PURGEABLE |
+				I915_SHRINK_IDLE);
+	dev_priv->mm.reap_stats.purged_pages += freed;
+
+	target = i915_gem_reap_target();
+	if (target) {
+		freed = i915_gem_shrink(dev_priv, target,
+					I915_SHRINK_UNBOUND |
+					I915_SHRINK_IDLE);
+		dev_priv->mm.reap_stats.unbound_pages += freed;
+	}
+
+	dev_priv->mm.reap_stats.runs++;
+	mutex_unlock(&dev->struct_mutex);
+}
+
 static unsigned long
 i915_gem_shrink_all(struct drm_i915_private *dev_priv)
 {
@@ -2310,6 +2439,9 @@ i915_gem_object_move_to_inactive(struct drm_i915_gem_object *obj)
 
 	obj->last_fenced_seqno = 0;
 
+	if (obj->madv == I915_MADV_DONTNEED && obj->pages)
+		i915_gem_queue_reap(dev_priv);
+
 	obj->active = 0;
 	drm_gem_object_unreference(&obj->base);
 
@@ -2496,6 +2628,7 @@ int __i915_add_request(struct intel_engine_cs *ring,
 	ring->preallocated_lazy_request = NULL;
 
 	i915_queue_hangcheck(ring->dev);
+	i915_retire_irq_get(ring);
 
 	cancel_delayed_work_sync(&dev_priv->mm.idle_work);
 	queue_delayed_work(dev_priv->wq,
@@ -2669,6 +2802,8 @@ static void i915_gem_reset_ring_cleanup(struct drm_i915_private *dev_priv,
 		i915_gem_free_request(request);
 	}
 
+	i915_retire_irq_put(ring);
+
 	/* These may not have been flush before the reset, do so now */
 	kfree(ring->preallocated_lazy_request);
 	ring->preallocated_lazy_request = NULL;
@@ -2718,12 +2853,31 @@ void i915_gem_reset(struct drm_device *dev)
 	i915_gem_restore_fences(dev);
 }
 
+static void
+i915_gem_record_retire_latency(struct intel_engine_cs *ring,
+			       unsigned int count)
+{
+	u64 stamp = ACCESS_ONCE(ring->retire_irq_ns);
+	u64 delta;
+
+	if (stamp == 0)
+		return;
+
+	ring->retire_irq_ns = 0;
+
+	/* log2 buckets of microseconds from completion irq to retirement */
+	delta = div_u64(ktime_get_raw_ns() - stamp, NSEC_PER_USEC);
+	ring->retire_latency[min(fls64(delta),
+				 I915_RETIRE_LATENCY_BUCKETS - 1)] += count;
+}
+
 /**
  * This function clears the request list as sequence numbers are passed.
  */
 void
 i915_gem_retire_requests_ring(struct intel_engine_cs *ring)
 {
+	unsigned int retired = 0;
 	uint32_t seqno;
 
 	if (list_empty(&ring->request_list))
@@ -2783,8 +2937,15 @@ i915_gem_retire_requests_ring(struct intel_engine_cs *ring)
 		ringbuf->last_retired_head = request->tail;
 
 		i915_gem_free_request(request);
+		retired++;
 	}
 
+	if (retired)
+		i915_gem_record_retire_latency(ring, retired);
+
+	if (list_empty(&ring->request_list))
+		i915_retire_irq_put(ring);
+
 	if (unlikely(ring->trace_irq_seqno &&
 		     i915_seqno_passed(seqno, ring->trace_irq_seqno))) {
 		ring->irq_put(ring);
@@ -2836,6 +2997,9 @@ i915_gem_retire_work_handler(struct work_struct *work)
 	idle = false;
 	if (mutex_trylock(&dev->struct_mutex)) {
 		idle = i915_gem_retire_requests(dev);
+		if (!list_empty(&dev_priv->mm.unbound_list) &&
+		    i915_gem_reap_below_watermark())
+			i915_gem_queue_reap(dev_priv);
 		mutex_unlock(&dev->struct_mutex);
 	}
 	if (!idle)
@@ -3573,9 +3737,16 @@ search_free:
 		goto err_remove_node;
 	}
 
+	if (vm->allocate_va_range) {
+		ret = vm->allocate_va_range(vm, vma->node.start,
+					    vma->node.size);
+		if (ret)
+			goto err_remove_node;
+	}
+
 	ret = i915_gem_gtt_prepare_object(obj);
 	if (ret)
-		goto err_remove_node;
+		goto err_free_va;
 
 	list_move_tail(&obj->global_list, &dev_priv->mm.bound_list);
 	list_add_tail(&vma->mm_list, &vm->inactive_list);
@@ -3586,6 +3757,9 @@ search_free:
 
 	return vma;
 
+err_free_va:
+	if (vm->free_va_range)
+		vm->free_va_range(vm, vma->node.start, vma->node.size);
 err_remove_node:
 	drm_mm_remove_node(&vma->node);
 err_free_vma:
@@ -4450,6 +4624,8 @@ i915_gem_madvise_ioctl(struct drm_device *dev, void *data,
 	/* if the object is no longer attached, discard its backing storage */
 	if (i915_gem_object_is_purgeable(obj) && obj->pages == NULL)
 		i915_gem_object_truncate(obj);
+	else if (i915_gem_object_is_purgeable(obj) && !obj->active)
+		i915_gem_queue_reap(dev_priv);
 
 	args->retained = obj->madv != __I915_MADV_PURGED;
 
@@ -4633,6 +4809,35 @@ struct i915_vma *i915_gem_obj_to_vma(struct drm_i915_gem_object *obj,
 	return NULL;
 }
 
+/**
+ * i915_gem_close_object() - drop execbuffer lookups of a closed handle
+ * @gem: the object whose handle is being closed
+ * @file: the file the handle belongs to
+ *
+ * The contexts of @file may have cached the vma this handle resolved to.
+ * The handle number stays reserved until we return, so forget all of those
+ * before it can be reused. An object opened under several handles in the
+ * same file loses the cached lookups of all of them, which only costs a
+ * slow lookup on the next execbuffer.
+ */
+void i915_gem_close_object(struct drm_gem_object *gem, struct drm_file *file)
+{
+	struct drm_i915_gem_object *obj = to_intel_bo(gem);
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+	struct i915_ctx_handle *lut, *next;
+	struct i915_vma *vma;
+
+	mutex_lock(&gem->dev->struct_mutex);
+	list_for_each_entry(vma, &obj->vma_list, vma_link) {
+		list_for_each_entry_safe(lut, next, &vma->ctx_handles,
+					 vma_link) {
+			if (lut->ctx->file_priv == file_priv)
+				i915_gem_context_uncache(lut);
+		}
+	}
+	mutex_unlock(&gem->dev->struct_mutex);
+}
+
 void i915_gem_vma_destroy(struct i915_vma *vma)
 {
 	struct i915_address_space *vm = NULL;
@@ -4642,6 +4847,11 @@ void i915_gem_vma_destroy(struct i915_vma *vma)
 	if (!list_empty(&vma->exec_list))
 		return;
 
+	while (!list_empty(&vma->ctx_handles))
+		i915_gem_context_uncache(list_first_entry(&vma->ctx_handles,
+							  struct i915_ctx_handle,
+							  vma_link));
+
 	vm = vma->vm;
 
 	if (!i915_is_ggtt(vm))
@@ -5024,6 +5234,7 @@ i915_gem_load(struct drm_device *dev)
 			  i915_gem_retire_work_handler);
 	INIT_DELAYED_WORK(&dev_priv->mm.idle_work,
 			  i915_gem_idle_work_handler);
+	INIT_WORK(&dev_priv->mm.reap_work, i915_gem_reap_work_handler);
 	init_waitqueue_head(&dev_priv->gpu_error.reset_queue);
 
 	/* On GEN3 we really need to make sure the ARB C3 LP bit is set */
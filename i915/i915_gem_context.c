@@ -133,6 +133,65 @@ static int get_context_size(struct drm_device *dev)
 	return ret;
 }
 
+/**
+ * i915_gem_context_cache_vma() - remember the vma an object handle resolves to
+ * @ctx: the context submitting the handle
+ * @handle: the object handle, in the context's file
+ * @vma: the object's vma in the context's address space
+ *
+ * Lets subsequent execbuffers on @ctx find @vma without going through the
+ * object's vma list. The entry is dropped under struct_mutex when the handle is
+ * closed, the vma is destroyed or the context is closed. The handle number
+ * isn't reused before the close has dropped it.
+ *
+ * Return: 0 on success, a negative error code if the entry was not added
+ */
+int i915_gem_context_cache_vma(struct intel_context *ctx, u32 handle,
+			       struct i915_vma *vma)
+{
+	struct i915_ctx_handle *lut;
+	int ret;
+
+	lut = kmalloc(sizeof(*lut), GFP_KERNEL);
+	if (lut == NULL)
+		return -ENOMEM;
+
+	lut->ctx = ctx;
+	lut->vma = vma;
+	lut->handle = handle;
+
+	ret = radix_tree_insert(&ctx->handles_vma, handle, lut);
+	if (ret) {
+		kfree(lut);
+		return ret;
+	}
+
+	list_add(&lut->ctx_link, &ctx->handles_list);
+	list_add(&lut->vma_link, &vma->ctx_handles);
+
+	return 0;
+}
+
+/**
+ * i915_gem_context_uncache() - drop a cached handle lookup
+ * @lut: the entry to drop
+ */
+void i915_gem_context_uncache(struct i915_ctx_handle *lut)
+{
+	radix_tree_delete(&lut->ctx->handles_vma, lut->handle);
+	list_del(&lut->ctx_link);
+	list_del(&lut->vma_link);
+	kfree(lut);
+}
+
+static void i915_gem_context_uncache_all(struct intel_context *ctx)
+{
+	struct i915_ctx_handle *lut, *next;
+
+	list_for_each_entry_safe(lut, next, &ctx->handles_list, ctx_link)
+		i915_gem_context_uncache(lut);
+}
+
 void i915_gem_context_free(struct kref *ctx_ref)
 {
 	struct intel_context *ctx = container_of(ctx_ref,
@@ -140,6 +199,9 @@ void i915_gem_context_free(struct kref *ctx_ref)
 
 	trace_i915_context_free(ctx);
 
+	/* Lookups cached by an execbuffer that raced with closing the context */
+	i915_gem_context_uncache_all(ctx);
+
 	if (i915.enable_execlists)
 		intel_lr_context_free(ctx);
 
@@ -195,6 +257,8 @@ __create_hw_context(struct drm_device *dev,
 
 	kref_init(&ctx->ref);
 	list_add_tail(&ctx->link, &dev_priv->context_list);
+	INIT_RADIX_TREE(&ctx->handles_vma, GFP_KERNEL);
+	INIT_LIST_HEAD(&ctx->handles_list);
 
 	if (dev_priv->hw_context_size) {
 		struct drm_i915_gem_object *obj =
@@ -424,6 +488,7 @@ static int context_idr_cleanup(int id, void *p, void *data)
 {
 	struct intel_context *ctx = p;
 
+	i915_gem_context_uncache_all(ctx);
 	i915_gem_context_unreference(ctx);
 	return 0;
 }
@@ -773,6 +838,7 @@ int i915_gem_context_destroy_ioctl(struct drm_device *dev, void *data,
 	}
 
 	idr_remove(&ctx->file_priv->context_idr, ctx->user_handle);
+	i915_gem_context_uncache_all(ctx);
 	i915_gem_context_unreference(ctx);
 	mutex_unlock(&dev->struct_mutex);
 
@@ -33,8 +33,41 @@
 #include "intel_drv.h"
 #include "i915_trace.h"
 
-static bool
-mark_free(struct i915_vma *vma, struct list_head *unwind)
+#include <linux/sort.h>
+
+/*
+ * Eviction cost model
+ *
+ * Every evictable vma is given a cost estimating what throwing it out will
+ * set us back: its PTEs have to be rewritten when it is next bound, pending
+ * GPU writes must be flushed before it can be unbound, an active vma costs a
+ * GPU stall, an object used for scanout is bound to come straight back, and
+ * the more recently it was used the more likely it is to be needed again.
+ *
+ * Several scans over the address space are then made, each feeding the
+ * candidates in a different order, and the hole whose overlapping vmas have
+ * the lowest total cost wins:
+ *   0. LRU order, inactive before active (the classic policy)
+ *   1. Ascending cost
+ *   2. Ascending cost over idle vmas only, if 1 would have stalled
+ */
+#define EVICT_ACTIVE_COST	(1ULL << 20)
+#define EVICT_DISPLAY_COST	(1ULL << 24)
+#define EVICT_RECENCY_COST	4
+
+enum evict_policy {
+	EVICT_LRU,
+	EVICT_COST,
+	EVICT_COST_IDLE,
+};
+
+struct evict_candidate {
+	struct i915_vma *vma;
+	u64 cost;
+	unsigned int policies;
+};
+
+static bool evictable(struct i915_vma *vma)
 {
 	if (vma->pin_count)
 		return false;
@@ -42,8 +75,77 @@ mark_free(struct i915_vma *vma, struct list_head *unwind)
 	if (WARN_ON(!list_empty(&vma->exec_list)))
 		return false;
 
-	list_add(&vma->exec_list, unwind);
-	return drm_mm_scan_add_block(&vma->node);
+	return true;
+}
+
+static u64 evict_cost(struct i915_vma *vma, unsigned int recency)
+{
+	struct drm_i915_gem_object *obj = vma->obj;
+	u64 pages = vma->node.size >> PAGE_SHIFT;
+	u64 cost = pages;
+
+	if (obj->base.write_domain & I915_GEM_GPU_DOMAINS)
+		cost += pages;
+
+	if (obj->active)
+		cost += EVICT_ACTIVE_COST;
+
+	if (obj->pin_display)
+		cost += EVICT_DISPLAY_COST;
+
+	return cost + (u64)recency * EVICT_RECENCY_COST;
+}
+
+static int evict_cost_cmp(const void *A, const void *B)
+{
+	const struct evict_candidate *a = *(const struct evict_candidate **)A;
+	const struct evict_candidate *b = *(const struct evict_candidate **)B;
+
+	if (a->cost < b->cost)
+		return -1;
+	return a->cost > b->cost;
+}
+
+/*
+ * Feed the candidates to drm_mm in the given order until a suitable hole
+ * appears, then unwind the scan, marking the candidates that overlap the hole
+ * with the policy and summing their cost. Returns false if no hole was found.
+ */
+static bool
+evict_scan(struct i915_address_space *vm,
+	   struct evict_candidate **order, unsigned int count,
+	   int min_size, unsigned alignment, unsigned cache_level,
+	   unsigned long start, unsigned long end,
+	   enum evict_policy policy, u64 *cost)
+{
+	unsigned int i, added;
+	bool found = false;
+
+	if (start != 0 || end != vm->total) {
+		drm_mm_init_scan_with_range(&vm->mm, min_size,
+					    alignment, cache_level,
+					    start, end);
+	} else
+		drm_mm_init_scan(&vm->mm, min_size, alignment, cache_level);
+
+	for (added = 0; added < count; ) {
+		if (drm_mm_scan_add_block(&order[added++]->vma->node)) {
+			found = true;
+			break;
+		}
+	}
+
+	/* drm_mm requires the blocks to be removed in reverse order */
+	*cost = 0;
+	for (i = added; i--; ) {
+		if (drm_mm_scan_remove_block(&order[i]->vma->node)) {
+			BUG_ON(!found);
+			order[i]->policies |= BIT(policy);
+			*cost += order[i]->cost;
+		}
+	}
+
+	return found;
 }
 
 /**
@@ -58,7 +160,9 @@ mark_free(struct i915_vma *vma, struct list_head *unwind)
  *
  * This function will try to evict vmas until a free space satisfying the
  * requirements is found. Callers must check first whether any such hole exists
- * already before calling this function.
+ * already before calling this function. Among the holes the candidate scans
+ * turn up, the one that is cheapest to evict according to the cost model
+ * above is chosen.
  *
  * This function is used by the object/vma binding code.
  *
@@ -71,72 +175,98 @@ i915_gem_evict_something(struct drm_device *dev, struct i915_address_space *vm,
 			 unsigned long start, unsigned long end,
 			 unsigned flags)
 {
-	struct list_head eviction_list, unwind_list;
+	struct evict_candidate *cand, **order;
+	struct list_head eviction_list;
 	struct i915_vma *vma;
+	u64 cost, best_cost = 0;
+	int best = -1;
+	unsigned int count, idle, i, evicting;
 	int ret = 0;
 	int pass = 0;
 
 	trace_i915_gem_evict(dev, min_size, alignment, flags);
 
 	/*
-	 * The goal is to evict objects and amalgamate space in LRU order.
 	 * The oldest idle objects reside on the inactive list, which is in
-	 * retirement order. The next objects to retire are those on the (per
-	 * ring) active list that do not have an outstanding flush. Once the
-	 * hardware reports completion (the seqno is updated after the
-	 * batchbuffer has been finished) the clean buffer objects would
-	 * be retired to the inactive list. Any dirty objects would be added
-	 * to the tail of the flushing list. So after processing the clean
-	 * active objects we need to emit a MI_FLUSH to retire the flushing
-	 * list, hence the retirement order of the flushing list is in
-	 * advance of the dirty objects on the active lists.
-	 *
-	 * The retirement sequence is thus:
-	 *   1. Inactive objects (already retired)
-	 *   2. Clean active objects
-	 *   3. Flushing list
-	 *   4. Dirty active objects.
-	 *
-	 * On each list, the oldest objects lie at the HEAD with the freshest
-	 * object on the TAIL.
+	 * retirement order. The active lists follow, with the objects that
+	 * will retire first at their head. Candidates are numbered in that
+	 * order, which serves as their age.
 	 */
+search_again:
+	count = 0;
+	list_for_each_entry(vma, &vm->inactive_list, mm_list)
+		count++;
+	if (!(flags & PIN_NONBLOCK)) {
+		list_for_each_entry(vma, &vm->active_list, mm_list)
+			count++;
+	}
 
-	INIT_LIST_HEAD(&unwind_list);
-	if (start != 0 || end != vm->total) {
-		drm_mm_init_scan_with_range(&vm->mm, min_size,
-					    alignment, cache_level,
-					    start, end);
-	} else
-		drm_mm_init_scan(&vm->mm, min_size, alignment, cache_level);
+	cand = drm_malloc_ab(count, sizeof(*cand) + sizeof(*order));
+	if (cand == NULL)
+		return -ENOMEM;
+	order = (struct evict_candidate **)(cand + count);
 
-search_again:
-	/* First see if there is a large enough contiguous idle region... */
+	count = 0;
 	list_for_each_entry(vma, &vm->inactive_list, mm_list) {
-		if (mark_free(vma, &unwind_list))
-			goto found;
+		if (!evictable(vma))
+			continue;
+
+		cand[count].vma = vma;
+		cand[count].policies = 0;
+		count++;
+	}
+	idle = count;
+	if (!(flags & PIN_NONBLOCK)) {
+		list_for_each_entry(vma, &vm->active_list, mm_list) {
+			if (!evictable(vma))
+				continue;
+
+			cand[count].vma = vma;
+			cand[count].policies = 0;
+			count++;
+		}
 	}
 
-	if (flags & PIN_NONBLOCK)
-		goto none;
+	/* Candidates are numbered least recently used first */
+	for (i = 0; i < count; i++) {
+		cand[i].cost = evict_cost(cand[i].vma, i);
+		order[i] = &cand[i];
+	}
 
-	/* Now merge in the soon-to-be-expired objects... */
-	list_for_each_entry(vma, &vm->active_list, mm_list) {
-		if (mark_free(vma, &unwind_list))
-			goto found;
+	if (evict_scan(vm, order, count, min_size, alignment, cache_level,
+		       start, end, EVICT_LRU, &cost)) {
+		best = EVICT_LRU;
+		best_cost = cost;
 	}
 
-none:
-	/* Nothing found, clean up and bail out! */
-	while (!list_empty(&unwind_list)) {
-		vma = list_first_entry(&unwind_list,
-				       struct i915_vma,
-				       exec_list);
-		ret = drm_mm_scan_remove_block(&vma->node);
-		BUG_ON(ret);
+	sort(order, count, sizeof(*order), evict_cost_cmp, NULL);
+	if (evict_scan(vm, order, count, min_size, alignment, cache_level,
+		       start, end, EVICT_COST, &cost) &&
+	    (best < 0 || cost < best_cost)) {
+		best = EVICT_COST;
+		best_cost = cost;
+	}
 
-		list_del_init(&vma->exec_list);
+	if (best >= 0 && best_cost >= EVICT_ACTIVE_COST && idle) {
+		unsigned int n = 0;
+
+		for (i = 0; i < count; i++)
+			if (!order[i]->vma->obj->active)
+				order[n++] = order[i];
+
+		if (evict_scan(vm, order, n, min_size, alignment, cache_level,
+			       start, end, EVICT_COST_IDLE, &cost) &&
+		    cost < best_cost) {
+			best = EVICT_COST_IDLE;
+			best_cost = cost;
+		}
 	}
 
+	if (best >= 0)
+		goto found;
+
+	drm_free_large(cand);
+
 	/* Can we unpin some objects such as idle hw contents,
 	 * or pending flips?
 	 */
@@ -160,22 +290,23 @@ none:
 	return intel_has_pending_fb_unpin(dev) ? -EAGAIN : -ENOSPC;
 
 found:
-	/* drm_mm doesn't allow any other other operations while
-	 * scanning, therefore store to be evicted objects on a
-	 * temporary list. */
+	/* Collect the chosen vmas before unbinding any of them */
 	INIT_LIST_HEAD(&eviction_list);
-	while (!list_empty(&unwind_list)) {
-		vma = list_first_entry(&unwind_list,
-				       struct i915_vma,
-				       exec_list);
-		if (drm_mm_scan_remove_block(&vma->node)) {
-			list_move(&vma->exec_list, &eviction_list);
-			drm_gem_object_reference(&vma->obj->base);
+	evicting = 0;
+	for (i = 0; i < count; i++) {
+		if (!(cand[i].policies & BIT(best)))
 			continue;
-		}
-		list_del_init(&vma->exec_list);
+
+		vma = cand[i].vma;
+		list_add(&vma->exec_list, &eviction_list);
+		drm_gem_object_reference(&vma->obj->base);
+		evicting++;
 	}
 
+	trace_i915_gem_evict_choice(vm, min_size, count, best, best_cost,
+				    evicting);
+	drm_free_large(cand);
+
 	/* Unbinding will emit any required flushes */
 	while (!list_empty(&eviction_list)) {
 		struct drm_gem_object *obj;
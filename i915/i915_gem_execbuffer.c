@@ -88,70 +88,92 @@ eb_reset(struct eb_vmas *eb)
 		memset(eb->buckets, 0, (eb->and+1)*sizeof(struct hlist_head));
 }
 
+static struct i915_vma *
+eb_lookup_vma_slow(struct intel_context *ctx,
+		   struct i915_address_space *vm,
+		   struct drm_file *file,
+		   u32 handle)
+{
+	struct drm_i915_gem_object *obj;
+	struct i915_vma *vma;
+
+	spin_lock(&file->table_lock);
+	obj = to_intel_bo(idr_find(&file->object_idr, handle));
+	if (obj)
+		drm_gem_object_reference(&obj->base);
+	spin_unlock(&file->table_lock);
+
+	if (obj == NULL)
+		return ERR_PTR(-ENOENT);
+
+	/*
+	 * NOTE: We can leak any vmas created here when something fails
+	 * later on. But that's no issue since vma_unbind can deal with
+	 * vmas which are not actually bound. And since only
+	 * lookup_or_create exists as an interface to get at the vma
+	 * from the (obj, vm) we don't run the risk of creating
+	 * duplicated vmas for the same vm.
+	 */
+	vma = i915_gem_obj_lookup_or_create_vma(obj, vm);
+	if (IS_ERR(vma)) {
+		drm_gem_object_unreference(&obj->base);
+		return vma;
+	}
+
+	/* A failure here only means the next lookup takes this path again */
+	i915_gem_context_cache_vma(ctx, handle, vma);
+
+	return vma;
+}
+
 static int
 eb_lookup_vmas(struct eb_vmas *eb,
 	       struct drm_i915_gem_exec_object2 *exec,
 	       const struct drm_i915_gem_execbuffer2 *args,
+	       struct intel_context *ctx,
 	       struct i915_address_space *vm,
 	       struct drm_file *file)
 {
-	struct drm_i915_gem_object *obj;
-	struct list_head objects;
-	int i, ret;
+	int i;
 
-	INIT_LIST_HEAD(&objects);
-	spin_lock(&file->table_lock);
-	/* Grab a reference to the object and release the lock so we can lookup
-	 * or create the VMA without using GFP_ATOMIC */
+	/*
+	 * Handles this context has submitted before resolve through its
+	 * handle cache, without taking the table lock or walking the
+	 * object's vma list. drm_gem_handle_delete() keeps the handle number
+	 * reserved until ->gem_close_object() has dropped its entries under
+	 * struct_mutex, which we hold, so a hit can't belong to a reused
+	 * handle. At worst it is a handle userspace is closing concurrently,
+	 * whose object is still alive.
+	 */
 	for (i = 0; i < args->buffer_count; i++) {
-		obj = to_intel_bo(idr_find(&file->object_idr, exec[i].handle));
-		if (obj == NULL) {
-			spin_unlock(&file->table_lock);
-			DRM_DEBUG("Invalid object handle %d at index %d\n",
-				   exec[i].handle, i);
-			ret = -ENOENT;
-			goto err;
+		struct i915_ctx_handle *lut;
+		struct i915_vma *vma;
+
+		lut = radix_tree_lookup(&ctx->handles_vma, exec[i].handle);
+		if (lut) {
+			vma = lut->vma;
+			drm_gem_object_reference(&vma->obj->base);
+		} else {
+			vma = eb_lookup_vma_slow(ctx, vm, file, exec[i].handle);
+			if (IS_ERR(vma)) {
+				DRM_DEBUG("Invalid object handle %d at index %d\n",
+					  exec[i].handle, i);
+				return PTR_ERR(vma);
+			}
 		}
 
-		if (!list_empty(&obj->obj_exec_link)) {
-			spin_unlock(&file->table_lock);
+		if (!list_empty(&vma->exec_list)) {
 			DRM_DEBUG("Object %p [handle %d, index %d] appears more than once in object list\n",
-				   obj, exec[i].handle, i);
-			ret = -EINVAL;
-			goto err;
+				  vma->obj, exec[i].handle, i);
+			drm_gem_object_unreference(&vma->obj->base);
+			return -EINVAL;
 		}
 
-		drm_gem_object_reference(&obj->base);
-		list_add_tail(&obj->obj_exec_link, &objects);
-	}
-	spin_unlock(&file->table_lock);
-
-	i = 0;
-	while (!list_empty(&objects)) {
-		struct i915_vma *vma;
-
-		obj = list_first_entry(&objects,
-				       struct drm_i915_gem_object,
-				       obj_exec_link);
-
 		/*
-		 * NOTE: We can leak any vmas created here when something fails
-		 * later on. But that's no issue since vma_unbind can deal with
-		 * vmas which are not actually bound. And since only
-		 * lookup_or_create exists as an interface to get at the vma
-		 * from the (obj, vm) we don't run the risk of creating
-		 * duplicated vmas for the same vm.
+		 * The reference taken above is owned by the vmas list from
+		 * here on, and released by eb_destroy.
 		 */
-		vma = i915_gem_obj_lookup_or_create_vma(obj, vm);
-		if (IS_ERR(vma)) {
-			DRM_DEBUG("Failed to lookup VMA\n");
-			ret = PTR_ERR(vma);
-			goto err;
-		}
-
-		/* Transfer ownership from the objects list to the vmas list. */
 		list_add_tail(&vma->exec_list, &eb->vmas);
-		list_del_init(&obj->obj_exec_link);
 
 		vma->exec_entry = &exec[i];
 		if (eb->and < 0) {
@@ -162,26 +184,9 @@ eb_lookup_vmas(struct eb_vmas *eb,
 			hlist_add_head(&vma->exec_node,
 				       &eb->buckets[handle & eb->and]);
 		}
-		++i;
 	}
 
 	return 0;
-
-
-err:
-	while (!list_empty(&objects)) {
-		obj = list_first_entry(&objects,
-				       struct drm_i915_gem_object,
-				       obj_exec_link);
-		list_del_init(&obj->obj_exec_link);
-		drm_gem_object_unreference(&obj->base);
-	}
-	/*
-	 * Objects already transfered to the vmas list will be unreferenced by
-	 * eb_destroy.
-	 */
-
-	return ret;
 }
 
 static struct i915_vma *eb_get_vma(struct eb_vmas *eb, unsigned long handle)
@@ -660,7 +665,11 @@ i915_gem_execbuffer_reserve(struct intel_engine_cs *ring,
 	 *
 	 * This avoid unnecessary unbinding of later objects in order to make
 	 * room for the earlier objects *unless* we need to defragment.
+	 *
+	 * The GGTT TLB flush for all the objects bound here is issued once,
+	 * before returning, rather than once per object.
 	 */
+	i915_gem_gtt_bind_begin(ring->dev);
 	retry = 0;
 	do {
 		int ret = 0;
@@ -689,16 +698,20 @@ i915_gem_execbuffer_reserve(struct intel_engine_cs *ring,
 		}
 
 err:
-		if (ret != -ENOSPC || retry++)
+		if (ret != -ENOSPC || retry++) {
+			i915_gem_gtt_bind_end(ring->dev);
 			return ret;
+		}
 
 		/* Decrement pin count for bound objects */
 		list_for_each_entry(vma, vmas, exec_list)
 			i915_gem_execbuffer_unreserve_vma(vma);
 
 		ret = i915_gem_evict_vm(vm, true);
-		if (ret)
+		if (ret) {
+			i915_gem_gtt_bind_end(ring->dev);
 			return ret;
+		}
 	} while (1);
 }
 
@@ -707,6 +720,7 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 				  struct drm_i915_gem_execbuffer2 *args,
 				  struct drm_file *file,
 				  struct intel_engine_cs *ring,
+				  struct intel_context *ctx,
 				  struct eb_vmas *eb,
 				  struct drm_i915_gem_exec_object2 *exec)
 {
@@ -789,7 +803,7 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 
 	/* reacquire the objects */
 	eb_reset(eb);
-	ret = eb_lookup_vmas(eb, exec, args, vm, file);
+	ret = eb_lookup_vmas(eb, exec, args, ctx, vm, file);
 	if (ret)
 		goto err;
 
@@ -1361,7 +1375,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	}
 
 	/* Look up object handles */
-	ret = eb_lookup_vmas(eb, exec, args, vm, file);
+	ret = eb_lookup_vmas(eb, exec, args, ctx, vm, file);
 	if (ret)
 		goto err;
 
@@ -1380,7 +1394,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	if (ret) {
 		if (ret == -EFAULT) {
 			ret = i915_gem_execbuffer_relocate_slow(dev, args, file, ring,
-								eb, exec);
+								ctx, eb, exec);
 			BUG_ON(!mutex_is_locked(&dev->struct_mutex));
 		}
 		if (ret)
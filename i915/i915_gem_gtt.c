@@ -277,16 +277,19 @@ static void gen8_ppgtt_clear_range(struct i915_address_space *vm,
 		if (last_pte > GEN8_PTES_PER_PAGE)
 			last_pte = GEN8_PTES_PER_PAGE;
 
-		pt_vaddr = kmap_atomic(page_table);
+		num_entries -= last_pte - pte;
 
-		for (i = pte; i < last_pte; i++) {
-			pt_vaddr[i] = scratch_pte;
-			num_entries--;
-		}
+		/* Unpopulated, the PDE already points at the scratch table */
+		if (page_table) {
+			pt_vaddr = kmap_atomic(page_table);
 
-		if (!HAS_LLC(ppgtt->base.dev))
-			drm_clflush_virt_range(pt_vaddr, PAGE_SIZE);
-		kunmap_atomic(pt_vaddr);
+			for (i = pte; i < last_pte; i++)
+				pt_vaddr[i] = scratch_pte;
+
+			if (!HAS_LLC(ppgtt->base.dev))
+				drm_clflush_virt_range(pt_vaddr, PAGE_SIZE);
+			kunmap_atomic(pt_vaddr);
+		}
 
 		pte = 0;
 		if (++pde == GEN8_PDES_PER_PAGE) {
@@ -315,8 +318,16 @@ static void gen8_ppgtt_insert_entries(struct i915_address_space *vm,
 		if (WARN_ON(pdpe >= GEN8_LEGACY_PDPS))
 			break;
 
-		if (pt_vaddr == NULL)
-			pt_vaddr = kmap_atomic(ppgtt->gen8_pt_pages[pdpe][pde]);
+		if (pt_vaddr == NULL) {
+			struct page *page_table =
+				ppgtt->gen8_pt_pages[pdpe][pde];
+
+			/* Should have been populated by allocate_va_range */
+			if (WARN_ON(page_table == NULL))
+				break;
+
+			pt_vaddr = kmap_atomic(page_table);
+		}
 
 		pt_vaddr[pte] =
 			gen8_pte_encode(sg_page_iter_dma_address(&sg_iter),
@@ -360,8 +371,12 @@ static void gen8_ppgtt_free(const struct i915_hw_ppgtt *ppgtt)
 		gen8_free_page_tables(ppgtt->gen8_pt_pages[i]);
 		kfree(ppgtt->gen8_pt_pages[i]);
 		kfree(ppgtt->gen8_pt_dma_addr[i]);
+		kfree(ppgtt->gen8_pt_used[i]);
 	}
 
+	if (ppgtt->scratch_pt)
+		__free_page(ppgtt->scratch_pt);
+
 	__free_pages(ppgtt->pd_pages, get_order(ppgtt->num_pd_pages << PAGE_SHIFT));
 }
 
@@ -386,6 +401,10 @@ static void gen8_ppgtt_unmap_pages(struct i915_hw_ppgtt *ppgtt)
 					       PCI_DMA_BIDIRECTIONAL);
 		}
 	}
+
+	if (ppgtt->scratch_pt_dma_addr)
+		pci_unmap_page(hwdev, ppgtt->scratch_pt_dma_addr, PAGE_SIZE,
+			       PCI_DMA_BIDIRECTIONAL);
 }
 
 static void gen8_ppgtt_cleanup(struct i915_address_space *vm)
@@ -397,7 +416,7 @@ static void gen8_ppgtt_cleanup(struct i915_address_space *vm)
 	gen8_ppgtt_free(ppgtt);
 }
 
-static struct page **__gen8_alloc_page_tables(void)
+static struct page **__gen8_alloc_page_tables(bool populate)
 {
 	struct page **pt_pages;
 	int i;
@@ -406,6 +425,9 @@ static struct page **__gen8_alloc_page_tables(void)
 	if (!pt_pages)
 		return ERR_PTR(-ENOMEM);
 
+	if (!populate)
+		return pt_pages;
+
 	for (i = 0; i < GEN8_PDES_PER_PAGE; i++) {
 		pt_pages[i] = alloc_page(GFP_KERNEL);
 		if (!pt_pages[i])
@@ -421,13 +443,14 @@ bail:
 }
 
 static int gen8_ppgtt_allocate_page_tables(struct i915_hw_ppgtt *ppgtt,
-					   const int max_pdp)
+					   const int max_pdp,
+					   bool populate)
 {
 	struct page **pt_pages[GEN8_LEGACY_PDPS];
 	int i, ret;
 
 	for (i = 0; i < max_pdp; i++) {
-		pt_pages[i] = __gen8_alloc_page_tables();
+		pt_pages[i] = __gen8_alloc_page_tables(populate);
 		if (IS_ERR(pt_pages[i])) {
 			ret = PTR_ERR(pt_pages[i]);
 			goto unwind_out;
@@ -461,6 +484,12 @@ static int gen8_ppgtt_allocate_dma(struct i915_hw_ppgtt *ppgtt)
 						     GFP_KERNEL);
 		if (!ppgtt->gen8_pt_dma_addr[i])
 			return -ENOMEM;
+
+		ppgtt->gen8_pt_used[i] = kcalloc(GEN8_PDES_PER_PAGE,
+						 sizeof(u16),
+						 GFP_KERNEL);
+		if (!ppgtt->gen8_pt_used[i])
+			return -ENOMEM;
 	}
 
 	return 0;
@@ -480,7 +509,8 @@ static int gen8_ppgtt_allocate_page_directories(struct i915_hw_ppgtt *ppgtt,
 }
 
 static int gen8_ppgtt_alloc(struct i915_hw_ppgtt *ppgtt,
-			    const int max_pdp)
+			    const int max_pdp,
+			    bool populate)
 {
 	int ret;
 
@@ -488,7 +518,7 @@ static int gen8_ppgtt_alloc(struct i915_hw_ppgtt *ppgtt,
 	if (ret)
 		return ret;
 
-	ret = gen8_ppgtt_allocate_page_tables(ppgtt, max_pdp);
+	ret = gen8_ppgtt_allocate_page_tables(ppgtt, max_pdp, populate);
 	if (ret) {
 		__free_pages(ppgtt->pd_pages, get_order(max_pdp << PAGE_SHIFT));
 		return ret;
@@ -542,27 +572,211 @@ static int gen8_ppgtt_setup_page_tables(struct i915_hw_ppgtt *ppgtt,
 	return 0;
 }
 
+static void gen8_ppgtt_write_pde(struct i915_hw_ppgtt *ppgtt,
+				 const int pd,
+				 const int pt,
+				 dma_addr_t addr)
+{
+	gen8_ppgtt_pde_t *pd_vaddr;
+
+	pd_vaddr = kmap_atomic(&ppgtt->pd_pages[pd]);
+	pd_vaddr[pt] = gen8_pde_encode(ppgtt->base.dev, addr, I915_CACHE_LLC);
+	if (!HAS_LLC(ppgtt->base.dev))
+		drm_clflush_virt_range(&pd_vaddr[pt], sizeof(*pd_vaddr));
+	kunmap_atomic(pd_vaddr);
+}
+
+static struct page *gen8_alloc_scratch_filled_page(struct i915_hw_ppgtt *ppgtt)
+{
+	gen8_gtt_pte_t *pt_vaddr, scratch_pte;
+	struct page *p;
+	int i;
+
+	p = alloc_page(GFP_KERNEL);
+	if (!p)
+		return NULL;
+
+	scratch_pte = gen8_pte_encode(ppgtt->base.scratch.addr,
+				      I915_CACHE_LLC, true);
+
+	pt_vaddr = kmap_atomic(p);
+	for (i = 0; i < GEN8_PTES_PER_PAGE; i++)
+		pt_vaddr[i] = scratch_pte;
+	if (!HAS_LLC(ppgtt->base.dev))
+		drm_clflush_virt_range(pt_vaddr, PAGE_SIZE);
+	kunmap_atomic(pt_vaddr);
+
+	return p;
+}
+
+static int gen8_ppgtt_setup_scratch_pt(struct i915_hw_ppgtt *ppgtt)
+{
+	dma_addr_t addr;
+	int ret;
+
+	ppgtt->scratch_pt = gen8_alloc_scratch_filled_page(ppgtt);
+	if (!ppgtt->scratch_pt)
+		return -ENOMEM;
+
+	addr = pci_map_page(ppgtt->base.dev->pdev, ppgtt->scratch_pt, 0,
+			    PAGE_SIZE, PCI_DMA_BIDIRECTIONAL);
+	ret = pci_dma_mapping_error(ppgtt->base.dev->pdev, addr);
+	if (ret)
+		return ret;
+
+	ppgtt->scratch_pt_dma_addr = addr;
+
+	return 0;
+}
+
+static int gen8_ppgtt_alloc_pt(struct i915_hw_ppgtt *ppgtt,
+			       const int pd,
+			       const int pt)
+{
+	struct page *p;
+	int ret;
+
+	p = gen8_alloc_scratch_filled_page(ppgtt);
+	if (!p)
+		return -ENOMEM;
+
+	ppgtt->gen8_pt_pages[pd][pt] = p;
+	ret = gen8_ppgtt_setup_page_tables(ppgtt, pd, pt);
+	if (ret) {
+		ppgtt->gen8_pt_pages[pd][pt] = NULL;
+		__free_page(p);
+		return ret;
+	}
+
+	gen8_ppgtt_write_pde(ppgtt, pd, pt, ppgtt->gen8_pt_dma_addr[pd][pt]);
+	ppgtt->num_pt_pages++;
+
+	return 0;
+}
+
+/*
+ * The page is freed right away rather than after the next TLB invalidate.
+ * That is safe because nothing in its range is in use any more: it is only
+ * freed once the last vma inside the range has been unbound, and unbinding
+ * first waits for the object to go idle (or the range was never bound at all
+ * when allocate_va_range fails). So no batch still running can walk a cached
+ * PDE to it. Every new batch is preceded by a flush that invalidates the TLBs,
+ * so a PT reallocated for this slot later is always fetched fresh.
+ */
+static void gen8_ppgtt_free_pt(struct i915_hw_ppgtt *ppgtt,
+			       const int pd,
+			       const int pt)
+{
+	gen8_ppgtt_write_pde(ppgtt, pd, pt, ppgtt->scratch_pt_dma_addr);
+
+	pci_unmap_page(ppgtt->base.dev->pdev, ppgtt->gen8_pt_dma_addr[pd][pt],
+		       PAGE_SIZE, PCI_DMA_BIDIRECTIONAL);
+	__free_page(ppgtt->gen8_pt_pages[pd][pt]);
+
+	ppgtt->gen8_pt_dma_addr[pd][pt] = 0;
+	ppgtt->gen8_pt_pages[pd][pt] = NULL;
+	ppgtt->num_pt_pages--;
+}
+
+/* End of the page table covering addr, clamped to end */
+static inline uint64_t gen8_pt_end(uint64_t addr, uint64_t end)
+{
+	uint64_t next = (addr | ((1ULL << GEN8_PDE_SHIFT) - 1)) + 1;
+
+	return next < end ? next : end;
+}
+
+static void gen8_ppgtt_free_va_range(struct i915_address_space *vm,
+				     uint64_t start,
+				     uint64_t length)
+{
+	struct i915_hw_ppgtt *ppgtt =
+		container_of(vm, struct i915_hw_ppgtt, base);
+	uint64_t end = start + length;
+
+	while (start < end) {
+		unsigned pdpe = start >> GEN8_PDPE_SHIFT & GEN8_PDPE_MASK;
+		unsigned pde = start >> GEN8_PDE_SHIFT & GEN8_PDE_MASK;
+		uint64_t next = gen8_pt_end(start, end);
+
+		if (!WARN_ON(ppgtt->gen8_pt_pages[pdpe][pde] == NULL)) {
+			ppgtt->gen8_pt_used[pdpe][pde] -=
+				(next - start) >> PAGE_SHIFT;
+			if (ppgtt->gen8_pt_used[pdpe][pde] == 0)
+				gen8_ppgtt_free_pt(ppgtt, pdpe, pde);
+		}
+
+		start = next;
+	}
+}
+
+static int gen8_ppgtt_allocate_va_range(struct i915_address_space *vm,
+					uint64_t start,
+					uint64_t length)
+{
+	struct i915_hw_ppgtt *ppgtt =
+		container_of(vm, struct i915_hw_ppgtt, base);
+	uint64_t end = start + length;
+	uint64_t addr = start;
+	int ret;
+
+	while (addr < end) {
+		unsigned pdpe = addr >> GEN8_PDPE_SHIFT & GEN8_PDPE_MASK;
+		unsigned pde = addr >> GEN8_PDE_SHIFT & GEN8_PDE_MASK;
+		uint64_t next = gen8_pt_end(addr, end);
+
+		if (ppgtt->gen8_pt_pages[pdpe][pde] == NULL) {
+			ret = gen8_ppgtt_alloc_pt(ppgtt, pdpe, pde);
+			if (ret) {
+				gen8_ppgtt_free_va_range(vm, start,
+							 addr - start);
+				return ret;
+			}
+		}
+
+		ppgtt->gen8_pt_used[pdpe][pde] += (next - addr) >> PAGE_SHIFT;
+		addr = next;
+	}
+
+	return 0;
+}
+
+static void gen8_dump_ppgtt(struct i915_hw_ppgtt *ppgtt, struct seq_file *m)
+{
+	seq_printf(m, "\tpage directories: %u, page tables: %u (%luKiB)%s\n",
+		   ppgtt->num_pd_pages, ppgtt->num_pt_pages,
+		   ppgtt->num_pt_pages * (PAGE_SIZE >> 10),
+		   ppgtt->scratch_pt ? "" : ", preallocated");
+}
+
 /**
  * GEN8 legacy ppgtt programming is accomplished through a max 4 PDP registers
  * with a net effect resembling a 2-level page table in normal x86 terms. Each
  * PDP represents 1GB of memory 4 * 512 * 512 * 4096 = 4GB legacy 32b address
  * space.
  *
- * FIXME: split allocation into smaller pieces. For now we only ever do this
- * once, but with full PPGTT, the multiple contiguous allocations will be bad.
+ * With full PPGTT every context gets its own address space, so only the page
+ * directories are allocated up front. Page tables are allocated when a vma is
+ * first bound over them and freed when the last vma covering them is unbound;
+ * until then their PDEs point at a single scratch page table. The page
+ * directories stay resident for the life of the ppgtt, so the PDP registers
+ * and the execlists context image never need reloading. The aliasing PPGTT
+ * mirrors the whole GGTT and still populates everything at init.
+ *
  * TODO: Do something with the size parameter
  */
 static int gen8_ppgtt_init(struct i915_hw_ppgtt *ppgtt, uint64_t size)
 {
 	const int max_pdp = DIV_ROUND_UP(size, 1 << 30);
 	const int min_pt_pages = GEN8_PDES_PER_PAGE * max_pdp;
+	const bool lazy = USES_FULL_PPGTT(ppgtt->base.dev);
 	int i, j, ret;
 
 	if (size % (1<<30))
 		DRM_INFO("Pages will be wasted unless GTT size (%llu) is divisible by 1GB\n", size);
 
 	/* 1. Do all our allocations for page directories and page tables. */
-	ret = gen8_ppgtt_alloc(ppgtt, max_pdp);
+	ret = gen8_ppgtt_alloc(ppgtt, max_pdp, !lazy);
 	if (ret)
 		return ret;
 
@@ -574,6 +788,9 @@ static int gen8_ppgtt_init(struct i915_hw_ppgtt *ppgtt, uint64_t size)
 		if (ret)
 			goto bail;
 
+		if (lazy)
+			continue;
+
 		for (j = 0; j < GEN8_PDES_PER_PAGE; j++) {
 			ret = gen8_ppgtt_setup_page_tables(ppgtt, i, j);
 			if (ret)
@@ -581,19 +798,26 @@ static int gen8_ppgtt_init(struct i915_hw_ppgtt *ppgtt, uint64_t size)
 		}
 	}
 
+	if (lazy) {
+		ret = gen8_ppgtt_setup_scratch_pt(ppgtt);
+		if (ret)
+			goto bail;
+	} else {
+		ppgtt->num_pt_pages = min_pt_pages;
+	}
+
 	/*
 	 * 3. Map all the page directory entires to point to the page tables
-	 * we've allocated.
+	 * we've allocated, or to the scratch page table.
 	 *
-	 * For now, the PPGTT helper functions all require that the PDEs are
-	 * plugged in correctly. So we do that now/here. For aliasing PPGTT, we
-	 * will never need to touch the PDEs again.
+	 * For aliasing PPGTT, we will never need to touch the PDEs again.
 	 */
 	for (i = 0; i < max_pdp; i++) {
 		gen8_ppgtt_pde_t *pd_vaddr;
 		pd_vaddr = kmap_atomic(&ppgtt->pd_pages[i]);
 		for (j = 0; j < GEN8_PDES_PER_PAGE; j++) {
-			dma_addr_t addr = ppgtt->gen8_pt_dma_addr[i][j];
+			dma_addr_t addr = lazy ? ppgtt->scratch_pt_dma_addr :
+						 ppgtt->gen8_pt_dma_addr[i][j];
 			pd_vaddr[j] = gen8_pde_encode(ppgtt->base.dev, addr,
 						      I915_CACHE_LLC);
 		}
@@ -605,17 +829,26 @@ static int gen8_ppgtt_init(struct i915_hw_ppgtt *ppgtt, uint64_t size)
 	ppgtt->switch_mm = gen8_mm_switch;
 	ppgtt->base.clear_range = gen8_ppgtt_clear_range;
 	ppgtt->base.insert_entries = gen8_ppgtt_insert_entries;
+	if (lazy) {
+		ppgtt->base.allocate_va_range = gen8_ppgtt_allocate_va_range;
+		ppgtt->base.free_va_range = gen8_ppgtt_free_va_range;
+	}
 	ppgtt->base.cleanup = gen8_ppgtt_cleanup;
 	ppgtt->base.start = 0;
 	ppgtt->base.total = ppgtt->num_pd_entries * GEN8_PTES_PER_PAGE * PAGE_SIZE;
+	ppgtt->debug_dump = gen8_dump_ppgtt;
 
 	ppgtt->base.clear_range(&ppgtt->base, 0, ppgtt->base.total, true);
 
 	DRM_DEBUG_DRIVER("Allocated %d pages for page directories (%d wasted)\n",
 			 ppgtt->num_pd_pages, ppgtt->num_pd_pages - max_pdp);
-	DRM_DEBUG_DRIVER("Allocated %d pages for page tables (%lld wasted)\n",
-			 ppgtt->num_pd_entries,
-			 (ppgtt->num_pd_entries - min_pt_pages) + size % (1<<30));
+	if (lazy)
+		DRM_DEBUG_DRIVER("Page tables for %d PDEs allocated on demand\n",
+				 ppgtt->num_pd_entries);
+	else
+		DRM_DEBUG_DRIVER("Allocated %d pages for page tables (%lld wasted)\n",
+				 ppgtt->num_pd_entries,
+				 (ppgtt->num_pd_entries - min_pt_pages) + size % (1<<30));
 	return 0;
 
 bail:
@@ -1218,6 +1451,11 @@ static void ppgtt_unbind_vma(struct i915_vma *vma)
 			     vma->node.start,
 			     vma->obj->base.size,
 			     true);
+
+	if (vma->vm->free_va_range)
+		vma->vm->free_va_range(vma->vm,
+				       vma->node.start,
+				       vma->node.size);
 }
 
 extern int intel_iommu_gfx_mapped;
@@ -1393,6 +1631,90 @@ static inline void gen8_set_pte(void __iomem *addr, gen8_gtt_pte_t pte)
 #endif
 }
 
+static void __ggtt_bind_flush(struct drm_i915_private *dev_priv)
+{
+	void __iomem *pte = dev_priv->gtt.last_pte;
+
+	/* XXX: This serves as a posting read to make sure that the PTE has
+	 * actually been updated. There is some concern that even though
+	 * registers and PTEs are within the same BAR that they are potentially
+	 * of NUMA access patterns. Therefore, even with the way we assume
+	 * hardware should work, we must keep this posting read for paranoia.
+	 */
+	if (INTEL_INFO(dev_priv->dev)->gen >= 8)
+		WARN_ON(readq(pte) != dev_priv->gtt.last_pte_value);
+	else
+		WARN_ON(readl(pte) != (u32)dev_priv->gtt.last_pte_value);
+
+	/* This next bit makes the above posting read even more important. We
+	 * want to flush the TLBs only after we're certain all the PTE updates
+	 * have finished.
+	 */
+	I915_WRITE(GFX_FLSH_CNTL_GEN6, GFX_FLSH_CNTL_EN);
+	POSTING_READ(GFX_FLSH_CNTL_GEN6);
+
+	dev_priv->gtt.stats.flushes++;
+}
+
+static void ggtt_bind_flush(struct drm_i915_private *dev_priv)
+{
+	if (dev_priv->gtt.bind_batch) {
+		dev_priv->gtt.batched_binds++;
+		return;
+	}
+
+	__ggtt_bind_flush(dev_priv);
+}
+
+/**
+ * i915_gem_gtt_bind_begin - start batching GGTT binds
+ * @dev: the device
+ *
+ * Until the matching i915_gem_gtt_bind_end(), GGTT binds only write their
+ * PTEs and leave the posting read and TLB flush pending, so that binding many
+ * objects costs a single flush. The caller must hold struct_mutex across the
+ * whole batch and must not touch the new bindings, through the aperture or
+ * the GPU, before ending it. Batches nest.
+ */
+void i915_gem_gtt_bind_begin(struct drm_device *dev)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+
+	if (INTEL_INFO(dev)->gen < 6)
+		return;
+
+	WARN_ON(!mutex_is_locked(&dev->struct_mutex));
+	dev_priv->gtt.bind_batch++;
+}
+
+/**
+ * i915_gem_gtt_bind_end - finish a batch of GGTT binds
+ * @dev: the device
+ *
+ * Issues the posting read and TLB flush for all GGTT binds made since the
+ * outermost i915_gem_gtt_bind_begin(), if there were any.
+ */
+void i915_gem_gtt_bind_end(struct drm_device *dev)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+
+	if (INTEL_INFO(dev)->gen < 6)
+		return;
+
+	if (WARN_ON(dev_priv->gtt.bind_batch == 0) ||
+	    --dev_priv->gtt.bind_batch)
+		return;
+
+	dev_priv->gtt.stats.batches++;
+	if (dev_priv->gtt.batched_binds == 0)
+		return;
+
+	__ggtt_bind_flush(dev_priv);
+	dev_priv->gtt.stats.batch_flushes++;
+	dev_priv->gtt.stats.batched_binds += dev_priv->gtt.batched_binds;
+	dev_priv->gtt.batched_binds = 0;
+}
+
 static void gen8_ggtt_insert_entries(struct i915_address_space *vm,
 				     struct sg_table *st,
 				     uint64_t start,
@@ -1414,23 +1736,12 @@ static void gen8_ggtt_insert_entries(struct i915_address_space *vm,
 		i++;
 	}
 
-	/*
-	 * XXX: This serves as a posting read to make sure that the PTE has
-	 * actually been updated. There is some concern that even though
-	 * registers and PTEs are within the same BAR that they are potentially
-	 * of NUMA access patterns. Therefore, even with the way we assume
-	 * hardware should work, we must keep this posting read for paranoia.
-	 */
-	if (i != 0)
-		WARN_ON(readq(&gtt_entries[i-1])
-			!= gen8_pte_encode(addr, level, true));
+	if (i == 0)
+		return;
 
-	/* This next bit makes the above posting read even more important. We
-	 * want to flush the TLBs only after we're certain all the PTE updates
-	 * have finished.
-	 */
-	I915_WRITE(GFX_FLSH_CNTL_GEN6, GFX_FLSH_CNTL_EN);
-	POSTING_READ(GFX_FLSH_CNTL_GEN6);
+	dev_priv->gtt.last_pte = &gtt_entries[i-1];
+	dev_priv->gtt.last_pte_value = gen8_pte_encode(addr, level, true);
+	ggtt_bind_flush(dev_priv);
 }
 
 /*
@@ -1458,23 +1769,12 @@ static void gen6_ggtt_insert_entries(struct i915_address_space *vm,
 		i++;
 	}
 
-	/* XXX: This serves as a posting read to make sure that the PTE has
-	 * actually been updated. There is some concern that even though
-	 * registers and PTEs are within the same BAR that they are potentially
-	 * of NUMA access patterns. Therefore, even with the way we assume
-	 * hardware should work, we must keep this posting read for paranoia.
-	 */
-	if (i != 0) {
-		unsigned long gtt = readl(&gtt_entries[i-1]);
-		WARN_ON(gtt != vm->pte_encode(addr, level, true, flags));
-	}
+	if (i == 0)
+		return;
 
-	/* This next bit makes the above posting read even more important. We
-	 * want to flush the TLBs only after we're certain all the PTE updates
-	 * have finished.
-	 */
-	I915_WRITE(GFX_FLSH_CNTL_GEN6, GFX_FLSH_CNTL_EN);
-	POSTING_READ(GFX_FLSH_CNTL_GEN6);
+	dev_priv->gtt.last_pte = &gtt_entries[i-1];
+	dev_priv->gtt.last_pte_value = vm->pte_encode(addr, level, true, flags);
+	ggtt_bind_flush(dev_priv);
 }
 
 static void gen8_ggtt_clear_range(struct i915_address_space *vm,
@@ -2174,6 +2474,7 @@ static struct i915_vma *__i915_gem_vma_create(struct drm_i915_gem_object *obj,
 	INIT_LIST_HEAD(&vma->vma_link);
 	INIT_LIST_HEAD(&vma->mm_list);
 	INIT_LIST_HEAD(&vma->exec_list);
+	INIT_LIST_HEAD(&vma->ctx_handles);
 	vma->vm = vm;
 	vma->obj = obj;
 
@@ -144,6 +144,9 @@ struct i915_vma {
 	unsigned long exec_handle;
 	struct drm_i915_gem_exec_object2 *exec_entry;
 
+	/** Context handle cache entries resolving to this vma */
+	struct list_head ctx_handles;
+
 	/**
 	 * How many users have pinned this object in GTT space. The following
 	 * users can each hold at most one reference: pwrite/pread, pin_ioctl
@@ -213,6 +216,14 @@ struct i915_address_space {
 			       struct sg_table *st,
 			       uint64_t start,
 			       enum i915_cache_level cache_level, u32 flags);
+	/* Optional: back [start, start + length) with page tables before the
+	 * first bind, and release them again once the range is unbound. */
+	int (*allocate_va_range)(struct i915_address_space *vm,
+				 uint64_t start,
+				 uint64_t length);
+	void (*free_va_range)(struct i915_address_space *vm,
+			      uint64_t start,
+			      uint64_t length);
 	void (*cleanup)(struct i915_address_space *vm);
 };
 
@@ -236,6 +247,23 @@ struct i915_gtt {
 
 	bool do_idle_maps;
 
+	/*
+	 * While bind_batch is raised, GGTT binds leave the posting read and
+	 * the TLB flush to i915_gem_gtt_bind_end(), which issues one for the
+	 * whole batch. last_pte/last_pte_value is the most recently written
+	 * entry, checked by that posting read.
+	 */
+	unsigned bind_batch;
+	unsigned batched_binds;
+	void __iomem *last_pte;
+	u64 last_pte_value;
+	struct {
+		u64 flushes;
+		u64 batches;
+		u64 batch_flushes;
+		u64 batched_binds;
+	} stats;
+
 	int mtrr;
 
 	/* global gtt ops */
@@ -264,6 +292,16 @@ struct i915_hw_ppgtt {
 		dma_addr_t *gen8_pt_dma_addr[4];
 	};
 
+	/*
+	 * gen8 full PPGTT allocates page tables on demand. Page directory
+	 * entries without one point at scratch_pt, and gen8_pt_used counts
+	 * the PTEs of each page table covered by bound vmas.
+	 */
+	struct page *scratch_pt;
+	dma_addr_t scratch_pt_dma_addr;
+	u16 *gen8_pt_used[GEN8_LEGACY_PDPS];
+	unsigned num_pt_pages;
+
 	struct drm_i915_file_private *file_priv;
 
 	int (*enable)(struct i915_hw_ppgtt *ppgtt);
@@ -299,5 +337,7 @@ void i915_gem_restore_gtt_mappings(struct drm_device *dev);
 
 int __must_check i915_gem_gtt_prepare_object(struct drm_i915_gem_object *obj);
 void i915_gem_gtt_finish_object(struct drm_i915_gem_object *obj);
+void i915_gem_gtt_bind_begin(struct drm_device *dev);
+void i915_gem_gtt_bind_end(struct drm_device *dev);
 
 #endif
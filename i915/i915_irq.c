@@ -1036,6 +1036,21 @@ static void notify_ring(struct drm_device *dev,
 	trace_i915_gem_request_complete(ring);
 
 	wake_up_all(&ring->irq_queue);
+
+	/*
+	 * Retire as soon as the GPU tells us a request completed, instead of
+	 * leaving objects on the active lists until the next periodic pass.
+	 * Back to back completions are batched into a single run of the
+	 * worker, which may only need to retire on one of the rings.
+	 */
+	if (ring->retire_irq) {
+		struct drm_i915_private *dev_priv = dev->dev_private;
+
+		if (ACCESS_ONCE(ring->retire_irq_ns) == 0)
+			ring->retire_irq_ns = ktime_get_raw_ns();
+
+		mod_delayed_work(dev_priv->wq, &dev_priv->mm.retire_work, 0);
+	}
 }
 
 static u32 vlv_c0_residency(struct drm_i915_private *dev_priv,
@@ -1385,13 +1400,41 @@ static irqreturn_t gen8_gt_irq_handler(struct drm_device *dev,
 {
 	struct intel_engine_cs *ring;
 	u32 rcs, bcs, vcs;
+	uint32_t iir[4] = {};
 	uint32_t tmp = 0;
 	irqreturn_t ret = IRQ_NONE;
 
+	/* Read and ack all the GT IIRs in one go, then process them */
+	intel_uncore_forcewake_batch_begin(dev_priv, 0);
+	if (master_ctl & (GEN8_GT_RCS_IRQ | GEN8_GT_BCS_IRQ)) {
+		iir[0] = I915_READ_FW(GEN8_GT_IIR(0));
+		if (iir[0])
+			I915_WRITE_FW(GEN8_GT_IIR(0), iir[0]);
+	}
+
+	if (master_ctl & (GEN8_GT_VCS1_IRQ | GEN8_GT_VCS2_IRQ)) {
+		iir[1] = I915_READ_FW(GEN8_GT_IIR(1));
+		if (iir[1])
+			I915_WRITE_FW(GEN8_GT_IIR(1), iir[1]);
+	}
+
+	if (master_ctl & GEN8_GT_PM_IRQ) {
+		iir[2] = I915_READ_FW(GEN8_GT_IIR(2));
+		if (iir[2] & dev_priv->pm_rps_events)
+			I915_WRITE_FW(GEN8_GT_IIR(2),
+				      iir[2] & dev_priv->pm_rps_events);
+	}
+
+	if (master_ctl & GEN8_GT_VECS_IRQ) {
+		iir[3] = I915_READ_FW(GEN8_GT_IIR(3));
+		if (iir[3])
+			I915_WRITE_FW(GEN8_GT_IIR(3), iir[3]);
+	}
+	intel_uncore_forcewake_batch_end(dev_priv);
+
 	if (master_ctl & (GEN8_GT_RCS_IRQ | GEN8_GT_BCS_IRQ)) {
-		tmp = I915_READ(GEN8_GT_IIR(0));
+		tmp = iir[0];
 		if (tmp) {
-			I915_WRITE(GEN8_GT_IIR(0), tmp);
 			ret = IRQ_HANDLED;
 
 			rcs = tmp >> GEN8_RCS_IRQ_SHIFT;
@@ -1412,9 +1455,8 @@ static irqreturn_t gen8_gt_irq_handler(struct drm_device *dev,
 	}
 
 	if (master_ctl & (GEN8_GT_VCS1_IRQ | GEN8_GT_VCS2_IRQ)) {
-		tmp = I915_READ(GEN8_GT_IIR(1));
+		tmp = iir[1];
 		if (tmp) {
-			I915_WRITE(GEN8_GT_IIR(1), tmp);
 			ret = IRQ_HANDLED;
 
 			vcs = tmp >> GEN8_VCS1_IRQ_SHIFT;
@@ -1435,10 +1477,8 @@ static irqreturn_t gen8_gt_irq_handler(struct drm_device *dev,
 	}
 
 	if (master_ctl & GEN8_GT_PM_IRQ) {
-		tmp = I915_READ(GEN8_GT_IIR(2));
+		tmp = iir[2];
 		if (tmp & dev_priv->pm_rps_events) {
-			I915_WRITE(GEN8_GT_IIR(2),
-				   tmp & dev_priv->pm_rps_events);
 			ret = IRQ_HANDLED;
 			gen6_rps_irq_handler(dev_priv, tmp);
 		} else
@@ -1446,9 +1486,8 @@ static irqreturn_t gen8_gt_irq_handler(struct drm_device *dev,
 	}
 
 	if (master_ctl & GEN8_GT_VECS_IRQ) {
-		tmp = I915_READ(GEN8_GT_IIR(3));
+		tmp = iir[3];
 		if (tmp) {
-			I915_WRITE(GEN8_GT_IIR(3), tmp);
 			ret = IRQ_HANDLED;
 
 			vcs = tmp >> GEN8_VECS_IRQ_SHIFT;
@@ -293,6 +293,42 @@ TRACE_EVENT(i915_gem_evict,
 		      __entry->flags & PIN_MAPPABLE ? ", mappable" : "")
 );
 
+TRACE_EVENT(i915_gem_evict_choice,
+	    TP_PROTO(struct i915_address_space *vm, u32 size,
+		     unsigned candidates, int policy, u64 cost,
+		     unsigned evicting),
+	    TP_ARGS(vm, size, candidates, policy, cost, evicting),
+
+	    TP_STRUCT__entry(
+			     __field(u32, dev)
+			     __field(struct i915_address_space *, vm)
+			     __field(u32, size)
+			     __field(unsigned, candidates)
+			     __field(int, policy)
+			     __field(u64, cost)
+			     __field(unsigned, evicting)
+			    ),
+
+	    TP_fast_assign(
+			   __entry->dev = vm->dev->primary->index;
+			   __entry->vm = vm;
+			   __entry->size = size;
+			   __entry->candidates = candidates;
+			   __entry->policy = policy;
+			   __entry->cost = cost;
+			   __entry->evicting = evicting;
+			  ),
+
+	    TP_printk("dev=%d, vm=%p, size=%d, candidates=%u, policy=%s, cost=%llu, evicting=%u",
+		      __entry->dev, __entry->vm, __entry->size,
+		      __entry->candidates,
+		      __print_symbolic(__entry->policy,
+				       { 0, "lru" },
+				       { 1, "cost" },
+				       { 2, "cost-idle" }),
+		      __entry->cost, __entry->evicting)
+);
+
 TRACE_EVENT(i915_gem_evict_everything,
 	    TP_PROTO(struct drm_device *dev),
 	    TP_ARGS(dev),
@@ -3,7 +3,9 @@
 
 #include <linux/hashtable.h>
 
-#define I915_CMD_HASH_ORDER 9
+#define I915_CMD_INDEX_SHIFT 23
+#define I915_CMD_INDEX_SIZE (1 << (32 - I915_CMD_INDEX_SHIFT))
+#define I915_CMD_CACHE_ORDER 5
 
 /* Early gen2 devices have a cacheline of just 32 bytes, using 64 is overkill,
  * but keeps the logic simple. Indeed, the whole purpose of this macro is just
@@ -143,6 +145,15 @@ struct  intel_engine_cs {
 	unsigned irq_refcount; /* protected by dev_priv->irq_lock */
 	u32		irq_enable_mask;	/* bitmask to enable ring interrupt */
 	u32		trace_irq_seqno;
+	/*
+	 * The user interrupt is held while requests are outstanding so that
+	 * completions kick the retire worker, see notify_ring().
+	 * retire_irq_ns stamps the first completion not yet retired.
+	 */
+	bool		retire_irq;
+	u64		retire_irq_ns;
+#define I915_RETIRE_LATENCY_BUCKETS 16
+	u64		retire_latency[I915_RETIRE_LATENCY_BUCKETS];
 	bool __must_check (*irq_get)(struct intel_engine_cs *ring);
 	void		(*irq_put)(struct intel_engine_cs *ring);
 
@@ -279,6 +290,20 @@ struct  intel_engine_cs {
 
 	struct intel_ring_hangcheck hangcheck;
 
+	/*
+	 * Statistics for __i915_wait_seqno(). Updated without locking by
+	 * concurrent waiters, so only approximate. avg_ns is a running
+	 * average of how long waits on this ring take to complete, and
+	 * sizes the optimistic spin before sleeping.
+	 */
+	struct {
+		u64 avg_ns;
+		u64 total_ns;
+		u64 waits;
+		u64 spin_hits;
+		u64 sleeps;
+	} wait_stats;
+
 	struct {
 		struct drm_i915_gem_object *obj;
 		u32 gtt_offset;
@@ -289,9 +314,12 @@ struct  intel_engine_cs {
 
 	/*
 	 * Table of commands the command parser needs to know about
-	 * for this ring.
+	 * for this ring, indexed by bits 31:23 of the command header.
 	 */
-	DECLARE_HASHTABLE(cmd_hash, I915_CMD_HASH_ORDER);
+	struct {
+		const struct drm_i915_cmd_descriptor **descs;
+		u16 first[I915_CMD_INDEX_SIZE + 1];
+	} cmd_index;
 
 	/*
 	 * Table of registers allowed in commands that read/write registers.
@@ -317,6 +345,20 @@ struct  intel_engine_cs {
 	 * to encode the command length in the header).
 	 */
 	u32 (*get_cmd_length_mask)(u32 cmd_header);
+
+	/*
+	 * Batches that already passed the command parser on this ring, looked
+	 * up by contents so that resubmitting an unchanged batch can skip the
+	 * parse. Protected by struct_mutex.
+	 */
+	struct {
+		DECLARE_HASHTABLE(hash, I915_CMD_CACHE_ORDER);
+		struct list_head lru;
+		unsigned int count;
+		u64 hits;
+		u64 misses;
+		u64 evictions;
+	} cmd_cache;
 };
 
 bool intel_ring_initialized(struct intel_engine_cs *ring);
@@ -442,6 +484,21 @@ static inline u32 intel_ring_get_seqno(struct intel_engine_cs *ring)
 	return ring->outstanding_lazy_seqno;
 }
 
+static inline void i915_retire_irq_get(struct intel_engine_cs *ring)
+{
+	if (!ring->retire_irq && ring->irq_get(ring))
+		ring->retire_irq = true;
+}
+
+static inline void i915_retire_irq_put(struct intel_engine_cs *ring)
+{
+	if (ring->retire_irq) {
+		ring->irq_put(ring);
+		ring->retire_irq = false;
+	}
+	ring->retire_irq_ns = 0;
+}
+
 static inline void i915_trace_irq_get(struct intel_engine_cs *ring, u32 seqno)
 {
 	if (ring->trace_irq_seqno == 0 && ring->irq_get(ring))
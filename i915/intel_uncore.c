@@ -620,6 +620,137 @@ out:
 		intel_runtime_pm_put(dev_priv);
 }
 
+static void fw_domains_get_timed(struct drm_i915_private *dev_priv,
+				 int fw_engine)
+{
+	struct intel_uncore_fw_stats *stats;
+	unsigned domains;
+	u64 start, elapsed;
+
+	start = ktime_get_raw_ns();
+	dev_priv->uncore.fw_domains_get(dev_priv, fw_engine);
+	elapsed = ktime_get_raw_ns() - start;
+
+	/* Platforms with a single wake bit account it all to render */
+	domains = fw_engine & dev_priv->uncore.fw_domains;
+	if (domains == 0)
+		domains = FORCEWAKE_RENDER;
+
+	for (stats = dev_priv->uncore.fw_stats; domains; domains >>= 1, stats++) {
+		if ((domains & 1) == 0)
+			continue;
+
+		stats->wakes++;
+		stats->ack_ns += elapsed;
+		if (elapsed > stats->max_ack_ns)
+			stats->max_ack_ns = elapsed;
+	}
+}
+
+/* Takes a reference on each domain, waking those not yet awake. */
+static void fw_domains_ref(struct drm_i915_private *dev_priv, unsigned fw)
+{
+	struct intel_uncore *uncore = &dev_priv->uncore;
+	unsigned wake = 0;
+
+	if (IS_GEN9(dev_priv->dev) || IS_VALLEYVIEW(dev_priv->dev)) {
+		fw &= uncore->fw_domains;
+		if (fw & FORCEWAKE_RENDER && uncore->fw_rendercount++ == 0)
+			wake |= FORCEWAKE_RENDER;
+		if (fw & FORCEWAKE_MEDIA && uncore->fw_mediacount++ == 0)
+			wake |= FORCEWAKE_MEDIA;
+		if (fw & FORCEWAKE_BLITTER && uncore->fw_blittercount++ == 0)
+			wake |= FORCEWAKE_BLITTER;
+	} else if (uncore->forcewake_count++ == 0)
+		wake = FORCEWAKE_ALL;
+
+	if (wake)
+		uncore->funcs.force_wake_get(dev_priv, wake);
+}
+
+static void fw_domains_unref(struct drm_i915_private *dev_priv, unsigned fw)
+{
+	struct intel_uncore *uncore = &dev_priv->uncore;
+	unsigned release = 0;
+
+	if (IS_GEN9(dev_priv->dev) || IS_VALLEYVIEW(dev_priv->dev)) {
+		fw &= uncore->fw_domains;
+		if (fw & FORCEWAKE_RENDER &&
+		    !WARN_ON(uncore->fw_rendercount == 0) &&
+		    --uncore->fw_rendercount == 0)
+			release |= FORCEWAKE_RENDER;
+		if (fw & FORCEWAKE_MEDIA &&
+		    !WARN_ON(uncore->fw_mediacount == 0) &&
+		    --uncore->fw_mediacount == 0)
+			release |= FORCEWAKE_MEDIA;
+		if (fw & FORCEWAKE_BLITTER &&
+		    !WARN_ON(uncore->fw_blittercount == 0) &&
+		    --uncore->fw_blittercount == 0)
+			release |= FORCEWAKE_BLITTER;
+	} else if (!WARN_ON(uncore->forcewake_count == 0) &&
+		   --uncore->forcewake_count == 0)
+		release = FORCEWAKE_ALL;
+
+	if (release)
+		uncore->funcs.force_wake_put(dev_priv, release);
+}
+
+/**
+ * intel_uncore_forcewake_batch_begin - start a run of raw register access
+ * @dev_priv: i915 device
+ * @fw_domains: FORCEWAKE_* domains the registers accessed belong to, may be 0
+ *
+ * Takes the uncore lock and wakes @fw_domains once, so that the following
+ * I915_READ_FW()/I915_WRITE_FW() accesses skip the per-access locking and
+ * forcewake handshake of I915_READ()/I915_WRITE(). Usable from irq context.
+ * The batch must be short and must not call into anything that accesses
+ * registers through the regular accessors, as that would retake the lock.
+ */
+void intel_uncore_forcewake_batch_begin(struct drm_i915_private *dev_priv,
+					int fw_domains)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&dev_priv->uncore.lock, irqflags);
+	dev_priv->uncore.batch_irqflags = irqflags;
+	dev_priv->uncore.fw_batches++;
+
+	if (!dev_priv->uncore.funcs.force_wake_get)
+		fw_domains = 0;
+
+	if (fw_domains)
+		fw_domains_ref(dev_priv, fw_domains);
+	dev_priv->uncore.batch_domains = fw_domains;
+}
+
+/**
+ * intel_uncore_forcewake_batch_end - finish a run of raw register access
+ * @dev_priv: i915 device
+ *
+ * Drops the references taken by intel_uncore_forcewake_batch_begin() and the
+ * uncore lock. Domains nobody else holds are released straight away, just as
+ * the single access path does; the delayed release of gen6_gt_force_wake_put()
+ * needs a runtime pm reference, which cannot be taken from irq context.
+ */
+void intel_uncore_forcewake_batch_end(struct drm_i915_private *dev_priv)
+{
+	struct drm_device *dev = dev_priv->dev;
+
+	if (dev_priv->uncore.batch_domains) {
+		/* Raw writes bypassed the GT FIFO accounting, resync it */
+		if (IS_GEN6(dev) || IS_GEN7(dev))
+			dev_priv->uncore.fifo_count =
+				__raw_i915_read32(dev_priv, GTFIFOCTL) &
+				GT_FIFO_FREE_ENTRIES_MASK;
+
+		fw_domains_unref(dev_priv, dev_priv->uncore.batch_domains);
+	}
+	dev_priv->uncore.batch_domains = 0;
+
+	spin_unlock_irqrestore(&dev_priv->uncore.lock,
+			       dev_priv->uncore.batch_irqflags);
+}
+
 void assert_force_wake_inactive(struct drm_i915_private *dev_priv)
 {
 	if (!dev_priv->uncore.funcs.force_wake_get)
@@ -1200,6 +1331,20 @@ void intel_uncore_init(struct drm_device *dev)
 			__gen6_gt_force_wake_put;
 	}
 
+	if (IS_GEN9(dev))
+		dev_priv->uncore.fw_domains = FORCEWAKE_ALL;
+	else if (IS_VALLEYVIEW(dev))
+		dev_priv->uncore.fw_domains = FORCEWAKE_RENDER | FORCEWAKE_MEDIA;
+	else
+		dev_priv->uncore.fw_domains = FORCEWAKE_RENDER;
+
+	/* Account every hardware wake, whichever path it comes from */
+	if (dev_priv->uncore.funcs.force_wake_get) {
+		dev_priv->uncore.fw_domains_get =
+			dev_priv->uncore.funcs.force_wake_get;
+		dev_priv->uncore.funcs.force_wake_get = fw_domains_get_timed;
+	}
+
 	switch (INTEL_INFO(dev)->gen) {
 	default:
 		WARN_ON(1);
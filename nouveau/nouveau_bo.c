@@ -692,6 +692,24 @@ nouveau_bo_evict_flags(struct ttm_buffer_object *bo, struct ttm_placement *pl)
 	*pl = nvbo->placement;
 }
 
+/*
+ * Keep buffers userspace asked to have in VRAM only, then tiled buffers,
+ * over the rest. Kernel objects are created as device buffers too, but
+ * those that matter are pinned and never on the LRU.
+ */
+static unsigned
+nouveau_bo_lru_priority(struct ttm_buffer_object *bo)
+{
+	struct nouveau_bo *nvbo = nouveau_bo(bo);
+
+	if (bo->destroy != nouveau_bo_del_ttm)
+		return 0;
+	if (nvbo->valid_domains == NOUVEAU_GEM_DOMAIN_VRAM)
+		return 2;
+	if (nvbo->tile_flags)
+		return 1;
+	return 0;
+}
 
 static int
 nve0_bo_move_init(struct nouveau_channel *chan, u32 handle)
@@ -1619,6 +1637,7 @@ struct ttm_bo_driver nouveau_bo_driver = {
 	.invalidate_caches = nouveau_bo_invalidate_caches,
 	.init_mem_type = nouveau_bo_init_mem_type,
 	.evict_flags = nouveau_bo_evict_flags,
+	.lru_priority = nouveau_bo_lru_priority,
 	.move_notify = nouveau_bo_move_ntfy,
 	.move = nouveau_bo_move,
 	.verify_access = nouveau_bo_verify_access,
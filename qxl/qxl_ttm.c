@@ -206,6 +206,22 @@ static void qxl_evict_flags(struct ttm_buffer_object *bo,
 	*placement = qbo->placement;
 }
 
+/* Surfaces live as long as the host knows about them, keep them resident */
+static unsigned qxl_lru_priority(struct ttm_buffer_object *bo)
+{
+	struct qxl_bo *qbo;
+
+	if (!qxl_ttm_bo_is_qxl_bo(bo))
+		return 0;
+
+	qbo = container_of(bo, struct qxl_bo, tbo);
+	if (bo->type == ttm_bo_type_kernel)
+		return 3;
+	if (qbo->type == QXL_GEM_DOMAIN_SURFACE)
+		return 2;
+	return 0;
+}
+
 static int qxl_verify_access(struct ttm_buffer_object *bo, struct file *filp)
 {
 	struct qxl_bo *qbo = to_qxl_bo(bo);
@@ -379,6 +395,7 @@ static struct ttm_bo_driver qxl_bo_driver = {
 	.invalidate_caches = &qxl_invalidate_caches,
 	.init_mem_type = &qxl_init_mem_type,
 	.evict_flags = &qxl_evict_flags,
+	.lru_priority = &qxl_lru_priority,
 	.move = &qxl_bo_move,
 	.verify_access = &qxl_verify_access,
 	.io_mem_reserve = &qxl_ttm_io_mem_reserve,
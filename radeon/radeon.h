@@ -155,6 +155,9 @@ extern int radeon_backlight;
 #define RADEON_VA_RESERVED_SIZE			(8 << 20)
 #define RADEON_IB_VM_MAX_SIZE			(64 << 10)
 
+/* dwords of PTE updates merged into one IB */
+#define RADEON_VM_BATCH_MAX_NDW			(RADEON_IB_VM_MAX_SIZE / 4)
+
 /* hard reset data */
 #define RADEON_ASIC_RESET_DATA                  0x39d5e86b
 
@@ -358,6 +361,13 @@ struct radeon_fence_driver {
 	atomic64_t			last_seq;
 	bool				initialized, delayed_irq;
 	struct delayed_work		lockup_work;
+	/* fences with signaling enabled, in seq order, and their lock */
+	spinlock_t			lock;
+	struct list_head		signal_list;
+	/* signaling passes, callbacks run and most callbacks in a pass */
+	unsigned long			signal_runs;
+	unsigned long			signal_callbacks;
+	unsigned			signal_max;
 };
 
 struct radeon_fence {
@@ -369,7 +379,7 @@ struct radeon_fence {
 	unsigned		ring;
 	bool			is_vm_update;
 
-	wait_queue_t		fence_wake;
+	struct list_head	signal_link;
 };
 
 int radeon_fence_driver_start_ring(struct radeon_device *rdev, int ring);
@@ -472,6 +482,7 @@ struct radeon_bo_va {
 	/* protected by vm mutex */
 	struct interval_tree_node	it;
 	struct list_head		vm_status;
+	struct list_head		batch;
 
 	/* constant after initialization */
 	struct radeon_vm		*vm;
@@ -528,11 +539,11 @@ int radeon_gem_debugfs_init(struct radeon_device *rdev);
  * each sub object until we reach object_offset+object_size >=
  * alloc_size, this object then become the sub object we return.
  *
- * Alignment can't be bigger than page size.
+ * Sub objects freed with a fence are released from a callback of
+ * that fence, which may leave holes anywhere in the buffer, so the
+ * search wraps over all the sub objects still in use before waiting.
  *
- * Hole are not considered for allocation to keep things simple.
- * Assumption is that there won't be hole (all object on same
- * alignment).
+ * Alignment can't be bigger than page size.
  */
 struct radeon_sa_manager {
 	wait_queue_head_t	wq;
@@ -540,6 +551,7 @@ struct radeon_sa_manager {
 	struct list_head	*hole;
 	struct list_head	flist[RADEON_NUM_RINGS];
 	struct list_head	olist;
+	unsigned long		frees;
 	unsigned		size;
 	uint64_t		gpu_addr;
 	void			*cpu_ptr;
@@ -557,6 +569,7 @@ struct radeon_sa_bo {
 	unsigned			soffset;
 	unsigned			eoffset;
 	struct radeon_fence		*fence;
+	struct fence_cb			cb;
 };
 
 /*
@@ -648,6 +661,21 @@ struct radeon_gart {
 	struct page			**pages;
 	uint64_t			*pages_entry;
 	bool				ready;
+
+	/* TLB flush deferred until the GPU next needs the new entries,
+	 * protected by tlb_lock like the stats */
+	spinlock_t			tlb_lock;
+	bool				tlb_dirty;
+	struct {
+		u64			pte_writes;
+		u64			binds;
+		u64			unbinds;
+		u64			flushes;
+		/* last debugfs sample, for the rates */
+		unsigned long		sample_jiffies;
+		u64			sample_pte_writes;
+		u64			sample_flushes;
+	} stats;
 };
 
 int radeon_gart_table_ram_alloc(struct radeon_device *rdev);
@@ -660,6 +688,7 @@ int radeon_gart_init(struct radeon_device *rdev);
 void radeon_gart_fini(struct radeon_device *rdev);
 void radeon_gart_unbind(struct radeon_device *rdev, unsigned offset,
 			int pages);
+void radeon_gart_tlb_sync(struct radeon_device *rdev);
 int radeon_gart_bind(struct radeon_device *rdev, unsigned offset,
 		     int pages, struct page **pagelist,
 		     dma_addr_t *dma_addr, uint32_t flags);
@@ -871,6 +900,18 @@ struct radeon_ring {
 	struct radeon_bo	*mqd_obj;
 	u32 doorbell_index;
 	unsigned		wptr_offs;
+	/* submission lock, always taken in ascending ring index order */
+	struct mutex		mutex;
+	/* updated under the submission lock, except trylock_failed */
+	struct {
+		u64		locked_at;
+		u64		hold_ns;
+		u64		max_hold_ns;
+		u64		wait_ns;
+		unsigned long	acquired;
+		unsigned long	contended;
+		atomic_t	trylock_failed;
+	} lock_stats;
 };
 
 struct radeon_mec {
@@ -925,6 +966,14 @@ struct radeon_vm_id {
 	struct radeon_fence	*last_id_use;
 };
 
+/* PTE updates written together, protected by the vm mutex */
+struct radeon_vm_batch {
+	struct radeon_vm	*vm;
+	/* freed mappings, cleared before the updates */
+	struct list_head	freed;
+	struct list_head	updates;
+};
+
 struct radeon_vm {
 	struct mutex		mutex;
 
@@ -963,6 +1012,10 @@ struct radeon_vm_manager {
 	bool				enabled;
 	/* for hw to save the PD addr on suspend/resume */
 	uint32_t			saved_table_addr[RADEON_NUM_VM];
+	/* ids grabbed by a ring and not yet fenced, so other rings skip
+	 * them; protected by id_lock together with active[] */
+	unsigned long			reserved;
+	spinlock_t			id_lock;
 };
 
 /*
@@ -1025,6 +1078,11 @@ bool radeon_ring_supports_scratch_reg(struct radeon_device *rdev,
 				      struct radeon_ring *ring);
 void radeon_ring_free_size(struct radeon_device *rdev, struct radeon_ring *cp);
 int radeon_ring_alloc(struct radeon_device *rdev, struct radeon_ring *cp, unsigned ndw);
+void radeon_ring_mutex_lock(struct radeon_ring *ring);
+bool radeon_ring_mutex_trylock(struct radeon_ring *ring);
+void radeon_ring_mutex_unlock(struct radeon_ring *ring);
+void radeon_ring_lock_all(struct radeon_device *rdev);
+void radeon_ring_unlock_all(struct radeon_device *rdev);
 int radeon_ring_lock(struct radeon_device *rdev, struct radeon_ring *cp, unsigned ndw);
 void radeon_ring_commit(struct radeon_device *rdev, struct radeon_ring *cp,
 			bool hdp_flush);
@@ -1774,6 +1832,8 @@ void radeon_test_ring_sync(struct radeon_device *rdev,
 			   struct radeon_ring *cpA,
 			   struct radeon_ring *cpB);
 void radeon_test_syncing(struct radeon_device *rdev);
+void radeon_test_gart(struct radeon_device *rdev);
+void radeon_test_vm_batch(struct radeon_device *rdev);
 
 /*
  * MMU Notifier
@@ -2354,7 +2414,6 @@ struct radeon_device {
 	struct radeon_fence_driver	fence_drv[RADEON_NUM_RINGS];
 	wait_queue_head_t		fence_queue;
 	unsigned			fence_context;
-	struct mutex			ring_lock;
 	struct radeon_ring		ring[RADEON_NUM_RINGS];
 	bool				ib_pool_ready;
 	struct radeon_sa_manager	ring_tmp_bo;
@@ -2982,6 +3041,8 @@ struct radeon_bo_list *radeon_vm_get_bos(struct radeon_device *rdev,
                                           struct list_head *head);
 struct radeon_fence *radeon_vm_grab_id(struct radeon_device *rdev,
 				       struct radeon_vm *vm, int ring);
+void radeon_vm_put_id(struct radeon_device *rdev,
+		      struct radeon_vm *vm, int ring);
 void radeon_vm_flush(struct radeon_device *rdev,
                      struct radeon_vm *vm,
 		     int ring, struct radeon_fence *fence);
@@ -2998,6 +3059,19 @@ int radeon_vm_clear_invalids(struct radeon_device *rdev,
 int radeon_vm_bo_update(struct radeon_device *rdev,
 			struct radeon_bo_va *bo_va,
 			struct ttm_mem_reg *mem);
+void radeon_vm_batch_init(struct radeon_vm_batch *batch, struct radeon_vm *vm);
+int radeon_vm_batch_add(struct radeon_device *rdev,
+			struct radeon_vm_batch *batch,
+			struct radeon_bo_va *bo_va,
+			struct ttm_mem_reg *mem);
+void radeon_vm_batch_add_freed(struct radeon_device *rdev,
+			       struct radeon_vm_batch *batch);
+int radeon_vm_batch_add_invalids(struct radeon_device *rdev,
+				 struct radeon_vm_batch *batch);
+struct radeon_bo_va *radeon_vm_batch_run(struct list_head *head,
+					 struct radeon_bo_va *first);
+int radeon_vm_batch_commit(struct radeon_device *rdev,
+			   struct radeon_vm_batch *batch);
 void radeon_vm_bo_invalidate(struct radeon_device *rdev,
 			     struct radeon_bo *bo);
 struct radeon_bo_va *radeon_vm_bo_find(struct radeon_vm *vm,
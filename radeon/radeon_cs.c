@@ -477,6 +477,7 @@ static int radeon_bo_vm_update_pte(struct radeon_cs_parser *p,
 				   struct radeon_vm *vm)
 {
 	struct radeon_device *rdev = p->rdev;
+	struct radeon_vm_batch batch;
 	struct radeon_bo_va *bo_va;
 	int i, r;
 
@@ -484,19 +485,20 @@ static int radeon_bo_vm_update_pte(struct radeon_cs_parser *p,
 	if (r)
 		return r;
 
-	r = radeon_vm_clear_freed(rdev, vm);
-	if (r)
-		return r;
-
 	if (vm->ib_bo_va == NULL) {
 		DRM_ERROR("Tmp BO not in VM!\n");
 		return -EINVAL;
 	}
 
-	r = radeon_vm_bo_update(rdev, vm->ib_bo_va,
+	/* collect all the PTE updates of this submission, so they are
+	 * written with as few IBs and fences as possible */
+	radeon_vm_batch_init(&batch, vm);
+	radeon_vm_batch_add_freed(rdev, &batch);
+
+	r = radeon_vm_batch_add(rdev, &batch, vm->ib_bo_va,
 				&rdev->ring_tmp_bo.bo->tbo.mem);
 	if (r)
-		return r;
+		goto error;
 
 	for (i = 0; i < p->nrelocs; i++) {
 		struct radeon_bo *bo;
@@ -505,17 +507,34 @@ static int radeon_bo_vm_update_pte(struct radeon_cs_parser *p,
 		bo_va = radeon_vm_bo_find(vm, bo);
 		if (bo_va == NULL) {
 			dev_err(rdev->dev, "bo %p not in vm %p\n", bo, vm);
-			return -EINVAL;
+			r = -EINVAL;
+			goto error;
 		}
 
-		r = radeon_vm_bo_update(rdev, bo_va, &bo->tbo.mem);
+		r = radeon_vm_batch_add(rdev, &batch, bo_va, &bo->tbo.mem);
 		if (r)
-			return r;
+			goto error;
+	}
 
+	r = radeon_vm_batch_add_invalids(rdev, &batch);
+	if (r)
+		goto error;
+
+	r = radeon_vm_batch_commit(rdev, &batch);
+	if (r)
+		return r;
+
+	for (i = 0; i < p->nrelocs; i++) {
+		bo_va = radeon_vm_bo_find(vm, p->relocs[i].robj);
 		radeon_sync_fence(&p->ib.sync, bo_va->last_pt_update);
 	}
 
-	return radeon_vm_clear_invalids(rdev, vm);
+	return 0;
+
+error:
+	/* still write what was collected, the mappings are updated */
+	radeon_vm_batch_commit(rdev, &batch);
+	return r;
 }
 
 static int radeon_cs_ib_vm_chunk(struct radeon_device *rdev,
@@ -1299,7 +1299,10 @@ int radeon_device_init(struct radeon_device *rdev,
 
 	/* mutex initialization are all done here so we
 	 * can recall function without having locking issues */
-	mutex_init(&rdev->ring_lock);
+	for (i = 0; i < RADEON_NUM_RINGS; i++)
+		mutex_init(&rdev->ring[i].mutex);
+	spin_lock_init(&rdev->vm_manager.id_lock);
+	spin_lock_init(&rdev->gart.tlb_lock);
 	mutex_init(&rdev->dc_hw_i2c_mutex);
 	atomic_set(&rdev->ih.lock, 0);
 	mutex_init(&rdev->gem.mutex);
@@ -1470,6 +1473,14 @@ int radeon_device_init(struct radeon_device *rdev,
 		else
 			DRM_INFO("radeon: acceleration disabled, skipping sync tests\n");
 	}
+	if ((radeon_testing & 4)) {
+		if (rdev->gart.ready)
+			radeon_test_gart(rdev);
+		else
+			DRM_INFO("radeon: no gart, skipping gart tests\n");
+	}
+	if ((radeon_testing & 8))
+		radeon_test_vm_batch(rdev);
 	if (radeon_benchmarking) {
 		if (rdev->accel_working)
 			radeon_benchmark(rdev, radeon_benchmarking);
@@ -625,6 +625,8 @@ static struct pci_driver radeon_kms_pci_driver = {
 
 static int __init radeon_init(void)
 {
+	int r;
+
 #ifdef CONFIG_VGA_CONSOLE
 	if (vgacon_text_force() && radeon_modeset == -1) {
 		DRM_INFO("VGACON disable radeon kernel modesetting.\n");
@@ -656,10 +658,17 @@ static int __init radeon_init(void)
 #endif
 	}
 
+	r = radeon_sa_init();
+	if (r)
+		return r;
+
 	radeon_kfd_init();
 
 	/* let modprobe override vga console setting */
-	return drm_pci_init(driver, pdriver);
+	r = drm_pci_init(driver, pdriver);
+	if (r)
+		radeon_sa_fini();
+	return r;
 }
 
 static void __exit radeon_exit(void)
@@ -667,6 +676,7 @@ static void __exit radeon_exit(void)
 	radeon_kfd_fini();
 	drm_pci_exit(driver, pdriver);
 	radeon_unregister_atpx_handler();
+	radeon_sa_fini();
 }
 
 module_init(radeon_init);
@@ -141,8 +141,9 @@ int radeon_fence_emit(struct radeon_device *rdev,
 	(*fence)->seq = seq;
 	(*fence)->ring = ring;
 	(*fence)->is_vm_update = false;
+	INIT_LIST_HEAD(&(*fence)->signal_link);
 	fence_init(&(*fence)->base, &radeon_fence_ops,
-		   &rdev->fence_queue.lock, rdev->fence_context + ring, seq);
+		   &rdev->fence_drv[ring].lock, rdev->fence_context + ring, seq);
 	radeon_fence_ring_emit(rdev, ring, *fence);
 	trace_radeon_fence_emit(rdev->ddev, ring, (*fence)->seq);
 	radeon_fence_schedule_check(rdev, ring);
@@ -150,38 +151,65 @@ int radeon_fence_emit(struct radeon_device *rdev,
 }
 
 /**
- * radeon_fence_check_signaled - callback from fence_queue
+ * radeon_fence_signal_locked - signal the completed fences of a ring
  *
- * this function is called with fence_queue lock held, which is also used
- * for the fence locking itself, so unlocked variants are used for
- * fence_signal, and remove_wait_queue.
+ * @rdev: radeon_device pointer
+ * @ring: ring index the fences are associated with
+ *
+ * Signals the fences on the ring's signal list that the last signaled
+ * sequence number covers. The list is kept in seq order, so only the
+ * completed prefix is visited. Must be called with the ring's fence
+ * lock held, which is also used for the fence locking itself, so
+ * unlocked variants are used for fence_signal.
  */
-static int radeon_fence_check_signaled(wait_queue_t *wait, unsigned mode, int flags, void *key)
+static void radeon_fence_signal_locked(struct radeon_device *rdev, int ring)
 {
-	struct radeon_fence *fence;
+	struct radeon_fence_driver *fence_drv = &rdev->fence_drv[ring];
+	struct radeon_fence *fence, *tmp;
+	unsigned count = 0;
 	u64 seq;
 
-	fence = container_of(wait, struct radeon_fence, fence_wake);
-
-	/*
-	 * We cannot use radeon_fence_process here because we're already
-	 * in the waitqueue, in a call from wake_up_all.
-	 */
-	seq = atomic64_read(&fence->rdev->fence_drv[fence->ring].last_seq);
-	if (seq >= fence->seq) {
-		int ret = fence_signal_locked(&fence->base);
+	seq = atomic64_read(&fence_drv->last_seq);
+	list_for_each_entry_safe(fence, tmp, &fence_drv->signal_list,
+				 signal_link) {
+		if (fence->seq > seq)
+			break;
 
-		if (!ret)
+		list_del_init(&fence->signal_link);
+		if (!fence_signal_locked(&fence->base))
 			FENCE_TRACE(&fence->base, "signaled from irq context\n");
 		else
 			FENCE_TRACE(&fence->base, "was already signaled\n");
 
-		radeon_irq_kms_sw_irq_put(fence->rdev, fence->ring);
-		__remove_wait_queue(&fence->rdev->fence_queue, &fence->fence_wake);
+		radeon_irq_kms_sw_irq_put(rdev, ring);
 		fence_put(&fence->base);
-	} else
-		FENCE_TRACE(&fence->base, "pending\n");
-	return 0;
+		count++;
+	}
+
+	fence_drv->signal_runs++;
+	fence_drv->signal_callbacks += count;
+	if (count > fence_drv->signal_max)
+		fence_drv->signal_max = count;
+}
+
+/**
+ * radeon_fence_signal - signal the completed fences of a ring
+ *
+ * @rdev: radeon_device pointer
+ * @ring: ring index the fences are associated with
+ *
+ * Signals the completed fences of the ring and wakes up
+ * everybody waiting on the fence queue.
+ */
+static void radeon_fence_signal(struct radeon_device *rdev, int ring)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&rdev->fence_drv[ring].lock, irqflags);
+	radeon_fence_signal_locked(rdev, ring);
+	spin_unlock_irqrestore(&rdev->fence_drv[ring].lock, irqflags);
+
+	wake_up_all(&rdev->fence_queue);
 }
 
 /**
@@ -291,7 +319,7 @@ static void radeon_fence_check_lockup(struct work_struct *work)
 	}
 
 	if (radeon_fence_activity(rdev, ring))
-		wake_up_all(&rdev->fence_queue);
+		radeon_fence_signal(rdev, ring);
 
 	else if (radeon_ring_is_lockup(rdev, ring, &rdev->ring[ring])) {
 
@@ -314,13 +342,14 @@ static void radeon_fence_check_lockup(struct work_struct *work)
  * @rdev: radeon_device pointer
  * @ring: ring index the fence is associated with
  *
- * Checks the current fence value and wakes the fence queue
- * if the sequence number has increased (all asics).
+ * Checks the current fence value and, if the sequence number has
+ * increased, signals the completed fences of this ring and wakes
+ * the fence queue (all asics).
  */
 void radeon_fence_process(struct radeon_device *rdev, int ring)
 {
 	if (radeon_fence_activity(rdev, ring))
-		wake_up_all(&rdev->fence_queue);
+		radeon_fence_signal(rdev, ring);
 }
 
 /**
@@ -377,14 +406,16 @@ static bool radeon_fence_is_signaled(struct fence *f)
  * radeon_fence_enable_signaling - enable signalling on fence
  * @fence: fence
  *
- * This function is called with fence_queue lock held, and adds a callback
- * to fence_queue that checks if this fence is signaled, and if so it
- * signals the fence and removes itself.
+ * This function is called with the ring's fence lock held, and adds the
+ * fence to the ring's signal list, keeping the list sorted by seq. The
+ * fence is signaled and removed once the ring's fence value passes it.
  */
 static bool radeon_fence_enable_signaling(struct fence *f)
 {
 	struct radeon_fence *fence = to_radeon_fence(f);
 	struct radeon_device *rdev = fence->rdev;
+	struct radeon_fence_driver *fence_drv = &rdev->fence_drv[fence->ring];
+	struct list_head *pos;
 
 	if (atomic64_read(&rdev->fence_drv[fence->ring].last_seq) >= fence->seq)
 		return false;
@@ -392,8 +423,10 @@ static bool radeon_fence_enable_signaling(struct fence *f)
 	if (down_read_trylock(&rdev->exclusive_lock)) {
 		radeon_irq_kms_sw_irq_get(rdev, fence->ring);
 
-		if (radeon_fence_activity(rdev, fence->ring))
-			wake_up_all_locked(&rdev->fence_queue);
+		if (radeon_fence_activity(rdev, fence->ring)) {
+			radeon_fence_signal_locked(rdev, fence->ring);
+			wake_up_all(&rdev->fence_queue);
+		}
 
 		/* did fence get signaled after we enabled the sw irq? */
 		if (atomic64_read(&rdev->fence_drv[fence->ring].last_seq) >= fence->seq) {
@@ -410,10 +443,13 @@ static bool radeon_fence_enable_signaling(struct fence *f)
 		radeon_fence_schedule_check(rdev, fence->ring);
 	}
 
-	fence->fence_wake.flags = 0;
-	fence->fence_wake.private = NULL;
-	fence->fence_wake.func = radeon_fence_check_signaled;
-	__add_wait_queue(&rdev->fence_queue, &fence->fence_wake);
+	/* fences are mostly enabled in emission order, search from the tail */
+	list_for_each_prev(pos, &fence_drv->signal_list) {
+		if (list_entry(pos, struct radeon_fence, signal_link)->seq <
+		    fence->seq)
+			break;
+	}
+	list_add(&fence->signal_link, pos);
 	fence_get(f);
 
 	FENCE_TRACE(&fence->base, "armed on ring %i!\n", fence->ring);
@@ -744,7 +780,7 @@ bool radeon_fence_need_sync(struct radeon_fence *fence, int dst_ring)
 		return false;
 	}
 
-	/* we are protected by the ring mutex */
+	/* sync_seq of dst_ring is protected by its ring mutex */
 	fdrv = &fence->rdev->fence_drv[dst_ring];
 	if (fence->seq <= fdrv->sync_seq[fence->ring]) {
 		return false;
@@ -775,7 +811,9 @@ void radeon_fence_note_sync(struct radeon_fence *fence, int dst_ring)
 		return;
 	}
 
-	/* we are protected by the ring mutex */
+	/* the ring mutexes of both the source and the destination ring
+	 * must be held, the source's sync_seq may not move past the
+	 * signal semaphore */
 	src = &fence->rdev->fence_drv[fence->ring];
 	dst = &fence->rdev->fence_drv[dst_ring];
 	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
@@ -862,6 +900,11 @@ static void radeon_fence_driver_init_ring(struct radeon_device *rdev, int ring)
 	INIT_DELAYED_WORK(&rdev->fence_drv[ring].lockup_work,
 			  radeon_fence_check_lockup);
 	rdev->fence_drv[ring].rdev = rdev;
+	spin_lock_init(&rdev->fence_drv[ring].lock);
+	INIT_LIST_HEAD(&rdev->fence_drv[ring].signal_list);
+	rdev->fence_drv[ring].signal_runs = 0;
+	rdev->fence_drv[ring].signal_callbacks = 0;
+	rdev->fence_drv[ring].signal_max = 0;
 }
 
 /**
@@ -902,7 +945,7 @@ void radeon_fence_driver_fini(struct radeon_device *rdev)
 {
 	int ring, r;
 
-	mutex_lock(&rdev->ring_lock);
+	radeon_ring_lock_all(rdev);
 	for (ring = 0; ring < RADEON_NUM_RINGS; ring++) {
 		if (!rdev->fence_drv[ring].initialized)
 			continue;
@@ -912,11 +955,12 @@ void radeon_fence_driver_fini(struct radeon_device *rdev)
 			radeon_fence_driver_force_completion(rdev, ring);
 		}
 		cancel_delayed_work_sync(&rdev->fence_drv[ring].lockup_work);
+		radeon_fence_process(rdev, ring);
 		wake_up_all(&rdev->fence_queue);
 		radeon_scratch_free(rdev, rdev->fence_drv[ring].scratch_reg);
 		rdev->fence_drv[ring].initialized = false;
 	}
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_unlock_all(rdev);
 }
 
 /**
@@ -959,6 +1003,10 @@ static int radeon_debugfs_fence_info(struct seq_file *m, void *data)
 			   (unsigned long long)atomic64_read(&rdev->fence_drv[i].last_seq));
 		seq_printf(m, "Last emitted        0x%016llx\n",
 			   rdev->fence_drv[i].sync_seq[i]);
+		seq_printf(m, "Signal passes %lu, callbacks %lu, max per pass %u\n",
+			   rdev->fence_drv[i].signal_runs,
+			   rdev->fence_drv[i].signal_callbacks,
+			   rdev->fence_drv[i].signal_max);
 
 		for (j = 0; j < RADEON_NUM_RINGS; ++j) {
 			if (i != j && rdev->fence_drv[j].initialized)
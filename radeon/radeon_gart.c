@@ -29,6 +29,8 @@
 #include <drm/radeon_drm.h>
 #include "radeon.h"
 
+static int radeon_debugfs_gart_init(struct radeon_device *rdev);
+
 /*
  * GART
  * The GART (Graphics Aperture Remapping Table) is an aperture
@@ -225,6 +227,64 @@ void radeon_gart_table_vram_free(struct radeon_device *rdev)
 /*
  * Common gart functions.
  */
+/**
+ * radeon_gart_write_range - write entries to the gart page table
+ *
+ * @rdev: radeon_device pointer
+ * @start: first GPU page to write
+ * @end: last GPU page to write, exclusive
+ *
+ * Copies the range of pages_entry to the page table, if it is
+ * mapped, and marks the TLB for flushing (all asics).
+ */
+static void radeon_gart_write_range(struct radeon_device *rdev,
+				    unsigned start, unsigned end)
+{
+	unsigned t;
+
+	if (start == end)
+		return;
+
+	if (rdev->gart.ptr) {
+		for (t = start; t < end; t++)
+			radeon_gart_set_page(rdev, t, rdev->gart.pages_entry[t]);
+	}
+	mb();
+
+	spin_lock(&rdev->gart.tlb_lock);
+	rdev->gart.tlb_dirty = true;
+	rdev->gart.stats.pte_writes += end - start;
+	spin_unlock(&rdev->gart.tlb_lock);
+}
+
+/**
+ * radeon_gart_tlb_sync - flush the gart TLB if entries changed
+ *
+ * @rdev: radeon_device pointer
+ *
+ * Binding and unbinding only update the page table, the TLB is
+ * flushed here once for all of them before the GPU can use the new
+ * entries: when commands are submitted or a bo is pinned (all asics).
+ */
+void radeon_gart_tlb_sync(struct radeon_device *rdev)
+{
+	/* Every ring commit lands here, don't serialize them on tlb_lock
+	 * when nothing changed. A bind the commands depend on was ordered
+	 * before the submission by the locks of the bo, so its update of
+	 * tlb_dirty is visible.
+	 */
+	if (!READ_ONCE(rdev->gart.tlb_dirty))
+		return;
+
+	spin_lock(&rdev->gart.tlb_lock);
+	if (rdev->gart.tlb_dirty) {
+		rdev->gart.tlb_dirty = false;
+		rdev->gart.stats.flushes++;
+		radeon_gart_tlb_flush(rdev);
+	}
+	spin_unlock(&rdev->gart.tlb_lock);
+}
+
 /**
  * radeon_gart_unbind - unbind pages from the gart page table
  *
@@ -238,7 +298,7 @@ void radeon_gart_table_vram_free(struct radeon_device *rdev)
 void radeon_gart_unbind(struct radeon_device *rdev, unsigned offset,
 			int pages)
 {
-	unsigned t;
+	unsigned t, start;
 	unsigned p;
 	int i, j;
 
@@ -248,20 +308,25 @@ void radeon_gart_unbind(struct radeon_device *rdev, unsigned offset,
 	}
 	t = offset / RADEON_GPU_PAGE_SIZE;
 	p = t / (PAGE_SIZE / RADEON_GPU_PAGE_SIZE);
+	start = t;
 	for (i = 0; i < pages; i++, p++) {
 		if (rdev->gart.pages[p]) {
 			rdev->gart.pages[p] = NULL;
 			for (j = 0; j < (PAGE_SIZE / RADEON_GPU_PAGE_SIZE); j++, t++) {
 				rdev->gart.pages_entry[t] = rdev->dummy_page.entry;
-				if (rdev->gart.ptr) {
-					radeon_gart_set_page(rdev, t,
-							     rdev->dummy_page.entry);
-				}
 			}
+		} else {
+			/* write out the bound run in one go */
+			radeon_gart_write_range(rdev, start, t);
+			t += PAGE_SIZE / RADEON_GPU_PAGE_SIZE;
+			start = t;
 		}
 	}
-	mb();
-	radeon_gart_tlb_flush(rdev);
+	radeon_gart_write_range(rdev, start, t);
+
+	spin_lock(&rdev->gart.tlb_lock);
+	rdev->gart.stats.unbinds++;
+	spin_unlock(&rdev->gart.tlb_lock);
 }
 
 /**
@@ -282,9 +347,9 @@ int radeon_gart_bind(struct radeon_device *rdev, unsigned offset,
 		     int pages, struct page **pagelist, dma_addr_t *dma_addr,
 		     uint32_t flags)
 {
-	unsigned t;
+	unsigned t, start;
 	unsigned p;
-	uint64_t page_base, page_entry;
+	uint64_t page_base;
 	int i, j;
 
 	if (!rdev->gart.ready) {
@@ -293,21 +358,22 @@ int radeon_gart_bind(struct radeon_device *rdev, unsigned offset,
 	}
 	t = offset / RADEON_GPU_PAGE_SIZE;
 	p = t / (PAGE_SIZE / RADEON_GPU_PAGE_SIZE);
+	start = t;
 
 	for (i = 0; i < pages; i++, p++) {
 		rdev->gart.pages[p] = pagelist[i];
 		page_base = dma_addr[i];
 		for (j = 0; j < (PAGE_SIZE / RADEON_GPU_PAGE_SIZE); j++, t++) {
-			page_entry = radeon_gart_get_page_entry(page_base, flags);
-			rdev->gart.pages_entry[t] = page_entry;
-			if (rdev->gart.ptr) {
-				radeon_gart_set_page(rdev, t, page_entry);
-			}
+			rdev->gart.pages_entry[t] =
+				radeon_gart_get_page_entry(page_base, flags);
 			page_base += RADEON_GPU_PAGE_SIZE;
 		}
 	}
-	mb();
-	radeon_gart_tlb_flush(rdev);
+	radeon_gart_write_range(rdev, start, t);
+
+	spin_lock(&rdev->gart.tlb_lock);
+	rdev->gart.stats.binds++;
+	spin_unlock(&rdev->gart.tlb_lock);
 	return 0;
 }
 
@@ -354,6 +420,11 @@ int radeon_gart_init(struct radeon_device *rdev)
 	/* set GART entry to point to the dummy page by default */
 	for (i = 0; i < rdev->gart.num_gpu_pages; i++)
 		rdev->gart.pages_entry[i] = rdev->dummy_page.entry;
+
+	rdev->gart.stats.sample_jiffies = jiffies;
+	if (radeon_debugfs_gart_init(rdev)) {
+		dev_err(rdev->dev, "gart debugfs file creation failed\n");
+	}
 	return 0;
 }
 
@@ -378,3 +449,55 @@ void radeon_gart_fini(struct radeon_device *rdev)
 
 	radeon_dummy_page_fini(rdev);
 }
+
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int radeon_debugfs_gart_stats(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct radeon_device *rdev = dev->dev_private;
+	u64 pte_writes, binds, unbinds, flushes, pte_rate, flush_rate;
+	unsigned long now, elapsed;
+
+	spin_lock(&rdev->gart.tlb_lock);
+	pte_writes = rdev->gart.stats.pte_writes;
+	binds = rdev->gart.stats.binds;
+	unbinds = rdev->gart.stats.unbinds;
+	flushes = rdev->gart.stats.flushes;
+
+	/* rates since the last time the file was read */
+	now = jiffies;
+	elapsed = max(now - rdev->gart.stats.sample_jiffies, 1UL);
+	pte_rate = div_u64((pte_writes - rdev->gart.stats.sample_pte_writes) * HZ,
+			   elapsed);
+	flush_rate = div_u64((flushes - rdev->gart.stats.sample_flushes) * HZ,
+			     elapsed);
+	rdev->gart.stats.sample_jiffies = now;
+	rdev->gart.stats.sample_pte_writes = pte_writes;
+	rdev->gart.stats.sample_flushes = flushes;
+	spin_unlock(&rdev->gart.tlb_lock);
+
+	seq_printf(m, "binds: %llu, unbinds: %llu\n", binds, unbinds);
+	seq_printf(m, "pte writes: %llu (%llu/s)\n", pte_writes, pte_rate);
+	seq_printf(m, "tlb flushes: %llu (%llu/s)\n", flushes, flush_rate);
+	return 0;
+}
+
+static struct drm_info_list radeon_debugfs_gart_list[] = {
+	{"radeon_gart_stats", &radeon_debugfs_gart_stats, 0, NULL},
+};
+
+#endif
+
+static int radeon_debugfs_gart_init(struct radeon_device *rdev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return radeon_debugfs_add_files(rdev, radeon_debugfs_gart_list, 1);
+#else
+	return 0;
+#endif
+}
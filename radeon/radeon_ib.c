@@ -138,7 +138,7 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 		return r;
 	}
 
-	/* grab a vm id if necessary */
+	/* grab a vm id if necessary, it stays reserved until the fence */
 	if (ib->vm) {
 		struct radeon_fence *vm_id_fence;
 		vm_id_fence = radeon_vm_grab_id(rdev, ib->vm, ib->ring);
@@ -150,7 +150,7 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 	if (r) {
 		dev_err(rdev->dev, "failed to sync rings (%d)\n", r);
 		radeon_ring_unlock_undo(rdev, ring);
-		return r;
+		goto err_vm;
 	}
 
 	if (ib->vm)
@@ -166,7 +166,7 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 	if (r) {
 		dev_err(rdev->dev, "failed to emit fence for new IB (%d)\n", r);
 		radeon_ring_unlock_undo(rdev, ring);
-		return r;
+		goto err_vm;
 	}
 	if (const_ib) {
 		const_ib->fence = radeon_fence_ref(ib->fence);
@@ -177,6 +177,11 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 
 	radeon_ring_unlock_commit(rdev, ring, hdp_flush);
 	return 0;
+
+err_vm:
+	if (ib->vm)
+		radeon_vm_put_id(rdev, ib->vm, ib->ring);
+	return r;
 }
 
 /**
@@ -361,6 +361,9 @@ int radeon_bo_pin_restricted(struct radeon_bo *bo, u32 domain, u64 max_offset,
 			bo->rdev->vram_pin_size += radeon_bo_size(bo);
 		else
 			bo->rdev->gart_pin_size += radeon_bo_size(bo);
+		/* pinned bos can be accessed by the GPU without any
+		 * submission, e.g. writeback or the IH ring */
+		radeon_gart_tlb_sync(bo->rdev);
 	} else {
 		dev_err(bo->rdev->dev, "%p pin failed\n", bo);
 	}
@@ -172,6 +172,8 @@ static inline void * radeon_sa_bo_cpu_addr(struct radeon_sa_bo *sa_bo)
 	return sa_bo->manager->cpu_ptr + sa_bo->soffset;
 }
 
+extern int radeon_sa_init(void);
+extern void radeon_sa_fini(void);
 extern int radeon_sa_bo_manager_init(struct radeon_device *rdev,
 				     struct radeon_sa_manager *sa_manager,
 				     unsigned size, u32 align, u32 domain,
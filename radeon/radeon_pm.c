@@ -254,7 +254,7 @@ static void radeon_pm_set_clocks(struct radeon_device *rdev)
 
 	mutex_lock(&rdev->ddev->struct_mutex);
 	down_write(&rdev->pm.mclk_lock);
-	mutex_lock(&rdev->ring_lock);
+	radeon_ring_lock_all(rdev);
 
 	/* wait for the rings to drain */
 	for (i = 0; i < RADEON_NUM_RINGS; i++) {
@@ -265,7 +265,7 @@ static void radeon_pm_set_clocks(struct radeon_device *rdev)
 		r = radeon_fence_wait_empty(rdev, i);
 		if (r) {
 			/* needs a GPU reset dont reset here */
-			mutex_unlock(&rdev->ring_lock);
+			radeon_ring_unlock_all(rdev);
 			up_write(&rdev->pm.mclk_lock);
 			mutex_unlock(&rdev->ddev->struct_mutex);
 			return;
@@ -301,7 +301,7 @@ static void radeon_pm_set_clocks(struct radeon_device *rdev)
 
 	rdev->pm.dynpm_planned_action = DYNPM_ACTION_NONE;
 
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_unlock_all(rdev);
 	up_write(&rdev->pm.mclk_lock);
 	mutex_unlock(&rdev->ddev->struct_mutex);
 }
@@ -914,7 +914,7 @@ force:
 
 	mutex_lock(&rdev->ddev->struct_mutex);
 	down_write(&rdev->pm.mclk_lock);
-	mutex_lock(&rdev->ring_lock);
+	radeon_ring_lock_all(rdev);
 
 	/* update whether vce is active */
 	ps->vce_active = rdev->pm.dpm.vce_active;
@@ -960,7 +960,7 @@ force:
 	}
 
 done:
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_unlock_all(rdev);
 	up_write(&rdev->pm.mclk_lock);
 	mutex_unlock(&rdev->ddev->struct_mutex);
 }
@@ -126,6 +126,92 @@ int radeon_ring_alloc(struct radeon_device *rdev, struct radeon_ring *ring, unsi
 	return 0;
 }
 
+/**
+ * radeon_ring_mutex_lock - take the submission lock of a ring
+ *
+ * @ring: radeon_ring structure holding ring information
+ *
+ * Take the ring's submission lock, accounting contention and wait
+ * time. When several rings are needed they must be locked in
+ * ascending index order, lower rings may only be trylocked.
+ */
+void radeon_ring_mutex_lock(struct radeon_ring *ring)
+{
+	if (!mutex_trylock(&ring->mutex)) {
+		u64 start = ktime_get_raw_ns();
+
+		/* each ring is its own lockdep subclass for lock_all */
+		mutex_lock_nested(&ring->mutex, ring->idx);
+		ring->lock_stats.contended++;
+		ring->lock_stats.wait_ns += ktime_get_raw_ns() - start;
+	}
+	ring->lock_stats.acquired++;
+	ring->lock_stats.locked_at = ktime_get_raw_ns();
+}
+
+/**
+ * radeon_ring_mutex_trylock - try to take the submission lock of a ring
+ *
+ * @ring: radeon_ring structure holding ring information
+ *
+ * Returns true if the lock was taken.
+ */
+bool radeon_ring_mutex_trylock(struct radeon_ring *ring)
+{
+	if (!mutex_trylock(&ring->mutex)) {
+		/* we don't hold the lock, so this can't go in the plain stats */
+		atomic_inc(&ring->lock_stats.trylock_failed);
+		return false;
+	}
+	ring->lock_stats.acquired++;
+	ring->lock_stats.locked_at = ktime_get_raw_ns();
+	return true;
+}
+
+/**
+ * radeon_ring_mutex_unlock - drop the submission lock of a ring
+ *
+ * @ring: radeon_ring structure holding ring information
+ */
+void radeon_ring_mutex_unlock(struct radeon_ring *ring)
+{
+	u64 held = ktime_get_raw_ns() - ring->lock_stats.locked_at;
+
+	ring->lock_stats.hold_ns += held;
+	if (held > ring->lock_stats.max_hold_ns)
+		ring->lock_stats.max_hold_ns = held;
+	mutex_unlock(&ring->mutex);
+}
+
+/**
+ * radeon_ring_lock_all - lock all rings
+ *
+ * @rdev: radeon_device pointer
+ *
+ * Take the submission lock of every ring, in index order, to
+ * stop all command submission (all asics).
+ */
+void radeon_ring_lock_all(struct radeon_device *rdev)
+{
+	int i;
+
+	for (i = 0; i < RADEON_NUM_RINGS; i++)
+		radeon_ring_mutex_lock(&rdev->ring[i]);
+}
+
+/**
+ * radeon_ring_unlock_all - unlock all rings
+ *
+ * @rdev: radeon_device pointer
+ */
+void radeon_ring_unlock_all(struct radeon_device *rdev)
+{
+	int i;
+
+	for (i = RADEON_NUM_RINGS - 1; i >= 0; i--)
+		radeon_ring_mutex_unlock(&rdev->ring[i]);
+}
+
 /**
  * radeon_ring_lock - lock the ring and allocate space on it
  *
@@ -141,10 +227,10 @@ int radeon_ring_lock(struct radeon_device *rdev, struct radeon_ring *ring, unsig
 {
 	int r;
 
-	mutex_lock(&rdev->ring_lock);
+	radeon_ring_mutex_lock(ring);
 	r = radeon_ring_alloc(rdev, ring, ndw);
 	if (r) {
-		mutex_unlock(&rdev->ring_lock);
+		radeon_ring_mutex_unlock(ring);
 		return r;
 	}
 	return 0;
@@ -179,6 +265,8 @@ void radeon_ring_commit(struct radeon_device *rdev, struct radeon_ring *ring,
 	 */
 	if (hdp_flush && rdev->asic->mmio_hdp_flush)
 		rdev->asic->mmio_hdp_flush(rdev);
+	/* the commands may use pages bound since the last flush */
+	radeon_gart_tlb_sync(rdev);
 	radeon_ring_set_wptr(rdev, ring);
 }
 
@@ -196,7 +284,7 @@ void radeon_ring_unlock_commit(struct radeon_device *rdev, struct radeon_ring *r
 			       bool hdp_flush)
 {
 	radeon_ring_commit(rdev, ring, hdp_flush);
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_mutex_unlock(ring);
 }
 
 /**
@@ -221,7 +309,7 @@ void radeon_ring_undo(struct radeon_ring *ring)
 void radeon_ring_unlock_undo(struct radeon_device *rdev, struct radeon_ring *ring)
 {
 	radeon_ring_undo(ring);
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_mutex_unlock(ring);
 }
 
 /**
@@ -280,17 +368,17 @@ unsigned radeon_ring_backup(struct radeon_device *rdev, struct radeon_ring *ring
 	unsigned size, ptr, i;
 
 	/* just in case lock the ring */
-	mutex_lock(&rdev->ring_lock);
+	radeon_ring_mutex_lock(ring);
 	*data = NULL;
 
 	if (ring->ring_obj == NULL) {
-		mutex_unlock(&rdev->ring_lock);
+		radeon_ring_mutex_unlock(ring);
 		return 0;
 	}
 
 	/* it doesn't make sense to save anything if all fences are signaled */
 	if (!radeon_fence_count_emitted(rdev, ring->idx)) {
-		mutex_unlock(&rdev->ring_lock);
+		radeon_ring_mutex_unlock(ring);
 		return 0;
 	}
 
@@ -301,7 +389,7 @@ unsigned radeon_ring_backup(struct radeon_device *rdev, struct radeon_ring *ring
 		ptr = le32_to_cpu(*ring->next_rptr_cpu_addr);
 	else {
 		/* no way to read back the next rptr */
-		mutex_unlock(&rdev->ring_lock);
+		radeon_ring_mutex_unlock(ring);
 		return 0;
 	}
 
@@ -309,14 +397,14 @@ unsigned radeon_ring_backup(struct radeon_device *rdev, struct radeon_ring *ring
 	size -= ptr;
 	size &= ring->ptr_mask;
 	if (size == 0) {
-		mutex_unlock(&rdev->ring_lock);
+		radeon_ring_mutex_unlock(ring);
 		return 0;
 	}
 
 	/* and then save the content of the ring */
 	*data = drm_malloc_ab(size, sizeof(uint32_t));
 	if (!*data) {
-		mutex_unlock(&rdev->ring_lock);
+		radeon_ring_mutex_unlock(ring);
 		return 0;
 	}
 	for (i = 0; i < size; ++i) {
@@ -324,7 +412,7 @@ unsigned radeon_ring_backup(struct radeon_device *rdev, struct radeon_ring *ring
 		ptr &= ring->ptr_mask;
 	}
 
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_mutex_unlock(ring);
 	return size;
 }
 
@@ -434,12 +522,12 @@ void radeon_ring_fini(struct radeon_device *rdev, struct radeon_ring *ring)
 	int r;
 	struct radeon_bo *ring_obj;
 
-	mutex_lock(&rdev->ring_lock);
+	radeon_ring_mutex_lock(ring);
 	ring_obj = ring->ring_obj;
 	ring->ready = false;
 	ring->ring = NULL;
 	ring->ring_obj = NULL;
-	mutex_unlock(&rdev->ring_lock);
+	radeon_ring_mutex_unlock(ring);
 
 	if (ring_obj) {
 		r = radeon_bo_reserve(ring_obj, false);
@@ -494,6 +582,12 @@ static int radeon_debugfs_ring_info(struct seq_file *m, void *data)
 		   ring->last_semaphore_wait_addr);
 	seq_printf(m, "%u free dwords in ring\n", ring->ring_free_dw);
 	seq_printf(m, "%u dwords in ring\n", count);
+	seq_printf(m, "lock: %lu acquired, %lu contended, %d trylock failed, "
+		   "%llu ns waited, %llu ns held, %llu ns max held\n",
+		   ring->lock_stats.acquired, ring->lock_stats.contended,
+		   atomic_read(&ring->lock_stats.trylock_failed),
+		   ring->lock_stats.wait_ns, ring->lock_stats.hold_ns,
+		   ring->lock_stats.max_hold_ns);
 
 	if (!ring->ready)
 		return 0;
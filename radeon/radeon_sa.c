@@ -34,18 +34,48 @@
  * progression was is after last is the oldest bo we allocated and thus
  * the first one that should no longer be in use by the GPU.
  *
- * If it's not the case we skip over the bo after last to the closest
- * done bo if such one exist. If none exist and we are not asked to
- * block we report failure to allocate.
+ * A bo freed with a pending fence installs a callback on that fence and
+ * is removed from the callback as soon as the fence signals, so nothing
+ * polls the fences to reclaim space. Since the gaps left behind are not
+ * necessarily next to the hole, we walk forward over the allocations
+ * still in use to the next gap big enough, on any ring.
  *
- * If we are asked to block we wait on all the oldest fence of all
+ * If there is no such gap we wait on all the oldest fence of all
  * rings. We just wait for any of those fence to complete.
  */
 #include <drm/drmP.h>
 #include "radeon.h"
 
+static struct kmem_cache *radeon_sa_bo_cache;
+
 static void radeon_sa_bo_remove_locked(struct radeon_sa_bo *sa_bo);
-static void radeon_sa_bo_try_free(struct radeon_sa_manager *sa_manager);
+
+/**
+ * radeon_sa_init - create the sub-allocation slab cache
+ *
+ * Creates the slab cache the radeon_sa_bo tracking structures are
+ * allocated from, shared between all devices (all asics).
+ * Returns 0 on success, -ENOMEM on failure.
+ */
+int radeon_sa_init(void)
+{
+	radeon_sa_bo_cache = kmem_cache_create("radeon_sa_bo",
+					       sizeof(struct radeon_sa_bo),
+					       0, SLAB_HWCACHE_ALIGN, NULL);
+	if (!radeon_sa_bo_cache)
+		return -ENOMEM;
+	return 0;
+}
+
+/**
+ * radeon_sa_fini - destroy the sub-allocation slab cache
+ *
+ * Destroys the slab cache created by radeon_sa_init (all asics).
+ */
+void radeon_sa_fini(void)
+{
+	kmem_cache_destroy(radeon_sa_bo_cache);
+}
 
 int radeon_sa_bo_manager_init(struct radeon_device *rdev,
 			      struct radeon_sa_manager *sa_manager,
@@ -58,6 +88,7 @@ int radeon_sa_bo_manager_init(struct radeon_device *rdev,
 	sa_manager->size = size;
 	sa_manager->domain = domain;
 	sa_manager->align = align;
+	sa_manager->frees = 0;
 	sa_manager->hole = &sa_manager->olist;
 	INIT_LIST_HEAD(&sa_manager->olist);
 	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
@@ -78,17 +109,37 @@ void radeon_sa_bo_manager_fini(struct radeon_device *rdev,
 			       struct radeon_sa_manager *sa_manager)
 {
 	struct radeon_sa_bo *sa_bo, *tmp;
+	int i;
 
 	if (!list_empty(&sa_manager->olist)) {
-		sa_manager->hole = &sa_manager->olist,
-		radeon_sa_bo_try_free(sa_manager);
-		if (!list_empty(&sa_manager->olist)) {
-			dev_err(rdev->dev, "sa_manager is not empty, clearing anyway\n");
-		}
+		dev_err(rdev->dev, "sa_manager is not empty, clearing anyway\n");
+	}
+
+	/* The fence driver is still running here, so the callbacks of
+	 * pending frees can fire concurrently and must be detached before
+	 * the lists are torn down. The callback frees the sa_bo, which
+	 * rules out fence_remove_callback() on an entry we don't hold the
+	 * fence lock for; instead hold each ring's fence lock, so none of
+	 * its callbacks can run, and unhook them by hand. Nothing adds to
+	 * flist any more, so an empty list stays empty.
+	 */
+	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
+		if (list_empty(&sa_manager->flist[i]))
+			continue;
+
+		spin_lock_irq(&rdev->fence_drv[i].lock);
+		spin_lock(&sa_manager->wq.lock);
+		list_for_each_entry(sa_bo, &sa_manager->flist[i], flist)
+			list_del_init(&sa_bo->cb.node);
+		spin_unlock(&sa_manager->wq.lock);
+		spin_unlock_irq(&rdev->fence_drv[i].lock);
 	}
+
+	spin_lock_irq(&sa_manager->wq.lock);
 	list_for_each_entry_safe(sa_bo, tmp, &sa_manager->olist, olist) {
 		radeon_sa_bo_remove_locked(sa_bo);
 	}
+	spin_unlock_irq(&sa_manager->wq.lock);
 	radeon_bo_unref(&sa_manager->bo);
 	sa_manager->size = 0;
 }
@@ -148,23 +199,30 @@ static void radeon_sa_bo_remove_locked(struct radeon_sa_bo *sa_bo)
 	list_del_init(&sa_bo->olist);
 	list_del_init(&sa_bo->flist);
 	radeon_fence_unref(&sa_bo->fence);
-	kfree(sa_bo);
+	kmem_cache_free(radeon_sa_bo_cache, sa_bo);
+	sa_manager->frees++;
 }
 
-static void radeon_sa_bo_try_free(struct radeon_sa_manager *sa_manager)
+/**
+ * radeon_sa_bo_fence_cb - reclaim a sub-allocation
+ *
+ * @f: fence the sub-allocation was protected by
+ * @cb: fence callback embedded in the sub-allocation
+ *
+ * Called when the fence of a freed sub-allocation signals, possibly
+ * from interrupt context with the fence lock held. Removes the
+ * sub-allocation and wakes up everybody waiting for space.
+ */
+static void radeon_sa_bo_fence_cb(struct fence *f, struct fence_cb *cb)
 {
-	struct radeon_sa_bo *sa_bo, *tmp;
-
-	if (sa_manager->hole->next == &sa_manager->olist)
-		return;
+	struct radeon_sa_bo *sa_bo = container_of(cb, struct radeon_sa_bo, cb);
+	struct radeon_sa_manager *sa_manager = sa_bo->manager;
+	unsigned long irqflags;
 
-	sa_bo = list_entry(sa_manager->hole->next, struct radeon_sa_bo, olist);
-	list_for_each_entry_safe_from(sa_bo, tmp, &sa_manager->olist, olist) {
-		if (sa_bo->fence == NULL || !radeon_fence_signaled(sa_bo->fence)) {
-			return;
-		}
-		radeon_sa_bo_remove_locked(sa_bo);
-	}
+	spin_lock_irqsave(&sa_manager->wq.lock, irqflags);
+	radeon_sa_bo_remove_locked(sa_bo);
+	wake_up_all_locked(&sa_manager->wq);
+	spin_unlock_irqrestore(&sa_manager->wq.lock, irqflags);
 }
 
 static inline unsigned radeon_sa_bo_hole_soffset(struct radeon_sa_manager *sa_manager)
@@ -215,16 +273,14 @@ static bool radeon_sa_bo_try_alloc(struct radeon_sa_manager *sa_manager,
  * radeon_sa_event - Check if we can stop waiting
  *
  * @sa_manager: pointer to the sa_manager
- * @size: number of bytes we want to allocate
- * @align: alignment we need to match
+ * @frees: number of removed sub-allocations when we started waiting
  *
  * Check if either there is a fence we can wait for or
- * enough free memory to satisfy the allocation directly
+ * some memory was released since we last looked
  */
 static bool radeon_sa_event(struct radeon_sa_manager *sa_manager,
-			    unsigned size, unsigned align)
+			    unsigned long frees)
 {
-	unsigned soffset, eoffset, wasted;
 	int i;
 
 	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
@@ -233,80 +289,58 @@ static bool radeon_sa_event(struct radeon_sa_manager *sa_manager,
 		}
 	}
 
-	soffset = radeon_sa_bo_hole_soffset(sa_manager);
-	eoffset = radeon_sa_bo_hole_eoffset(sa_manager);
-	wasted = (align - (soffset % align)) % align;
-
-	if ((eoffset - soffset) >= (size + wasted)) {
-		return true;
-	}
-
-	return false;
+	return sa_manager->frees != frees;
 }
 
+/**
+ * radeon_sa_bo_next_hole - skip to the next hole
+ *
+ * @sa_manager: pointer to the sa_manager
+ * @start: hole the search started from
+ *
+ * Moves the hole behind the next allocation, wrapping around at the
+ * end of the buffer. Allocations still in use are skipped whatever
+ * ring they belong to, so a slow fence doesn't hide the space
+ * released behind it. Returns false once we are back at @start.
+ */
 static bool radeon_sa_bo_next_hole(struct radeon_sa_manager *sa_manager,
-				   struct radeon_fence **fences,
-				   unsigned *tries)
+				   struct list_head *start)
 {
-	struct radeon_sa_bo *best_bo = NULL;
-	unsigned i, soffset, best, tmp;
-
 	/* if hole points to the end of the buffer */
 	if (sa_manager->hole->next == &sa_manager->olist) {
 		/* try again with its beginning */
 		sa_manager->hole = &sa_manager->olist;
-		return true;
+	} else {
+		sa_manager->hole = sa_manager->hole->next;
 	}
+	return sa_manager->hole != start;
+}
 
-	soffset = radeon_sa_bo_hole_soffset(sa_manager);
-	/* to handle wrap around we add sa_manager->size */
-	best = sa_manager->size * 2;
-	/* go over all fence list and try to find the closest sa_bo
-	 * of the current last
-	 */
-	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
-		struct radeon_sa_bo *sa_bo;
+/**
+ * radeon_sa_bo_oldest_fences - get the oldest pending fence of each ring
+ *
+ * @sa_manager: pointer to the sa_manager
+ * @fences: array of RADEON_NUM_RINGS fences to fill
+ *
+ * Takes a reference to the oldest fence protecting a freed
+ * sub-allocation on each ring, so they can be waited on
+ * after dropping the lock.
+ */
+static void radeon_sa_bo_oldest_fences(struct radeon_sa_manager *sa_manager,
+				       struct radeon_fence **fences)
+{
+	struct radeon_sa_bo *sa_bo;
+	int i;
 
+	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
+		fences[i] = NULL;
 		if (list_empty(&sa_manager->flist[i])) {
 			continue;
 		}
-
 		sa_bo = list_first_entry(&sa_manager->flist[i],
 					 struct radeon_sa_bo, flist);
-
-		if (!radeon_fence_signaled(sa_bo->fence)) {
-			fences[i] = sa_bo->fence;
-			continue;
-		}
-
-		/* limit the number of tries each ring gets */
-		if (tries[i] > 2) {
-			continue;
-		}
-
-		tmp = sa_bo->soffset;
-		if (tmp < soffset) {
-			/* wrap around, pretend it's after */
-			tmp += sa_manager->size;
-		}
-		tmp -= soffset;
-		if (tmp < best) {
-			/* this sa bo is the closest one */
-			best = tmp;
-			best_bo = sa_bo;
-		}
-	}
-
-	if (best_bo) {
-		++tries[best_bo->fence->ring];
-		sa_manager->hole = best_bo->olist.prev;
-
-		/* we knew that this one is signaled,
-		   so it's save to remote it */
-		radeon_sa_bo_remove_locked(best_bo);
-		return true;
+		fences[i] = radeon_fence_ref(sa_bo->fence);
 	}
-	return false;
 }
 
 int radeon_sa_bo_new(struct radeon_device *rdev,
@@ -315,13 +349,14 @@ int radeon_sa_bo_new(struct radeon_device *rdev,
 		     unsigned size, unsigned align)
 {
 	struct radeon_fence *fences[RADEON_NUM_RINGS];
-	unsigned tries[RADEON_NUM_RINGS];
+	struct list_head *start;
+	unsigned long frees;
 	int i, r;
 
 	BUG_ON(align > sa_manager->align);
 	BUG_ON(size > sa_manager->size);
 
-	*sa_bo = kmalloc(sizeof(struct radeon_sa_bo), GFP_KERNEL);
+	*sa_bo = kmem_cache_alloc(radeon_sa_bo_cache, GFP_KERNEL);
 	if ((*sa_bo) == NULL) {
 		return -ENOMEM;
 	}
@@ -330,40 +365,40 @@ int radeon_sa_bo_new(struct radeon_device *rdev,
 	INIT_LIST_HEAD(&(*sa_bo)->olist);
 	INIT_LIST_HEAD(&(*sa_bo)->flist);
 
-	spin_lock(&sa_manager->wq.lock);
+	spin_lock_irq(&sa_manager->wq.lock);
 	do {
-		for (i = 0; i < RADEON_NUM_RINGS; ++i) {
-			fences[i] = NULL;
-			tries[i] = 0;
-		}
+		start = sa_manager->hole;
+		frees = sa_manager->frees;
 
 		do {
-			radeon_sa_bo_try_free(sa_manager);
-
 			if (radeon_sa_bo_try_alloc(sa_manager, *sa_bo,
 						   size, align)) {
-				spin_unlock(&sa_manager->wq.lock);
+				spin_unlock_irq(&sa_manager->wq.lock);
 				return 0;
 			}
 
 			/* see if we can skip over some allocations */
-		} while (radeon_sa_bo_next_hole(sa_manager, fences, tries));
+		} while (radeon_sa_bo_next_hole(sa_manager, start));
 
-		spin_unlock(&sa_manager->wq.lock);
+		radeon_sa_bo_oldest_fences(sa_manager, fences);
+		spin_unlock_irq(&sa_manager->wq.lock);
 		r = radeon_fence_wait_any(rdev, fences, false);
-		spin_lock(&sa_manager->wq.lock);
+		for (i = 0; i < RADEON_NUM_RINGS; ++i) {
+			radeon_fence_unref(&fences[i]);
+		}
+		spin_lock_irq(&sa_manager->wq.lock);
 		/* if we have nothing to wait for block */
 		if (r == -ENOENT) {
-			r = wait_event_interruptible_locked(
-				sa_manager->wq, 
-				radeon_sa_event(sa_manager, size, align)
+			r = wait_event_interruptible_locked_irq(
+				sa_manager->wq,
+				radeon_sa_event(sa_manager, frees)
 			);
 		}
 
 	} while (!r);
 
-	spin_unlock(&sa_manager->wq.lock);
-	kfree(*sa_bo);
+	spin_unlock_irq(&sa_manager->wq.lock);
+	kmem_cache_free(radeon_sa_bo_cache, *sa_bo);
 	*sa_bo = NULL;
 	return r;
 }
@@ -378,16 +413,25 @@ void radeon_sa_bo_free(struct radeon_device *rdev, struct radeon_sa_bo **sa_bo,
 	}
 
 	sa_manager = (*sa_bo)->manager;
-	spin_lock(&sa_manager->wq.lock);
 	if (fence && !radeon_fence_signaled(fence)) {
+		spin_lock_irq(&sa_manager->wq.lock);
 		(*sa_bo)->fence = radeon_fence_ref(fence);
 		list_add_tail(&(*sa_bo)->flist,
 			      &sa_manager->flist[fence->ring]);
+		wake_up_all_locked(&sa_manager->wq);
+		spin_unlock_irq(&sa_manager->wq.lock);
+
+		/* the callback takes the wq lock under the fence lock,
+		 * so it must be installed without holding the former */
+		if (fence_add_callback(&fence->base, &(*sa_bo)->cb,
+				       radeon_sa_bo_fence_cb))
+			radeon_sa_bo_fence_cb(&fence->base, &(*sa_bo)->cb);
 	} else {
+		spin_lock_irq(&sa_manager->wq.lock);
 		radeon_sa_bo_remove_locked(*sa_bo);
+		wake_up_all_locked(&sa_manager->wq);
+		spin_unlock_irq(&sa_manager->wq.lock);
 	}
-	wake_up_all_locked(&sa_manager->wq);
-	spin_unlock(&sa_manager->wq.lock);
 	*sa_bo = NULL;
 }
 
@@ -397,7 +441,7 @@ void radeon_sa_bo_dump_debug_info(struct radeon_sa_manager *sa_manager,
 {
 	struct radeon_sa_bo *i;
 
-	spin_lock(&sa_manager->wq.lock);
+	spin_lock_irq(&sa_manager->wq.lock);
 	list_for_each_entry(i, &sa_manager->olist, olist) {
 		uint64_t soffset = i->soffset + sa_manager->gpu_addr;
 		uint64_t eoffset = i->eoffset + sa_manager->gpu_addr;
@@ -414,6 +458,6 @@ void radeon_sa_bo_dump_debug_info(struct radeon_sa_manager *sa_manager,
 		}
 		seq_printf(m, "\n");
 	}
-	spin_unlock(&sa_manager->wq.lock);
+	spin_unlock_irq(&sa_manager->wq.lock);
 }
 #endif
@@ -133,6 +133,11 @@ int radeon_sync_resv(struct radeon_device *rdev,
  *
  * Ensure that all registered fences are signaled before letting
  * the ring continue. The caller must hold the ring lock.
+ *
+ * The signaling rings are locked while the semaphore is emitted on
+ * them. Ring locks are taken in ascending index order, so a ring
+ * below @ring can only be trylocked; if it is busy we wait for the
+ * fence on the CPU instead.
  */
 int radeon_sync_rings(struct radeon_device *rdev,
 		      struct radeon_sync *sync,
@@ -168,15 +173,27 @@ int radeon_sync_rings(struct radeon_device *rdev,
 
 		sync->semaphores[count++] = semaphore;
 
+		if (i > ring) {
+			radeon_ring_mutex_lock(&rdev->ring[i]);
+		} else if (!radeon_ring_mutex_trylock(&rdev->ring[i])) {
+			/* taking it could deadlock, wait manually */
+			r = radeon_fence_wait(fence, false);
+			if (r)
+				return r;
+			continue;
+		}
+
 		/* allocate enough space for sync command */
 		r = radeon_ring_alloc(rdev, &rdev->ring[i], 16);
-		if (r)
+		if (r) {
+			radeon_ring_mutex_unlock(&rdev->ring[i]);
 			return r;
+		}
 
 		/* emit the signal semaphore */
 		if (!radeon_semaphore_emit_signal(rdev, i, semaphore)) {
 			/* signaling wasn't successful wait manually */
-			radeon_ring_undo(&rdev->ring[i]);
+			radeon_ring_unlock_undo(rdev, &rdev->ring[i]);
 			r = radeon_fence_wait(fence, false);
 			if (r)
 				return r;
@@ -186,15 +203,16 @@ int radeon_sync_rings(struct radeon_device *rdev,
 		/* we assume caller has already allocated space on waiters ring */
 		if (!radeon_semaphore_emit_wait(rdev, ring, semaphore)) {
 			/* waiting wasn't successful wait manually */
-			radeon_ring_undo(&rdev->ring[i]);
+			radeon_ring_unlock_undo(rdev, &rdev->ring[i]);
 			r = radeon_fence_wait(fence, false);
 			if (r)
 				return r;
 			continue;
 		}
 
-		radeon_ring_commit(rdev, &rdev->ring[i], false);
+		/* before unlocking, later fences on ring i aren't covered */
 		radeon_fence_note_sync(fence, ring);
+		radeon_ring_unlock_commit(rdev, &rdev->ring[i], false);
 	}
 
 	return 0;
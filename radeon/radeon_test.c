@@ -572,3 +572,198 @@ void radeon_test_syncing(struct radeon_device *rdev)
 		}
 	}
 }
+
+#define RADEON_TEST_GART_PAGES 8
+
+/* Find RADEON_TEST_GART_PAGES unbound pages, from the end of the aperture */
+static int radeon_test_gart_window(struct radeon_device *rdev)
+{
+	unsigned n = 0;
+	int p;
+
+	for (p = rdev->gart.num_cpu_pages - 1; p >= 0; --p) {
+		if (rdev->gart.pages[p])
+			n = 0;
+		else if (++n == RADEON_TEST_GART_PAGES)
+			return p;
+	}
+	return -1;
+}
+
+/* Check pages_entry of the window, bit i of @bound set for bound page i */
+static int radeon_test_gart_check(struct radeon_device *rdev, unsigned first,
+				  unsigned bound, uint32_t flags)
+{
+	unsigned i, j, t;
+	uint64_t entry;
+
+	for (i = 0; i < RADEON_TEST_GART_PAGES; ++i) {
+		t = (first + i) * (PAGE_SIZE / RADEON_GPU_PAGE_SIZE);
+		for (j = 0; j < (PAGE_SIZE / RADEON_GPU_PAGE_SIZE); j++, t++) {
+			if (bound & (1 << i))
+				entry = radeon_gart_get_page_entry(rdev->dummy_page.addr +
+								   j * RADEON_GPU_PAGE_SIZE,
+								   flags);
+			else
+				entry = rdev->dummy_page.entry;
+
+			if (rdev->gart.pages_entry[t] != entry) {
+				DRM_ERROR("GART entry %u is 0x%016llx, expected 0x%016llx\n",
+					  t, rdev->gart.pages_entry[t], entry);
+				return -EINVAL;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Test the bookkeeping of radeon_gart_bind/unbind on unused pages at the
+ * end of the aperture. Every page is backed by the dummy page, so the GPU
+ * never sees anything but the dummy page there; nothing is submitted.
+ */
+void radeon_test_gart(struct radeon_device *rdev)
+{
+	const uint32_t flags = RADEON_GART_PAGE_VALID | RADEON_GART_PAGE_READ;
+	const unsigned per_page = PAGE_SIZE / RADEON_GPU_PAGE_SIZE;
+	struct page *pages[RADEON_TEST_GART_PAGES];
+	dma_addr_t dma_addr[RADEON_TEST_GART_PAGES];
+	u64 pte_writes, flushes;
+	unsigned i;
+	int first, r;
+
+	first = radeon_test_gart_window(rdev);
+	if (first < 0) {
+		DRM_INFO("No %u unbound GART pages, skipping GART test\n",
+			 RADEON_TEST_GART_PAGES);
+		return;
+	}
+
+	for (i = 0; i < RADEON_TEST_GART_PAGES; ++i) {
+		pages[i] = rdev->dummy_page.page;
+		dma_addr[i] = rdev->dummy_page.addr;
+	}
+
+	/* two bound runs with a hole between them */
+	pte_writes = rdev->gart.stats.pte_writes;
+	radeon_gart_bind(rdev, first * PAGE_SIZE, 4, pages, dma_addr, flags);
+	radeon_gart_bind(rdev, (first + 6) * PAGE_SIZE, 2, pages, dma_addr,
+			 flags);
+	r = radeon_test_gart_check(rdev, first, 0xcf, flags);
+	if (r)
+		goto out_cleanup;
+
+	if (!rdev->gart.tlb_dirty ||
+	    rdev->gart.stats.pte_writes - pte_writes != 6 * per_page) {
+		DRM_ERROR("Binding wrote %llu entries, TLB %s\n",
+			  rdev->gart.stats.pte_writes - pte_writes,
+			  rdev->gart.tlb_dirty ? "dirty" : "clean");
+		r = -EINVAL;
+		goto out_cleanup;
+	}
+
+	/* one flush for both binds, none when nothing changed */
+	flushes = rdev->gart.stats.flushes;
+	radeon_gart_tlb_sync(rdev);
+	radeon_gart_tlb_sync(rdev);
+	if (rdev->gart.tlb_dirty || rdev->gart.stats.flushes - flushes != 1) {
+		DRM_ERROR("Syncing flushed the TLB %llu times\n",
+			  rdev->gart.stats.flushes - flushes);
+		r = -EINVAL;
+		goto out_cleanup;
+	}
+
+	/* unbinding across the hole must clear the second run in place */
+	pte_writes = rdev->gart.stats.pte_writes;
+	radeon_gart_unbind(rdev, (first + 2) * PAGE_SIZE, 6);
+	r = radeon_test_gart_check(rdev, first, 0x03, flags);
+	if (r)
+		goto out_cleanup;
+
+	if (rdev->gart.stats.pte_writes - pte_writes != 4 * per_page) {
+		DRM_ERROR("Unbinding wrote %llu entries\n",
+			  rdev->gart.stats.pte_writes - pte_writes);
+		r = -EINVAL;
+		goto out_cleanup;
+	}
+
+	radeon_gart_unbind(rdev, first * PAGE_SIZE, RADEON_TEST_GART_PAGES);
+	r = radeon_test_gart_check(rdev, first, 0, flags);
+
+out_cleanup:
+	radeon_gart_unbind(rdev, first * PAGE_SIZE, RADEON_TEST_GART_PAGES);
+	radeon_gart_tlb_sync(rdev);
+
+	if (r)
+		printk(KERN_WARNING "Error while testing GART.\n");
+	else
+		DRM_INFO("Tested GART bind/unbind on pages %d-%d\n",
+			 first, first + RADEON_TEST_GART_PAGES - 1);
+}
+
+/* Mappings in address order and the index of the last mapping of the
+ * run that starts at each of them.
+ */
+static const struct {
+	unsigned start, last;
+	uint32_t flags;
+	uint64_t addr;
+	unsigned run_end;
+} radeon_test_vm_runs[] = {
+	/* contiguous at both ends */
+	{ 0, 15, RADEON_VM_PAGE_VALID, 0x100000, 1 },
+	{ 16, 31, RADEON_VM_PAGE_VALID, 0x100000 + 16 * RADEON_GPU_PAGE_SIZE, 1 },
+	/* gap at the destination */
+	{ 32, 47, RADEON_VM_PAGE_VALID, 0x200000, 2 },
+	/* different flags */
+	{ 48, 63, RADEON_VM_PAGE_VALID | RADEON_VM_PAGE_SYSTEM,
+	  0x200000 + 16 * RADEON_GPU_PAGE_SIZE, 3 },
+	/* cleared mappings after a gap in the address space, all at 0 */
+	{ 80, 95, 0, 0, 6 },
+	{ 96, 99, 0, 0, 6 },
+	{ 100, 127, 0, 0, 6 },
+	{ 128, 131, RADEON_VM_PAGE_VALID, 0x300000, 7 },
+};
+
+/* Test which mappings radeon_vm_batch_run merges, CPU only */
+void radeon_test_vm_batch(struct radeon_device *rdev)
+{
+	unsigned i, n = ARRAY_SIZE(radeon_test_vm_runs), runs = 0;
+	struct radeon_bo_va *bo_va, *first, *last;
+	LIST_HEAD(head);
+	int r = 0;
+
+	bo_va = kcalloc(n, sizeof(*bo_va), GFP_KERNEL);
+	if (!bo_va) {
+		DRM_ERROR("Failed to allocate %u mappings\n", n);
+		return;
+	}
+
+	for (i = 0; i < n; ++i) {
+		bo_va[i].it.start = radeon_test_vm_runs[i].start;
+		bo_va[i].it.last = radeon_test_vm_runs[i].last;
+		bo_va[i].flags = radeon_test_vm_runs[i].flags;
+		bo_va[i].addr = radeon_test_vm_runs[i].addr;
+		list_add_tail(&bo_va[i].batch, &head);
+	}
+
+	list_for_each_entry(first, &head, batch) {
+		i = first - bo_va;
+		last = radeon_vm_batch_run(&head, first);
+		if (last - bo_va != radeon_test_vm_runs[i].run_end) {
+			DRM_ERROR("Run from mapping %u ends at %u, expected %u\n",
+				  i, (unsigned)(last - bo_va),
+				  radeon_test_vm_runs[i].run_end);
+			r = -EINVAL;
+		}
+		++runs;
+		first = last;
+	}
+
+	kfree(bo_va);
+
+	if (r)
+		printk(KERN_WARNING "Error while testing VM batch runs.\n");
+	else
+		DRM_INFO("Tested VM batch runs, %u mappings in %u runs\n",
+			 n, runs);
+}
@@ -231,6 +231,28 @@ static void radeon_evict_flags(struct ttm_buffer_object *bo,
 	*placement = rbo->placement;
 }
 
+/*
+ * Kernel buffers like rings, IBs and the shader heaps are the most expensive
+ * to lose, followed by buffers userspace wants in VRAM only and tiled ones
+ * which are usually render targets. Anything else is evicted first.
+ */
+static unsigned radeon_lru_priority(struct ttm_buffer_object *bo)
+{
+	struct radeon_bo *rbo;
+
+	if (!radeon_ttm_bo_is_radeon_bo(bo))
+		return 0;
+
+	rbo = container_of(bo, struct radeon_bo, tbo);
+	if (bo->type == ttm_bo_type_kernel)
+		return 3;
+	if (rbo->initial_domain == RADEON_GEM_DOMAIN_VRAM)
+		return 2;
+	if (rbo->tiling_flags)
+		return 1;
+	return 0;
+}
+
 static int radeon_verify_access(struct ttm_buffer_object *bo, struct file *filp)
 {
 	struct radeon_bo *rbo = container_of(bo, struct radeon_bo, tbo);
@@ -850,6 +872,7 @@ static struct ttm_bo_driver radeon_bo_driver = {
 	.invalidate_caches = &radeon_invalidate_caches,
 	.init_mem_type = &radeon_init_mem_type,
 	.evict_flags = &radeon_evict_flags,
+	.lru_priority = &radeon_lru_priority,
 	.move = &radeon_bo_move,
 	.verify_access = &radeon_verify_access,
 	.move_notify = &radeon_bo_move_notify,
@@ -1025,12 +1048,22 @@ static int radeon_mm_dump_table(struct seq_file *m, void *data)
 	return ret;
 }
 
+static int radeon_ttm_lru_dump(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct radeon_device *rdev = dev->dev_private;
+
+	return ttm_bo_lru_dump_table(m, &rdev->mman.bdev);
+}
+
 static int ttm_pl_vram = TTM_PL_VRAM;
 static int ttm_pl_tt = TTM_PL_TT;
 
 static struct drm_info_list radeon_ttm_debugfs_list[] = {
 	{"radeon_vram_mm", radeon_mm_dump_table, 0, &ttm_pl_vram},
 	{"radeon_gtt_mm", radeon_mm_dump_table, 0, &ttm_pl_tt},
+	{"radeon_ttm_lru", radeon_ttm_lru_dump, 0, NULL},
 	{"ttm_page_pool", ttm_page_alloc_debugfs, 0, NULL},
 #ifdef CONFIG_SWIOTLB
 	{"ttm_dma_page_pool", ttm_dma_page_alloc_debugfs, 0, NULL}
@@ -25,6 +25,7 @@
  *          Alex Deucher
  *          Jerome Glisse
  */
+#include <linux/list_sort.h>
 #include <drm/drmP.h>
 #include <drm/radeon_drm.h>
 #include "radeon.h"
@@ -172,39 +173,56 @@ struct radeon_bo_list *radeon_vm_get_bos(struct radeon_device *rdev,
  * Allocate an id for the vm (cayman+).
  * Returns the fence we need to sync to (if any).
  *
- * Global and local mutex must be locked!
+ * The id stays reserved for this ring until radeon_vm_fence or
+ * radeon_vm_put_id, so submissions on other rings can't pick it in
+ * the meantime. Every ring holds at most one reservation and there
+ * are always more ids than rings running VM IBs, so a candidate is
+ * always left.
+ *
+ * Local mutex and ring lock must be locked!
  */
 struct radeon_fence *radeon_vm_grab_id(struct radeon_device *rdev,
 				       struct radeon_vm *vm, int ring)
 {
+	struct radeon_vm_manager *mgr = &rdev->vm_manager;
 	struct radeon_fence *best[RADEON_NUM_RINGS] = {};
 	struct radeon_vm_id *vm_id = &vm->ids[ring];
+	struct radeon_fence *fence = NULL;
 
 	unsigned choices[2] = {};
 	unsigned i;
 
+	spin_lock(&mgr->id_lock);
+
 	/* check if the id is still valid */
 	if (vm_id->id && vm_id->last_id_use &&
-	    vm_id->last_id_use == rdev->vm_manager.active[vm_id->id])
-		return NULL;
+	    !test_bit(vm_id->id, &mgr->reserved) &&
+	    vm_id->last_id_use == mgr->active[vm_id->id]) {
+		__set_bit(vm_id->id, &mgr->reserved);
+		goto out;
+	}
 
 	/* we definately need to flush */
 	vm_id->pd_gpu_addr = ~0ll;
 
 	/* skip over VMID 0, since it is the system VM */
-	for (i = 1; i < rdev->vm_manager.nvm; ++i) {
-		struct radeon_fence *fence = rdev->vm_manager.active[i];
+	for (i = 1; i < mgr->nvm; ++i) {
+		struct radeon_fence *active = mgr->active[i];
 
-		if (fence == NULL) {
+		if (test_bit(i, &mgr->reserved))
+			continue;
+
+		if (active == NULL) {
 			/* found a free one */
 			vm_id->id = i;
 			trace_radeon_vm_grab_id(i, ring);
-			return NULL;
+			__set_bit(i, &mgr->reserved);
+			goto out;
 		}
 
-		if (radeon_fence_is_earlier(fence, best[fence->ring])) {
-			best[fence->ring] = fence;
-			choices[fence->ring == ring ? 0 : 1] = i;
+		if (radeon_fence_is_earlier(active, best[active->ring])) {
+			best[active->ring] = active;
+			choices[active->ring == ring ? 0 : 1] = i;
 		}
 	}
 
@@ -212,13 +230,37 @@ struct radeon_fence *radeon_vm_grab_id(struct radeon_device *rdev,
 		if (choices[i]) {
 			vm_id->id = choices[i];
 			trace_radeon_vm_grab_id(choices[i], ring);
-			return rdev->vm_manager.active[choices[i]];
+			__set_bit(choices[i], &mgr->reserved);
+			/* can't be replaced while we hold the reservation */
+			fence = mgr->active[choices[i]];
+			goto out;
 		}
 	}
 
 	/* should never happen */
 	BUG();
-	return NULL;
+
+out:
+	spin_unlock(&mgr->id_lock);
+	return fence;
+}
+
+/**
+ * radeon_vm_put_id - give up an id without using it
+ *
+ * @rdev: radeon_device pointer
+ * @vm: vm the id was grabbed for
+ * @ring: ring the id was grabbed on
+ *
+ * Drop the reservation taken by radeon_vm_grab_id when the submission
+ * fails before radeon_vm_fence (cayman+).
+ */
+void radeon_vm_put_id(struct radeon_device *rdev,
+		      struct radeon_vm *vm, int ring)
+{
+	spin_lock(&rdev->vm_manager.id_lock);
+	__clear_bit(vm->ids[ring].id, &rdev->vm_manager.reserved);
+	spin_unlock(&rdev->vm_manager.id_lock);
 }
 
 /**
@@ -231,7 +273,7 @@ struct radeon_fence *radeon_vm_grab_id(struct radeon_device *rdev,
  *
  * Flush the vm (cayman+).
  *
- * Global and local mutex must be locked!
+ * Local mutex and ring lock must be locked!
  */
 void radeon_vm_flush(struct radeon_device *rdev,
 		     struct radeon_vm *vm,
@@ -261,9 +303,10 @@ void radeon_vm_flush(struct radeon_device *rdev,
  * @fence: fence to remember
  *
  * Fence the vm (cayman+).
- * Set the fence used to protect page table and id.
+ * Set the fence used to protect page table and id, and release the
+ * reservation taken by radeon_vm_grab_id.
  *
- * Global and local mutex must be locked!
+ * Local mutex and ring lock must be locked!
  */
 void radeon_vm_fence(struct radeon_device *rdev,
 		     struct radeon_vm *vm,
@@ -271,8 +314,11 @@ void radeon_vm_fence(struct radeon_device *rdev,
 {
 	unsigned vm_id = vm->ids[fence->ring].id;
 
+	spin_lock(&rdev->vm_manager.id_lock);
 	radeon_fence_unref(&rdev->vm_manager.active[vm_id]);
 	rdev->vm_manager.active[vm_id] = radeon_fence_ref(fence);
+	__clear_bit(vm_id, &rdev->vm_manager.reserved);
+	spin_unlock(&rdev->vm_manager.id_lock);
 
 	radeon_fence_unref(&vm->ids[fence->ring].last_id_use);
 	vm->ids[fence->ring].last_id_use = radeon_fence_ref(fence);
@@ -335,6 +381,7 @@ struct radeon_bo_va *radeon_vm_bo_add(struct radeon_device *rdev,
 	bo_va->ref_count = 1;
 	INIT_LIST_HEAD(&bo_va->bo_list);
 	INIT_LIST_HEAD(&bo_va->vm_status);
+	INIT_LIST_HEAD(&bo_va->batch);
 
 	mutex_lock(&vm->mutex);
 	list_add_tail(&bo_va->bo_list, &bo->va);
@@ -487,6 +534,7 @@ int radeon_vm_bo_set_addr(struct radeon_device *rdev,
 			tmp->vm = vm;
 			tmp->addr = bo_va->addr;
 			tmp->bo = radeon_bo_ref(bo_va->bo);
+			INIT_LIST_HEAD(&tmp->batch);
 			spin_lock(&vm->status_lock);
 			list_add(&tmp->vm_status, &vm->freed);
 			spin_unlock(&vm->status_lock);
@@ -884,38 +932,21 @@ static void radeon_vm_fence_pts(struct radeon_vm *vm,
 }
 
 /**
- * radeon_vm_bo_update - map a bo into the vm page table
+ * radeon_vm_bo_new_addr - compute the new mapping of a bo
  *
  * @rdev: radeon_device pointer
- * @vm: requested vm
- * @bo: radeon buffer object
- * @mem: ttm mem
- *
- * Fill in the page table entries for @bo (cayman+).
- * Returns 0 for success, -EINVAL for failure.
+ * @bo_va: requested bo_va
+ * @mem: ttm mem, NULL to clear the mapping
  *
- * Object have to be reserved and mutex must be locked!
+ * Update the page flags of @bo_va for @mem and set its new
+ * address (cayman+).
+ * Returns true if the page tables need to be updated.
  */
-int radeon_vm_bo_update(struct radeon_device *rdev,
-			struct radeon_bo_va *bo_va,
-			struct ttm_mem_reg *mem)
+static bool radeon_vm_bo_new_addr(struct radeon_device *rdev,
+				  struct radeon_bo_va *bo_va,
+				  struct ttm_mem_reg *mem)
 {
-	struct radeon_vm *vm = bo_va->vm;
-	struct radeon_ib ib;
-	unsigned nptes, ncmds, ndw;
 	uint64_t addr;
-	uint32_t flags;
-	int r;
-
-	if (!bo_va->it.start) {
-		dev_err(rdev->dev, "bo %p don't has a mapping in vm %p\n",
-			bo_va->bo, vm);
-		return -EINVAL;
-	}
-
-	spin_lock(&vm->status_lock);
-	list_del_init(&bo_va->vm_status);
-	spin_unlock(&vm->status_lock);
 
 	bo_va->flags &= ~RADEON_VM_PAGE_VALID;
 	bo_va->flags &= ~RADEON_VM_PAGE_SYSTEM;
@@ -941,132 +972,148 @@ int radeon_vm_bo_update(struct radeon_device *rdev,
 	}
 
 	if (addr == bo_va->addr)
-		return 0;
+		return false;
 	bo_va->addr = addr;
 
 	trace_radeon_vm_bo_update(bo_va);
+	return true;
+}
 
-	nptes = bo_va->it.last - bo_va->it.start + 1;
-
+/**
+ * radeon_vm_update_ndw - estimate the IB size of a PTE update
+ *
+ * @nptes: number of PTEs to update
+ * @flags: hw mapping flags
+ *
+ * Returns the number of dwords needed to update @nptes PTEs,
+ * without the padding.
+ */
+static unsigned radeon_vm_update_ndw(unsigned nptes, uint32_t flags)
+{
 	/* reserve space for one command every (1 << BLOCK_SIZE) entries
 	   or 2k dwords (whatever is smaller) */
-	ncmds = (nptes >> min(radeon_vm_block_size, 11)) + 1;
-
-	/* padding, etc. */
-	ndw = 64;
+	unsigned ncmds = (nptes >> min(radeon_vm_block_size, 11)) + 1;
 
-	flags = radeon_vm_page_flags(bo_va->flags);
 	if ((flags & R600_PTE_GART_MASK) == R600_PTE_GART_MASK) {
 		/* only copy commands needed */
-		ndw += ncmds * 7;
+		return ncmds * 7;
 
 	} else if (flags & R600_PTE_SYSTEM) {
-		/* header for write data commands */
-		ndw += ncmds * 4;
-
-		/* body of write data command */
-		ndw += nptes * 2;
+		/* header for write data commands and their body */
+		return ncmds * 4 + nptes * 2;
 
 	} else {
-		/* set page commands needed */
-		ndw += ncmds * 10;
-
-		/* two extra commands for begin/end of fragment */
-		ndw += 2 * 10;
+		/* set page commands needed, plus two extra
+		   commands for begin/end of fragment */
+		return ncmds * 10 + 2 * 10;
 	}
+}
 
-	/* update too big for an IB */
-	if (ndw > 0xfffff)
-		return -ENOMEM;
-
-	r = radeon_ib_get(rdev, R600_RING_TYPE_DMA_INDEX, &ib, NULL, ndw * 4);
-	if (r)
-		return r;
-	ib.length_dw = 0;
-
-	if (!(bo_va->flags & RADEON_VM_PAGE_VALID)) {
-		unsigned i;
+/**
+ * radeon_vm_batch_init - start a batch of PTE updates
+ *
+ * @batch: batch to initialize
+ * @vm: requested vm
+ *
+ * Mappings added to @batch are written to the page tables with as
+ * few IBs and fences as possible by radeon_vm_batch_commit (cayman+).
+ */
+void radeon_vm_batch_init(struct radeon_vm_batch *batch, struct radeon_vm *vm)
+{
+	batch->vm = vm;
+	INIT_LIST_HEAD(&batch->freed);
+	INIT_LIST_HEAD(&batch->updates);
+}
 
-		for (i = 0; i < RADEON_NUM_RINGS; ++i)
-			radeon_sync_fence(&ib.sync, vm->ids[i].last_id_use);
-	}
+/**
+ * radeon_vm_batch_add - add a bo mapping to a batch
+ *
+ * @rdev: radeon_device pointer
+ * @batch: batch to add the mapping to
+ * @bo_va: requested bo_va
+ * @mem: ttm mem, NULL to clear the mapping
+ *
+ * Queue the page table entries for @bo_va for update (cayman+).
+ * Returns 0 for success, -EINVAL for failure.
+ *
+ * Object have to be reserved and mutex must be locked!
+ */
+int radeon_vm_batch_add(struct radeon_device *rdev,
+			struct radeon_vm_batch *batch,
+			struct radeon_bo_va *bo_va,
+			struct ttm_mem_reg *mem)
+{
+	struct radeon_vm *vm = bo_va->vm;
 
-	r = radeon_vm_update_ptes(rdev, vm, &ib, bo_va->it.start,
-				  bo_va->it.last + 1, addr,
-				  radeon_vm_page_flags(bo_va->flags));
-	if (r) {
-		radeon_ib_free(rdev, &ib);
-		return r;
+	if (!bo_va->it.start) {
+		dev_err(rdev->dev, "bo %p don't has a mapping in vm %p\n",
+			bo_va->bo, vm);
+		return -EINVAL;
 	}
 
-	radeon_asic_vm_pad_ib(rdev, &ib);
-	WARN_ON(ib.length_dw > ndw);
+	spin_lock(&vm->status_lock);
+	list_del_init(&bo_va->vm_status);
+	spin_unlock(&vm->status_lock);
 
-	r = radeon_ib_schedule(rdev, &ib, NULL, false);
-	if (r) {
-		radeon_ib_free(rdev, &ib);
-		return r;
-	}
-	ib.fence->is_vm_update = true;
-	radeon_vm_fence_pts(vm, bo_va->it.start, bo_va->it.last + 1, ib.fence);
-	radeon_fence_unref(&bo_va->last_pt_update);
-	bo_va->last_pt_update = radeon_fence_ref(ib.fence);
-	radeon_ib_free(rdev, &ib);
+	if (radeon_vm_bo_new_addr(rdev, bo_va, mem) &&
+	    list_empty(&bo_va->batch))
+		list_add_tail(&bo_va->batch, &batch->updates);
 
 	return 0;
 }
 
 /**
- * radeon_vm_clear_freed - clear freed BOs in the PT
+ * radeon_vm_batch_add_freed - add the freed BOs to a batch
  *
  * @rdev: radeon_device pointer
- * @vm: requested vm
+ * @batch: batch to add the mappings to
  *
- * Make sure all freed BOs are cleared in the PT.
- * Returns 0 for success.
+ * Queue all freed BOs for clearing in the PT, they are released
+ * once the batch is committed.
  *
  * PTs have to be reserved and mutex must be locked!
  */
-int radeon_vm_clear_freed(struct radeon_device *rdev,
-			  struct radeon_vm *vm)
+void radeon_vm_batch_add_freed(struct radeon_device *rdev,
+			       struct radeon_vm_batch *batch)
 {
+	struct radeon_vm *vm = batch->vm;
 	struct radeon_bo_va *bo_va;
-	int r;
 
 	spin_lock(&vm->status_lock);
 	while (!list_empty(&vm->freed)) {
 		bo_va = list_first_entry(&vm->freed,
 			struct radeon_bo_va, vm_status);
+		list_del_init(&bo_va->vm_status);
 		spin_unlock(&vm->status_lock);
 
-		r = radeon_vm_bo_update(rdev, bo_va, NULL);
-		radeon_bo_unref(&bo_va->bo);
-		radeon_fence_unref(&bo_va->last_pt_update);
-		kfree(bo_va);
-		if (r)
-			return r;
+		if (radeon_vm_bo_new_addr(rdev, bo_va, NULL)) {
+			list_add_tail(&bo_va->batch, &batch->freed);
+		} else {
+			radeon_bo_unref(&bo_va->bo);
+			radeon_fence_unref(&bo_va->last_pt_update);
+			kfree(bo_va);
+		}
 
 		spin_lock(&vm->status_lock);
 	}
 	spin_unlock(&vm->status_lock);
-	return 0;
-
 }
 
 /**
- * radeon_vm_clear_invalids - clear invalidated BOs in the PT
+ * radeon_vm_batch_add_invalids - add the invalidated BOs to a batch
  *
  * @rdev: radeon_device pointer
- * @vm: requested vm
+ * @batch: batch to add the mappings to
  *
- * Make sure all invalidated BOs are cleared in the PT.
+ * Queue all invalidated BOs for clearing in the PT.
  * Returns 0 for success.
  *
  * PTs have to be reserved and mutex must be locked!
  */
-int radeon_vm_clear_invalids(struct radeon_device *rdev,
-			     struct radeon_vm *vm)
+int radeon_vm_batch_add_invalids(struct radeon_device *rdev,
+				 struct radeon_vm_batch *batch)
 {
+	struct radeon_vm *vm = batch->vm;
 	struct radeon_bo_va *bo_va;
 	int r;
 
@@ -1076,7 +1123,7 @@ int radeon_vm_clear_invalids(struct radeon_device *rdev,
 			struct radeon_bo_va, vm_status);
 		spin_unlock(&vm->status_lock);
 
-		r = radeon_vm_bo_update(rdev, bo_va, NULL);
+		r = radeon_vm_batch_add(rdev, batch, bo_va, NULL);
 		if (r)
 			return r;
 
@@ -1087,6 +1134,290 @@ int radeon_vm_clear_invalids(struct radeon_device *rdev,
 	return 0;
 }
 
+static int radeon_vm_batch_cmp(void *priv, struct list_head *a,
+			       struct list_head *b)
+{
+	struct radeon_bo_va *la = list_entry(a, struct radeon_bo_va, batch);
+	struct radeon_bo_va *lb = list_entry(b, struct radeon_bo_va, batch);
+
+	/* Sort A before B if A maps a lower address. */
+	if (la->it.start < lb->it.start)
+		return -1;
+	return la->it.start > lb->it.start;
+}
+
+/**
+ * radeon_vm_batch_run - find the end of a run of mappings
+ *
+ * @head: sorted list of mappings
+ * @first: first mapping of the run
+ *
+ * Mappings following each other both in the address space and at
+ * their destination with the same flags are written as one range,
+ * so that the fragments can span them. Runs without
+ * RADEON_VM_PAGE_VALID clear the entries and never look at the
+ * destination, so cleared mappings only need to be adjacent.
+ * Returns the last mapping of the run.
+ */
+struct radeon_bo_va *radeon_vm_batch_run(struct list_head *head,
+					 struct radeon_bo_va *first)
+{
+	struct radeon_bo_va *last = first, *next;
+	bool valid = first->flags & RADEON_VM_PAGE_VALID;
+	uint64_t addr = first->addr;
+
+	while (!list_is_last(&last->batch, head)) {
+		addr += (last->it.last - last->it.start + 1) *
+			RADEON_GPU_PAGE_SIZE;
+		next = list_next_entry(last, batch);
+		if (next->it.start != last->it.last + 1 ||
+		    next->flags != first->flags ||
+		    (valid && next->addr != addr))
+			break;
+		last = next;
+	}
+	return last;
+}
+
+/**
+ * radeon_vm_batch_release - drop the mappings of a batch
+ *
+ * @freed: list of freed mappings, released
+ * @updates: list of updated mappings
+ *
+ * Mutex must be locked!
+ */
+static void radeon_vm_batch_release(struct list_head *freed,
+				    struct list_head *updates)
+{
+	struct radeon_bo_va *bo_va, *tmp;
+
+	list_for_each_entry_safe(bo_va, tmp, freed, batch) {
+		list_del(&bo_va->batch);
+		radeon_bo_unref(&bo_va->bo);
+		radeon_fence_unref(&bo_va->last_pt_update);
+		kfree(bo_va);
+	}
+	list_for_each_entry_safe(bo_va, tmp, updates, batch) {
+		list_del_init(&bo_va->batch);
+	}
+}
+
+/**
+ * radeon_vm_batch_emit - write the next part of a batch
+ *
+ * @rdev: radeon_device pointer
+ * @batch: batch to write
+ *
+ * Take as many runs from the head of @batch as fit into one IB,
+ * freed mappings first, and write them to the page tables with a
+ * single fence (cayman+).
+ * Returns 0 for success, error for failure.
+ *
+ * Global and local mutex must be locked!
+ */
+static int radeon_vm_batch_emit(struct radeon_device *rdev,
+				struct radeon_vm_batch *batch)
+{
+	struct list_head *lists[2] = { &batch->freed, &batch->updates };
+	struct radeon_vm *vm = batch->vm;
+	struct radeon_bo_va *first, *last;
+	struct list_head emitted[2], run;
+	bool sync_ids = false, full = false;
+	unsigned i, ndw, run_ndw;
+	struct radeon_ib ib;
+	int r;
+
+	/* padding, etc. */
+	ndw = 64;
+
+	for (i = 0; i < 2; ++i) {
+		INIT_LIST_HEAD(&emitted[i]);
+		while (!full && !list_empty(lists[i])) {
+			first = list_first_entry(lists[i], struct radeon_bo_va,
+						 batch);
+			last = radeon_vm_batch_run(lists[i], first);
+			run_ndw = radeon_vm_update_ndw(last->it.last -
+						       first->it.start + 1,
+						       radeon_vm_page_flags(first->flags));
+
+			/* always take at least one run */
+			if (ndw > 64 && ndw + run_ndw > RADEON_VM_BATCH_MAX_NDW) {
+				full = true;
+				break;
+			}
+			ndw += run_ndw;
+
+			if (!(first->flags & RADEON_VM_PAGE_VALID))
+				sync_ids = true;
+
+			list_cut_position(&run, lists[i], &last->batch);
+			list_splice_tail(&run, &emitted[i]);
+		}
+	}
+
+	/* update too big for an IB */
+	if (ndw > 0xfffff) {
+		r = -ENOMEM;
+		goto error_release;
+	}
+
+	r = radeon_ib_get(rdev, R600_RING_TYPE_DMA_INDEX, &ib, NULL, ndw * 4);
+	if (r)
+		goto error_release;
+	ib.length_dw = 0;
+
+	if (sync_ids) {
+		for (i = 0; i < RADEON_NUM_RINGS; ++i)
+			radeon_sync_fence(&ib.sync, vm->ids[i].last_id_use);
+	}
+
+	for (i = 0; i < 2; ++i) {
+		list_for_each_entry(first, &emitted[i], batch) {
+			last = radeon_vm_batch_run(&emitted[i], first);
+			r = radeon_vm_update_ptes(rdev, vm, &ib, first->it.start,
+						  last->it.last + 1, first->addr,
+						  radeon_vm_page_flags(first->flags));
+			if (r)
+				goto error_free;
+			first = last;
+		}
+	}
+
+	radeon_asic_vm_pad_ib(rdev, &ib);
+	WARN_ON(ib.length_dw > ndw);
+
+	r = radeon_ib_schedule(rdev, &ib, NULL, false);
+	if (r)
+		goto error_free;
+	ib.fence->is_vm_update = true;
+
+	for (i = 0; i < 2; ++i) {
+		list_for_each_entry(first, &emitted[i], batch) {
+			radeon_vm_fence_pts(vm, first->it.start,
+					    first->it.last + 1, ib.fence);
+			radeon_fence_unref(&first->last_pt_update);
+			first->last_pt_update = radeon_fence_ref(ib.fence);
+		}
+	}
+	radeon_ib_free(rdev, &ib);
+	radeon_vm_batch_release(&emitted[0], &emitted[1]);
+
+	return 0;
+
+error_free:
+	radeon_ib_free(rdev, &ib);
+error_release:
+	radeon_vm_batch_release(&emitted[0], &emitted[1]);
+	return r;
+}
+
+/**
+ * radeon_vm_batch_commit - write a batch of PTE updates
+ *
+ * @rdev: radeon_device pointer
+ * @batch: batch to write
+ *
+ * Sort the mappings of @batch by address and write them to the page
+ * tables, merging neighbouring mappings into fragment runs and
+ * splitting into several IBs only when they get too big (cayman+).
+ * The freed mappings are cleared first since the updated ones can
+ * reuse their address range. The batch is empty afterwards, even
+ * on failure.
+ * Returns 0 for success, error for failure.
+ *
+ * Objects have to be reserved and mutex must be locked!
+ */
+int radeon_vm_batch_commit(struct radeon_device *rdev,
+			   struct radeon_vm_batch *batch)
+{
+	int r = 0;
+
+	list_sort(NULL, &batch->freed, radeon_vm_batch_cmp);
+	list_sort(NULL, &batch->updates, radeon_vm_batch_cmp);
+
+	while (!list_empty(&batch->freed) || !list_empty(&batch->updates)) {
+		r = radeon_vm_batch_emit(rdev, batch);
+		if (r)
+			break;
+	}
+
+	radeon_vm_batch_release(&batch->freed, &batch->updates);
+	return r;
+}
+
+/**
+ * radeon_vm_bo_update - map a bo into the vm page table
+ *
+ * @rdev: radeon_device pointer
+ * @bo_va: requested BO and VM object
+ * @mem: ttm mem
+ *
+ * Fill in the page table entries for @bo_va (cayman+).
+ * Returns 0 for success, -EINVAL for failure.
+ *
+ * Object have to be reserved and mutex must be locked!
+ */
+int radeon_vm_bo_update(struct radeon_device *rdev,
+			struct radeon_bo_va *bo_va,
+			struct ttm_mem_reg *mem)
+{
+	struct radeon_vm_batch batch;
+	int r;
+
+	radeon_vm_batch_init(&batch, bo_va->vm);
+	r = radeon_vm_batch_add(rdev, &batch, bo_va, mem);
+	if (r)
+		return r;
+
+	return radeon_vm_batch_commit(rdev, &batch);
+}
+
+/**
+ * radeon_vm_clear_freed - clear freed BOs in the PT
+ *
+ * @rdev: radeon_device pointer
+ * @vm: requested vm
+ *
+ * Make sure all freed BOs are cleared in the PT.
+ * Returns 0 for success.
+ *
+ * PTs have to be reserved and mutex must be locked!
+ */
+int radeon_vm_clear_freed(struct radeon_device *rdev,
+			  struct radeon_vm *vm)
+{
+	struct radeon_vm_batch batch;
+
+	radeon_vm_batch_init(&batch, vm);
+	radeon_vm_batch_add_freed(rdev, &batch);
+	return radeon_vm_batch_commit(rdev, &batch);
+}
+
+/**
+ * radeon_vm_clear_invalids - clear invalidated BOs in the PT
+ *
+ * @rdev: radeon_device pointer
+ * @vm: requested vm
+ *
+ * Make sure all invalidated BOs are cleared in the PT.
+ * Returns 0 for success.
+ *
+ * PTs have to be reserved and mutex must be locked!
+ */
+int radeon_vm_clear_invalids(struct radeon_device *rdev,
+			     struct radeon_vm *vm)
+{
+	struct radeon_vm_batch batch;
+	int r, r2;
+
+	radeon_vm_batch_init(&batch, vm);
+	/* commit whatever was added before a failure as well */
+	r = radeon_vm_batch_add_invalids(rdev, &batch);
+	r2 = radeon_vm_batch_commit(rdev, &batch);
+	return r ? r : r2;
+}
+
 /**
  * radeon_vm_bo_rmv - remove a bo to a specific vm
  *
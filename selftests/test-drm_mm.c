@@ -0,0 +1,634 @@
+/*
+ * Test cases and benchmark for the drm_mm range allocator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Every test replays a random trace against a fresh drm_mm, checks the
+ * resulting layout and reports the time per operation together with the
+ * number of holes and the fragmentation left behind. Traces start at 1000
+ * nodes and grow tenfold up to the max_nodes module parameter.
+ *
+ * Sizes are in abstract units, so that even 10^7 nodes of up to
+ * TEST_MAX_SIZE units fit into a 32-bit unsigned long.
+ */
+
+#define pr_fmt(fmt) "drm_mm: " fmt
+
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <drm/drm_mm.h>
+
+#define TEST_MAX_SIZE 256
+#define TEST_COLORS 4
+#define TEST_COLOR_GUARD 1
+
+static unsigned int max_nodes = 100000;
+module_param(max_nodes, uint, 0400);
+MODULE_PARM_DESC(max_nodes, "Largest trace in nodes, up to 10000000 (about 200 bytes per node)");
+
+static unsigned int random_seed;
+module_param(random_seed, uint, 0400);
+MODULE_PARM_DESC(random_seed, "Seed for the traces (0 = random)");
+
+static struct rnd_state rnd;
+
+static unsigned long random_size(void)
+{
+	return prandom_u32_state(&rnd) % TEST_MAX_SIZE + 1;
+}
+
+static void shuffle(unsigned int *order, unsigned int count)
+{
+	unsigned int i, j, tmp;
+
+	for (i = 0; i < count; i++)
+		order[i] = i;
+
+	for (i = count - 1; i > 0; i--) {
+		j = prandom_u32_state(&rnd) % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+}
+
+static u64 ns_per_op(ktime_t start, unsigned long ops)
+{
+	if (!ops)
+		return 0;
+
+	return div64_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), ops);
+}
+
+static void report(const char *name, unsigned int count, struct drm_mm *mm,
+		   const char *op, u64 ns)
+{
+	struct drm_mm_node *hole;
+	unsigned long hole_start, hole_end, holes = 0;
+	unsigned long total_free = 0, largest = 0, frag = 0;
+
+	drm_mm_for_each_hole(hole, mm, hole_start, hole_end) {
+		holes++;
+		total_free += hole_end - hole_start;
+		largest = max(largest, hole_end - hole_start);
+	}
+	if (total_free)
+		frag = 100 - div64_u64(100ULL * largest, total_free);
+
+	pr_info("%s, %u nodes: %s %llu ns/op, %lu holes, fragmentation %lu%%\n",
+		name, count, op, ns, holes, frag);
+}
+
+/* Walk all nodes checking order, hole tracking and the number of nodes */
+static bool check_mm(struct drm_mm *mm, unsigned long count)
+{
+	struct drm_mm_node *node;
+	unsigned long prev_end = __drm_mm_hole_node_start(&mm->head_node);
+	unsigned long nodes = 0;
+
+	drm_mm_for_each_node(node, mm) {
+		if (node->start < prev_end) {
+			pr_err("node 0x%lx+0x%lx overlaps its predecessor ending at 0x%lx\n",
+			       node->start, node->size, prev_end);
+			return false;
+		}
+		if (node->hole_follows != (__drm_mm_hole_node_end(node) >
+					   __drm_mm_hole_node_start(node))) {
+			pr_err("node 0x%lx+0x%lx has hole_follows %d\n",
+			       node->start, node->size, node->hole_follows);
+			return false;
+		}
+		prev_end = node->start + node->size;
+		nodes++;
+	}
+
+	if (nodes != count) {
+		pr_err("found %lu nodes, expected %lu\n", nodes, count);
+		return false;
+	}
+	return true;
+}
+
+/* A failed insertion is only fine if there really was no hole to fit */
+static bool check_enospc(struct drm_mm *mm, unsigned long size)
+{
+	struct drm_mm_node *hole;
+	unsigned long hole_start, hole_end;
+
+	drm_mm_for_each_hole(hole, mm, hole_start, hole_end) {
+		if (hole_end - hole_start >= size) {
+			pr_err("no space for 0x%lx, but hole 0x%lx-0x%lx is free\n",
+			       size, hole_start, hole_end);
+			return false;
+		}
+	}
+	return true;
+}
+
+static const struct insert_mode {
+	const char *name;
+	enum drm_mm_search_flags sflags;
+	enum drm_mm_allocator_flags aflags;
+} insert_modes[] = {
+	{ "default", DRM_MM_SEARCH_DEFAULT, DRM_MM_CREATE_DEFAULT },
+	{ "best", DRM_MM_SEARCH_BEST, DRM_MM_CREATE_DEFAULT },
+	{ "top-down", DRM_MM_SEARCH_BELOW, DRM_MM_CREATE_TOP },
+};
+
+/*
+ * Fill the allocator, free a random half of it and insert that half again
+ * with new sizes, for each search mode.
+ */
+static int test_insert(struct drm_mm_node *nodes, unsigned int *order,
+		       unsigned int count)
+{
+	unsigned long size, failed;
+	struct drm_mm mm;
+	unsigned int i, m;
+	ktime_t start;
+	u64 ns;
+	int ret;
+
+	for (m = 0; m < ARRAY_SIZE(insert_modes); m++) {
+		const struct insert_mode *mode = &insert_modes[m];
+
+		memset(&mm, 0, sizeof(mm));
+		drm_mm_init(&mm, 0, (unsigned long)count * TEST_MAX_SIZE);
+		memset(nodes, 0, count * sizeof(*nodes));
+
+		start = ktime_get();
+		for (i = 0; i < count; i++) {
+			ret = drm_mm_insert_node_generic(&mm, &nodes[i],
+							 random_size(), 0, 0,
+							 mode->sflags,
+							 mode->aflags);
+			if (ret) {
+				pr_err("%s insert %u failed: %d\n",
+				       mode->name, i, ret);
+				goto err;
+			}
+			if (!(i & 1023))
+				cond_resched();
+		}
+		ns = ns_per_op(start, count);
+		report(mode->name, count, &mm, "insert", ns);
+		if (!check_mm(&mm, count))
+			goto err;
+
+		shuffle(order, count);
+		start = ktime_get();
+		for (i = 0; i < count / 2; i++)
+			drm_mm_remove_node(&nodes[order[i]]);
+		ns = ns_per_op(start, count / 2);
+		report(mode->name, count, &mm, "remove", ns);
+		if (!check_mm(&mm, count - count / 2))
+			goto err;
+
+		failed = 0;
+		start = ktime_get();
+		for (i = 0; i < count / 2; i++) {
+			struct drm_mm_node *node = &nodes[order[i]];
+
+			size = random_size();
+			ret = drm_mm_insert_node_generic(&mm, node, size, 0, 0,
+							 mode->sflags,
+							 mode->aflags);
+			if (ret) {
+				/* only check the first, the walk is slow */
+				if (!failed++ && !check_enospc(&mm, size))
+					goto err;
+			}
+			if (!(i & 1023))
+				cond_resched();
+		}
+		ns = ns_per_op(start, count / 2);
+		report(mode->name, count, &mm, "reinsert", ns);
+		if (failed)
+			pr_info("%s, %u nodes: %lu reinsertions found no hole\n",
+				mode->name, count, failed);
+		if (!check_mm(&mm, count - failed))
+			goto err;
+
+		for (i = 0; i < count; i++) {
+			if (nodes[i].allocated)
+				drm_mm_remove_node(&nodes[i]);
+		}
+		if (!drm_mm_clean(&mm)) {
+			pr_err("%s: allocator not clean\n", mode->name);
+			return -EINVAL;
+		}
+		drm_mm_takedown(&mm);
+	}
+	return 0;
+
+err:
+	drm_mm_debug_table(&mm, "drm_mm");
+	return -EINVAL;
+}
+
+/* Insert into the middle half of the allocator, for each search mode */
+static int test_insert_range(struct drm_mm_node *nodes, unsigned int count)
+{
+	unsigned long size = (unsigned long)count * TEST_MAX_SIZE;
+	unsigned long range_start = size / 4, range_end = size / 4 * 3;
+	struct drm_mm mm;
+	unsigned int i, m;
+	ktime_t start;
+	u64 ns;
+	int ret;
+
+	for (m = 0; m < ARRAY_SIZE(insert_modes); m++) {
+		const struct insert_mode *mode = &insert_modes[m];
+
+		memset(&mm, 0, sizeof(mm));
+		drm_mm_init(&mm, 0, size);
+		memset(nodes, 0, count * sizeof(*nodes));
+
+		start = ktime_get();
+		for (i = 0; i < count / 2; i++) {
+			ret = drm_mm_insert_node_in_range_generic(&mm, &nodes[i],
+								  random_size(),
+								  0, 0,
+								  range_start,
+								  range_end,
+								  mode->sflags,
+								  mode->aflags);
+			if (ret) {
+				pr_err("%s range insert %u failed: %d\n",
+				       mode->name, i, ret);
+				goto err;
+			}
+			if (!(i & 1023))
+				cond_resched();
+		}
+		ns = ns_per_op(start, count / 2);
+		report(mode->name, count / 2, &mm, "range insert", ns);
+		if (!check_mm(&mm, count / 2))
+			goto err;
+
+		for (i = 0; i < count / 2; i++) {
+			if (nodes[i].start < range_start ||
+			    nodes[i].start + nodes[i].size > range_end) {
+				pr_err("%s: node 0x%lx+0x%lx outside of 0x%lx-0x%lx\n",
+				       mode->name, nodes[i].start,
+				       nodes[i].size, range_start, range_end);
+				goto err;
+			}
+			drm_mm_remove_node(&nodes[i]);
+		}
+		drm_mm_takedown(&mm);
+	}
+	return 0;
+
+err:
+	drm_mm_debug_table(&mm, "drm_mm");
+	return -EINVAL;
+}
+
+/*
+ * Reserve one node in each slot of TEST_MAX_SIZE units, in random order,
+ * and check that reserving an already used range fails.
+ */
+static int test_reserve(struct drm_mm_node *nodes, unsigned int *order,
+			unsigned int count)
+{
+	struct drm_mm_node tmp;
+	struct drm_mm mm;
+	unsigned int i;
+	ktime_t start;
+	u64 ns;
+	int ret;
+
+	memset(&mm, 0, sizeof(mm));
+	drm_mm_init(&mm, 0, (unsigned long)count * TEST_MAX_SIZE);
+	memset(nodes, 0, count * sizeof(*nodes));
+
+	shuffle(order, count);
+	for (i = 0; i < count; i++) {
+		nodes[i].start = (unsigned long)order[i] * TEST_MAX_SIZE;
+		nodes[i].size = random_size();
+	}
+
+	start = ktime_get();
+	for (i = 0; i < count; i++) {
+		ret = drm_mm_reserve_node(&mm, &nodes[i]);
+		if (ret) {
+			pr_err("reserve 0x%lx+0x%lx failed: %d\n",
+			       nodes[i].start, nodes[i].size, ret);
+			goto err;
+		}
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ns_per_op(start, count);
+	report("reserve", count, &mm, "reserve", ns);
+	if (!check_mm(&mm, count))
+		goto err;
+
+	for (i = 0; i < min(count, 1000u); i++) {
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.start = nodes[i].start + nodes[i].size - 1;
+		tmp.size = 1;
+		ret = drm_mm_reserve_node(&mm, &tmp);
+		if (ret != -ENOSPC) {
+			pr_err("reserving used 0x%lx returned %d\n",
+			       tmp.start, ret);
+			if (!ret)
+				drm_mm_remove_node(&tmp);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		drm_mm_remove_node(&nodes[i]);
+	drm_mm_takedown(&mm);
+	return 0;
+
+err:
+	drm_mm_debug_table(&mm, "drm_mm");
+	return -EINVAL;
+}
+
+/* Like i915_gtt_color_adjust, keep a guard between different colors */
+static void test_color_adjust(struct drm_mm_node *node, unsigned long color,
+			      unsigned long *start, unsigned long *end)
+{
+	if (node->color != color)
+		*start += TEST_COLOR_GUARD;
+
+	if (!list_empty(&node->node_list)) {
+		node = list_entry(node->node_list.next,
+				  struct drm_mm_node,
+				  node_list);
+		if (node->allocated && node->color != color)
+			*end -= TEST_COLOR_GUARD;
+	}
+}
+
+static int test_color(struct drm_mm_node *nodes, unsigned int *order,
+		      unsigned int count)
+{
+	struct drm_mm_node *node, *prev = NULL;
+	struct drm_mm mm;
+	unsigned int i;
+	ktime_t start;
+	u64 ns;
+	int ret;
+
+	memset(&mm, 0, sizeof(mm));
+	drm_mm_init(&mm, 0, (unsigned long)count * TEST_MAX_SIZE);
+	mm.color_adjust = test_color_adjust;
+	memset(nodes, 0, count * sizeof(*nodes));
+
+	start = ktime_get();
+	for (i = 0; i < count; i++) {
+		ret = drm_mm_insert_node_generic(&mm, &nodes[i], random_size(),
+						 0, prandom_u32_state(&rnd) %
+						 TEST_COLORS,
+						 DRM_MM_SEARCH_DEFAULT,
+						 DRM_MM_CREATE_DEFAULT);
+		if (ret) {
+			pr_err("color insert %u failed: %d\n", i, ret);
+			goto err;
+		}
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ns_per_op(start, count);
+	report("color", count, &mm, "insert", ns);
+
+	/* churn, so that nodes end up next to freed holes of other colors */
+	shuffle(order, count);
+	for (i = 0; i < count / 2; i++)
+		drm_mm_remove_node(&nodes[order[i]]);
+
+	start = ktime_get();
+	for (i = 0; i < count / 2; i++) {
+		ret = drm_mm_insert_node_generic(&mm, &nodes[order[i]],
+						 random_size(), 0,
+						 prandom_u32_state(&rnd) %
+						 TEST_COLORS,
+						 DRM_MM_SEARCH_DEFAULT,
+						 DRM_MM_CREATE_DEFAULT);
+		if (ret) {
+			pr_err("color reinsert %u failed: %d\n", i, ret);
+			goto err;
+		}
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ns_per_op(start, count / 2);
+	report("color", count, &mm, "reinsert", ns);
+	if (!check_mm(&mm, count))
+		goto err;
+
+	drm_mm_for_each_node(node, &mm) {
+		if (prev && prev->color != node->color &&
+		    node->start < prev->start + prev->size + TEST_COLOR_GUARD) {
+			pr_err("color %lu at 0x%lx follows color %lu at 0x%lx+0x%lx without guard\n",
+			       node->color, node->start, prev->color,
+			       prev->start, prev->size);
+			goto err;
+		}
+		prev = node;
+	}
+
+	for (i = 0; i < count; i++)
+		drm_mm_remove_node(&nodes[i]);
+	drm_mm_takedown(&mm);
+	return 0;
+
+err:
+	drm_mm_debug_table(&mm, "drm_mm");
+	return -EINVAL;
+}
+
+struct evict_node {
+	struct drm_mm_node node;
+	struct list_head link;
+	struct list_head evict;
+};
+
+/*
+ * Fill the allocator completely, then make room for random sizes by
+ * scanning an LRU the way i915_gem_evict_something() does.
+ */
+static int test_evict(unsigned int count)
+{
+	unsigned int rounds = count / 10, i, pool_size = count + rounds;
+	unsigned long scanned = 0, evicted = 0, size;
+	struct evict_node *pool, *e, *tmp;
+	LIST_HEAD(lru);
+	LIST_HEAD(unused);
+	LIST_HEAD(evict_list);
+	struct drm_mm mm;
+	unsigned long total = 0;
+	ktime_t start;
+	u64 ns;
+	int ret = -EINVAL;
+
+	pool = vzalloc(pool_size * sizeof(*pool));
+	if (!pool)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		pool[i].node.size = random_size();
+		pool[i].node.start = total;
+		total += pool[i].node.size;
+	}
+	for (; i < pool_size; i++)
+		list_add(&pool[i].link, &unused);
+
+	memset(&mm, 0, sizeof(mm));
+	drm_mm_init(&mm, 0, total);
+	for (i = 0; i < count; i++) {
+		if (drm_mm_reserve_node(&mm, &pool[i].node)) {
+			pr_err("evict fill %u failed\n", i);
+			goto out;
+		}
+		list_add_tail(&pool[i].link, &lru);
+	}
+
+	start = ktime_get();
+	for (i = 0; i < rounds; i++) {
+		bool found = false;
+
+		size = random_size() * 4;
+		drm_mm_init_scan(&mm, size, 0, 0);
+		list_for_each_entry(e, &lru, link) {
+			list_add(&e->evict, &evict_list);
+			scanned++;
+			if (drm_mm_scan_add_block(&e->node)) {
+				found = true;
+				break;
+			}
+		}
+
+		/* reverse order of adding, keeping only what must go */
+		list_for_each_entry_safe(e, tmp, &evict_list, evict) {
+			if (!drm_mm_scan_remove_block(&e->node))
+				list_del(&e->evict);
+		}
+		if (!found) {
+			pr_err("evict round %u: no room for 0x%lx\n", i, size);
+			goto out;
+		}
+
+		list_for_each_entry_safe(e, tmp, &evict_list, evict) {
+			list_del(&e->evict);
+			drm_mm_remove_node(&e->node);
+			list_move(&e->link, &unused);
+			evicted++;
+		}
+
+		e = list_first_entry(&unused, struct evict_node, link);
+		memset(&e->node, 0, sizeof(e->node));
+		if (drm_mm_insert_node_generic(&mm, &e->node, size, 0, 0,
+					       DRM_MM_SEARCH_DEFAULT,
+					       DRM_MM_CREATE_DEFAULT)) {
+			pr_err("evict round %u: insert of 0x%lx failed after eviction\n",
+			       i, size);
+			goto out;
+		}
+		list_move_tail(&e->link, &lru);
+
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ns_per_op(start, rounds);
+	report("evict", count, &mm, "scan+evict+insert", ns);
+	pr_info("evict, %u nodes: %lu scanned, %lu evicted per 1000 rounds\n",
+		count, rounds ? scanned * 1000 / rounds : 0,
+		rounds ? evicted * 1000 / rounds : 0);
+
+	ret = 0;
+out:
+	if (ret)
+		drm_mm_debug_table(&mm, "drm_mm");
+	list_for_each_entry(e, &lru, link)
+		drm_mm_remove_node(&e->node);
+	drm_mm_takedown(&mm);
+	vfree(pool);
+	return ret;
+}
+
+static int test_drm_mm_run(unsigned int count)
+{
+	struct drm_mm_node *nodes;
+	unsigned int *order;
+	int ret = -ENOMEM;
+
+	nodes = vmalloc(count * sizeof(*nodes));
+	order = vmalloc(count * sizeof(*order));
+	if (!nodes || !order) {
+		pr_err("out of memory for %u nodes\n", count);
+		goto out;
+	}
+
+	ret = test_insert(nodes, order, count);
+	if (!ret)
+		ret = test_insert_range(nodes, count);
+	if (!ret)
+		ret = test_reserve(nodes, order, count);
+	if (!ret)
+		ret = test_color(nodes, order, count);
+	if (!ret)
+		ret = test_evict(count);
+
+out:
+	vfree(order);
+	vfree(nodes);
+	return ret;
+}
+
+static int __init test_drm_mm_init(void)
+{
+	unsigned int count;
+	int ret;
+
+	if (!random_seed)
+		random_seed = get_random_int();
+	prandom_seed_state(&rnd, random_seed);
+	pr_info("random_seed %u\n", random_seed);
+
+	for (count = 1000; count <= min(max_nodes, 10000000u); count *= 10) {
+		ret = test_drm_mm_run(count);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static void __exit test_drm_mm_exit(void)
+{
+}
+
+module_init(test_drm_mm_init);
+module_exit(test_drm_mm_exit);
+
+MODULE_DESCRIPTION("drm_mm selftests and benchmark");
+MODULE_LICENSE("GPL and additional rights");
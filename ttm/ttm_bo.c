@@ -41,6 +41,12 @@
 #include <linux/module.h>
 #include <linux/atomic.h>
 #include <linux/reservation.h>
+#include <linux/llist.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/seq_file.h>
+
+#include "ttm_trace.h"
 
 #define TTM_ASSERT_LOCKED(param)
 #define TTM_DEBUG(fmt, arg...)
@@ -54,6 +60,21 @@ static struct attribute ttm_bo_count = {
 	.mode = S_IRUGO
 };
 
+static struct attribute ttm_bo_ddestroy_pending = {
+	.name = "ddestroy_pending",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_ddestroy_released = {
+	.name = "ddestroy_released",
+	.mode = S_IRUGO
+};
+
+static struct attribute ttm_bo_ddestroy_latency = {
+	.name = "ddestroy_latency_us",
+	.mode = S_IRUGO
+};
+
 static inline int ttm_mem_type_from_place(const struct ttm_place *place,
 					  uint32_t *mem_type)
 {
@@ -107,13 +128,29 @@ static ssize_t ttm_bo_global_show(struct kobject *kobj,
 {
 	struct ttm_bo_global *glob =
 		container_of(kobj, struct ttm_bo_global, kobj);
+	unsigned long val, released;
+
+	if (attr == &ttm_bo_ddestroy_pending) {
+		val = atomic_read(&glob->ddestroy_count);
+	} else if (attr == &ttm_bo_ddestroy_released) {
+		val = atomic_long_read(&glob->ddestroy_released);
+	} else if (attr == &ttm_bo_ddestroy_latency) {
+		/* average time from queueing to release */
+		released = atomic_long_read(&glob->ddestroy_released);
+		val = atomic_long_read(&glob->ddestroy_latency_us);
+		val = released ? val / released : 0;
+	} else {
+		val = atomic_read(&glob->bo_count);
+	}
 
-	return snprintf(buffer, PAGE_SIZE, "%lu\n",
-			(unsigned long) atomic_read(&glob->bo_count));
+	return snprintf(buffer, PAGE_SIZE, "%lu\n", val);
 }
 
 static struct attribute *ttm_bo_global_attrs[] = {
 	&ttm_bo_count,
+	&ttm_bo_ddestroy_pending,
+	&ttm_bo_ddestroy_released,
+	&ttm_bo_ddestroy_latency,
 	NULL
 };
 
@@ -161,6 +198,31 @@ static void ttm_bo_release_list(struct kref *list_kref)
 	ttm_mem_global_free(bdev->glob->mem_glob, acc_size);
 }
 
+static bool ttm_mem_type_lru_empty(struct ttm_mem_type_manager *man)
+{
+	unsigned i;
+
+	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i)
+		if (!list_empty(&man->lru[i]))
+			return false;
+
+	return true;
+}
+
+/*
+ * Let the driver pick the LRU bucket, it may depend on the placement the
+ * buffer just got.
+ */
+static void ttm_bo_update_priority(struct ttm_buffer_object *bo)
+{
+	struct ttm_bo_driver *driver = bo->bdev->driver;
+
+	if (driver->lru_priority)
+		bo->priority = driver->lru_priority(bo);
+	if (bo->priority >= TTM_MAX_BO_PRIORITY)
+		bo->priority = TTM_MAX_BO_PRIORITY - 1;
+}
+
 void ttm_bo_add_to_lru(struct ttm_buffer_object *bo)
 {
 	struct ttm_bo_device *bdev = bo->bdev;
@@ -172,8 +234,9 @@ void ttm_bo_add_to_lru(struct ttm_buffer_object *bo)
 
 		BUG_ON(!list_empty(&bo->lru));
 
+		ttm_bo_update_priority(bo);
 		man = &bdev->man[bo->mem.mem_type];
-		list_add_tail(&bo->lru, &man->lru);
+		list_add_tail(&bo->lru, &man->lru[bo->priority]);
 		kref_get(&bo->list_kref);
 
 		if (bo->ttm != NULL) {
@@ -184,6 +247,75 @@ void ttm_bo_add_to_lru(struct ttm_buffer_object *bo)
 }
 EXPORT_SYMBOL(ttm_bo_add_to_lru);
 
+void ttm_lru_bulk_move_init(struct ttm_lru_bulk_move *bulk)
+{
+	unsigned i, j;
+
+	for (i = 0; i < TTM_NUM_MEM_TYPES; ++i)
+		for (j = 0; j < TTM_MAX_BO_PRIORITY; ++j)
+			INIT_LIST_HEAD(&bulk->lru[i][j]);
+	INIT_LIST_HEAD(&bulk->swap);
+}
+EXPORT_SYMBOL(ttm_lru_bulk_move_init);
+
+/**
+ * ttm_bo_bulk_add_to_lru - Collect a buffer for a bulk LRU move.
+ *
+ * @bo: The buffer, reserved and not on any LRU list.
+ * @bulk: The bulk move to collect it on.
+ *
+ * Like ttm_bo_add_to_lru(), but the buffer is queued on private lists of
+ * @bulk. Nobody else touches the LRU links of a reserved buffer which isn't
+ * on the LRU, so this doesn't need the lru_lock. The buffer must stay
+ * reserved until ttm_lru_bulk_move_tail() has been called.
+ */
+void ttm_bo_bulk_add_to_lru(struct ttm_buffer_object *bo,
+			    struct ttm_lru_bulk_move *bulk)
+{
+	lockdep_assert_held(&bo->resv->lock.base);
+
+	if (bo->mem.placement & TTM_PL_FLAG_NO_EVICT)
+		return;
+
+	BUG_ON(!list_empty(&bo->lru));
+
+	ttm_bo_update_priority(bo);
+	list_add_tail(&bo->lru, &bulk->lru[bo->mem.mem_type][bo->priority]);
+	kref_get(&bo->list_kref);
+
+	if (bo->ttm != NULL) {
+		list_add_tail(&bo->swap, &bulk->swap);
+		kref_get(&bo->list_kref);
+	}
+}
+EXPORT_SYMBOL(ttm_bo_bulk_add_to_lru);
+
+/**
+ * ttm_lru_bulk_move_tail - Move all buffers of a bulk move to the LRU tails.
+ *
+ * @bdev: The device all buffers of @bulk belong to.
+ * @bulk: The bulk move.
+ *
+ * Splices each of the collected lists in one go, so the cost doesn't depend
+ * on the number of buffers, and the buffers keep a contiguous position on
+ * each LRU. Must be called with the lru_lock held, @bulk is empty again
+ * afterwards.
+ */
+void ttm_lru_bulk_move_tail(struct ttm_bo_device *bdev,
+			    struct ttm_lru_bulk_move *bulk)
+{
+	unsigned i, j;
+
+	lockdep_assert_held(&bdev->glob->lru_lock);
+
+	for (i = 0; i < TTM_NUM_MEM_TYPES; ++i)
+		for (j = 0; j < TTM_MAX_BO_PRIORITY; ++j)
+			list_splice_tail_init(&bulk->lru[i][j],
+					      &bdev->man[i].lru[j]);
+	list_splice_tail_init(&bulk->swap, &bdev->glob->swap_lru);
+}
+EXPORT_SYMBOL(ttm_lru_bulk_move_tail);
+
 int ttm_bo_del_from_lru(struct ttm_buffer_object *bo)
 {
 	int put_count = 0;
@@ -423,10 +555,124 @@ static void ttm_bo_flush_all_fences(struct ttm_buffer_object *bo)
 	}
 }
 
+/*
+ * Find a fence of @bo which hasn't signaled yet, the exclusive one first.
+ * Must be called with the reservation held.
+ */
+static struct fence *ttm_bo_busy_fence(struct ttm_buffer_object *bo)
+{
+	struct reservation_object_list *fobj;
+	struct fence *fence;
+	int i;
+
+	fence = reservation_object_get_excl(bo->resv);
+	if (fence && !fence_is_signaled(fence))
+		return fence;
+
+	fobj = reservation_object_get_list(bo->resv);
+	for (i = 0; fobj && i < fobj->shared_count; ++i) {
+		fence = rcu_dereference_protected(fobj->shared[i],
+					reservation_object_held(bo->resv));
+
+		if (!fence_is_signaled(fence))
+			return fence;
+	}
+
+	return NULL;
+}
+
+static void ttm_bo_ddestroy_cb(struct fence *fence, struct fence_cb *cb)
+{
+	struct ttm_buffer_object *bo =
+	    container_of(cb, struct ttm_buffer_object, ddestroy_cb);
+	struct ttm_bo_device *bdev = bo->bdev;
+
+	/*
+	 * Everything signaling until the worker runs is released in one
+	 * batch, so only the first one needs to kick it. While the driver
+	 * holds the delayed workqueue locked, the batch just collects and
+	 * ttm_bo_unlock_delayed_workqueue() kicks it.
+	 */
+	if (llist_add(&bo->ddestroy_node, &bdev->ddestroy_ready) &&
+	    !READ_ONCE(bdev->ddestroy_blocked))
+		schedule_work(&bdev->ddestroy_work);
+}
+
+/*
+ * Arm a callback on the next busy fence of @bo. Must be called with the
+ * reservation held. Returns false if @bo is idle.
+ */
+static bool ttm_bo_ddestroy_arm(struct ttm_buffer_object *bo)
+{
+	struct fence *fence = ttm_bo_busy_fence(bo);
+
+	if (!fence)
+		return false;
+
+	bo->ddestroy_fence = fence_get(fence);
+	if (fence_add_callback(fence, &bo->ddestroy_cb, ttm_bo_ddestroy_cb))
+		ttm_bo_ddestroy_cb(fence, &bo->ddestroy_cb);
+
+	return true;
+}
+
+/*
+ * Let the fences of @bo drive its delayed destruction instead of polling
+ * from ttm_bo_delayed_workqueue. The callback owns a list reference until
+ * the buffer has been released by ttm_bo_ddestroy_work.
+ *
+ * Must be called with lru_lock and the reservation held, returns false if
+ * there was nothing to wait for.
+ */
+static bool ttm_bo_ddestroy_queue(struct ttm_buffer_object *bo)
+{
+	struct ttm_bo_device *bdev = bo->bdev;
+	struct ttm_bo_global *glob = bo->glob;
+	int pending;
+
+	kref_get(&bo->list_kref);
+	pending = atomic_inc_return(&bdev->ddestroy_pending);
+	atomic_inc(&glob->ddestroy_count);
+	bo->ddestroy_time = ktime_get();
+
+	if (!ttm_bo_ddestroy_arm(bo)) {
+		atomic_dec(&glob->ddestroy_count);
+		atomic_dec(&bdev->ddestroy_pending);
+		ttm_bo_list_ref_sub(bo, 1, true);
+		return false;
+	}
+
+	trace_ttm_bo_ddestroy_queue(bo, pending);
+	return true;
+}
+
+/* Drop the reference of the fence callback, and account for the latency. */
+static void ttm_bo_ddestroy_done(struct ttm_buffer_object *bo)
+{
+	struct ttm_bo_device *bdev = bo->bdev;
+	struct ttm_bo_global *glob = bo->glob;
+	s64 latency = ktime_us_delta(ktime_get(), bo->ddestroy_time);
+
+	trace_ttm_bo_ddestroy_release(bo, latency);
+	atomic_long_inc(&glob->ddestroy_released);
+	atomic_long_add(latency, &glob->ddestroy_latency_us);
+	atomic_dec(&glob->ddestroy_count);
+
+	kref_put(&bo->list_kref, ttm_bo_release_list);
+	/*
+	 * bdev must stay around until the last pending buffer is gone.
+	 * ttm_bo_device_release() flushes this worker after the wait, so
+	 * waking it up here is safe.
+	 */
+	if (atomic_dec_and_test(&bdev->ddestroy_pending))
+		wake_up_all(&bdev->ddestroy_idle);
+}
+
 static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 {
 	struct ttm_bo_device *bdev = bo->bdev;
 	struct ttm_bo_global *glob = bo->glob;
+	bool queued = false;
 	int put_count;
 	int ret;
 
@@ -455,16 +701,21 @@ static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 			bo->mem.placement &= ~TTM_PL_FLAG_NO_EVICT;
 			ttm_bo_add_to_lru(bo);
 		}
-
-		__ttm_bo_unreserve(bo);
 	}
 
 	kref_get(&bo->list_kref);
 	list_add_tail(&bo->ddestroy, &bdev->ddestroy);
+
+	if (!ret) {
+		queued = ttm_bo_ddestroy_queue(bo);
+		__ttm_bo_unreserve(bo);
+	}
 	spin_unlock(&glob->lru_lock);
 
-	schedule_delayed_work(&bdev->wq,
-			      ((HZ / 100) < 1) ? 1 : HZ / 100);
+	/* Only poll if we couldn't hook into the fences */
+	if (!queued)
+		schedule_delayed_work(&bdev->wq,
+				      ((HZ / 100) < 1) ? 1 : HZ / 100);
 }
 
 /**
@@ -546,6 +797,58 @@ static int ttm_bo_cleanup_refs_and_unlock(struct ttm_buffer_object *bo,
 	return 0;
 }
 
+/*
+ * Release the batch of buffers whose fences signaled since the last run.
+ * Buffers with more busy fences are armed again, buffers whose reservation
+ * is contended are left to ttm_bo_delayed_workqueue.
+ */
+static void ttm_bo_ddestroy_work(struct work_struct *work)
+{
+	struct ttm_bo_device *bdev =
+	    container_of(work, struct ttm_bo_device, ddestroy_work);
+	struct ttm_bo_global *glob = bdev->glob;
+	struct ttm_buffer_object *bo, *next;
+	struct llist_node *batch;
+	unsigned released = 0, requeued = 0;
+	bool poll = false;
+
+	/*
+	 * A fence callback may have kicked us just before the delayed
+	 * workqueue was locked; leave the batch for the unlock.
+	 */
+	if (READ_ONCE(bdev->ddestroy_blocked))
+		return;
+
+	batch = llist_del_all(&bdev->ddestroy_ready);
+	llist_for_each_entry_safe(bo, next, batch, ddestroy_node) {
+		fence_put(bo->ddestroy_fence);
+		bo->ddestroy_fence = NULL;
+
+		spin_lock(&glob->lru_lock);
+		if (__ttm_bo_reserve(bo, false, true, false, NULL)) {
+			spin_unlock(&glob->lru_lock);
+			poll = true;
+		} else if (!list_empty(&bo->ddestroy) &&
+			   ttm_bo_ddestroy_arm(bo)) {
+			__ttm_bo_unreserve(bo);
+			spin_unlock(&glob->lru_lock);
+			++requeued;
+			continue;
+		} else {
+			ttm_bo_cleanup_refs_and_unlock(bo, false, true);
+		}
+
+		ttm_bo_ddestroy_done(bo);
+		++released;
+	}
+
+	trace_ttm_bo_ddestroy_batch(released, requeued);
+
+	if (poll)
+		schedule_delayed_work(&bdev->wq,
+				      ((HZ / 100) < 1) ? 1 : HZ / 100);
+}
+
 /**
  * Traverse the delayed list, and call ttm_bo_cleanup_refs on all
  * encountered buffers.
@@ -644,15 +947,31 @@ EXPORT_SYMBOL(ttm_bo_unref);
 
 int ttm_bo_lock_delayed_workqueue(struct ttm_bo_device *bdev)
 {
-	return cancel_delayed_work_sync(&bdev->wq);
+	int pending;
+
+	/*
+	 * Fence callbacks keep signaling while we are locked, e.g. when a
+	 * GPU reset force-completes the fences, so cancelling the work is
+	 * not enough to keep it from running again.
+	 */
+	WRITE_ONCE(bdev->ddestroy_blocked, true);
+	smp_mb();
+	pending = cancel_work_sync(&bdev->ddestroy_work);
+
+	return cancel_delayed_work_sync(&bdev->wq) | pending;
 }
 EXPORT_SYMBOL(ttm_bo_lock_delayed_workqueue);
 
 void ttm_bo_unlock_delayed_workqueue(struct ttm_bo_device *bdev, int resched)
 {
+	WRITE_ONCE(bdev->ddestroy_blocked, false);
+	smp_mb();
+
 	if (resched)
 		schedule_delayed_work(&bdev->wq,
 				      ((HZ / 100) < 1) ? 1 : HZ / 100);
+	if (resched || !llist_empty(&bdev->ddestroy_ready))
+		schedule_work(&bdev->ddestroy_work);
 }
 EXPORT_SYMBOL(ttm_bo_unlock_delayed_workqueue);
 
@@ -717,25 +1036,34 @@ static int ttm_mem_evict_first(struct ttm_bo_device *bdev,
 	struct ttm_mem_type_manager *man = &bdev->man[mem_type];
 	struct ttm_buffer_object *bo;
 	int ret = -EBUSY, put_count;
+	unsigned i;
 
 	spin_lock(&glob->lru_lock);
-	list_for_each_entry(bo, &man->lru, lru) {
-		ret = __ttm_bo_reserve(bo, false, true, false, NULL);
-		if (!ret) {
-			if (place && (place->fpfn || place->lpfn)) {
-				/* Don't evict this BO if it's outside of the
-				 * requested placement range
-				 */
-				if (place->fpfn >= (bo->mem.start + bo->mem.size) ||
-				    (place->lpfn && place->lpfn <= bo->mem.start)) {
-					__ttm_bo_unreserve(bo);
-					ret = -EBUSY;
-					continue;
+	/* Drain the lowest priority bucket first */
+	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
+		list_for_each_entry(bo, &man->lru[i], lru) {
+			ret = __ttm_bo_reserve(bo, false, true, false, NULL);
+			if (!ret) {
+				if (place && (place->fpfn || place->lpfn)) {
+					/* Don't evict this BO if it's outside
+					 * of the requested placement range
+					 */
+					if (place->fpfn >= (bo->mem.start +
+							    bo->mem.size) ||
+					    (place->lpfn &&
+					     place->lpfn <= bo->mem.start)) {
+						__ttm_bo_unreserve(bo);
+						ret = -EBUSY;
+						continue;
+					}
 				}
+
+				break;
 			}
+		}
 
+		if (!ret)
 			break;
-		}
 	}
 
 	if (ret) {
@@ -762,6 +1090,12 @@ static int ttm_mem_evict_first(struct ttm_bo_device *bdev,
 	ret = ttm_bo_evict(bo, interruptible, no_wait_gpu);
 	ttm_bo_unreserve(bo);
 
+	if (!ret) {
+		spin_lock(&glob->lru_lock);
+		man->lru_evictions[i]++;
+		spin_unlock(&glob->lru_lock);
+	}
+
 	kref_put(&bo->list_kref, ttm_bo_release_list);
 	return ret;
 }
@@ -1245,7 +1579,7 @@ static int ttm_bo_force_list_clean(struct ttm_bo_device *bdev,
 	 */
 
 	spin_lock(&glob->lru_lock);
-	while (!list_empty(&man->lru)) {
+	while (!ttm_mem_type_lru_empty(man)) {
 		spin_unlock(&glob->lru_lock);
 		ret = ttm_mem_evict_first(bdev, mem_type, NULL, false, false);
 		if (ret) {
@@ -1315,6 +1649,7 @@ int ttm_bo_init_mm(struct ttm_bo_device *bdev, unsigned type,
 {
 	int ret = -EINVAL;
 	struct ttm_mem_type_manager *man;
+	unsigned i;
 
 	BUG_ON(type >= TTM_NUM_MEM_TYPES);
 	man = &bdev->man[type];
@@ -1339,12 +1674,60 @@ int ttm_bo_init_mm(struct ttm_bo_device *bdev, unsigned type,
 	man->use_type = true;
 	man->size = p_size;
 
-	INIT_LIST_HEAD(&man->lru);
+	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
+		INIT_LIST_HEAD(&man->lru[i]);
+		man->lru_evictions[i] = 0;
+	}
 
 	return 0;
 }
 EXPORT_SYMBOL(ttm_bo_init_mm);
 
+#if defined(CONFIG_DEBUG_FS)
+/**
+ * ttm_bo_lru_dump_table - Dump the LRU buckets of all memory types.
+ *
+ * @m: seq_file to dump to.
+ * @bdev: The device.
+ *
+ * Shows the number of buffers and pages on each priority bucket, and how
+ * many buffers have been evicted from it.
+ */
+int ttm_bo_lru_dump_table(struct seq_file *m, struct ttm_bo_device *bdev)
+{
+	struct ttm_bo_global *glob = bdev->glob;
+	struct ttm_buffer_object *bo;
+	unsigned i, prio;
+
+	seq_printf(m, "%4s %4s %8s %10s %10s\n",
+		   "type", "prio", "bos", "pages", "evictions");
+
+	spin_lock(&glob->lru_lock);
+	for (i = 0; i < TTM_NUM_MEM_TYPES; ++i) {
+		struct ttm_mem_type_manager *man = &bdev->man[i];
+
+		if (!man->has_type)
+			continue;
+
+		for (prio = 0; prio < TTM_MAX_BO_PRIORITY; ++prio) {
+			unsigned long bos = 0, pages = 0;
+
+			list_for_each_entry(bo, &man->lru[prio], lru) {
+				++bos;
+				pages += bo->num_pages;
+			}
+
+			seq_printf(m, "%4u %4u %8lu %10lu %10lu\n", i, prio,
+				   bos, pages, man->lru_evictions[prio]);
+		}
+	}
+	spin_unlock(&glob->lru_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(ttm_bo_lru_dump_table);
+#endif
+
 static void ttm_bo_global_kobj_release(struct kobject *kobj)
 {
 	struct ttm_bo_global *glob =
@@ -1392,6 +1775,9 @@ int ttm_bo_global_init(struct drm_global_reference *ref)
 	}
 
 	atomic_set(&glob->bo_count, 0);
+	atomic_set(&glob->ddestroy_count, 0);
+	atomic_long_set(&glob->ddestroy_released, 0);
+	atomic_long_set(&glob->ddestroy_latency_us, 0);
 
 	ret = kobject_init_and_add(
 		&glob->kobj, &ttm_bo_glob_kobj_type, ttm_get_kobj(), "buffer_objects");
@@ -1436,11 +1822,20 @@ int ttm_bo_device_release(struct ttm_bo_device *bdev)
 	while (ttm_bo_delayed_delete(bdev, true))
 		;
 
+	/*
+	 * Everything is idle now, but the fence callbacks may still be on
+	 * their way to the worker. Wait for them to drop their references,
+	 * then for the worker to stop touching bdev.
+	 */
+	wait_event(bdev->ddestroy_idle,
+		   !atomic_read(&bdev->ddestroy_pending));
+	flush_work(&bdev->ddestroy_work);
+
 	spin_lock(&glob->lru_lock);
 	if (list_empty(&bdev->ddestroy))
 		TTM_DEBUG("Delayed destroy list was clean\n");
 
-	if (list_empty(&bdev->man[0].lru))
+	if (ttm_mem_type_lru_empty(&bdev->man[0]))
 		TTM_DEBUG("Swap list was clean\n");
 	spin_unlock(&glob->lru_lock);
 
@@ -1475,6 +1870,11 @@ int ttm_bo_device_init(struct ttm_bo_device *bdev,
 				    0x10000000);
 	INIT_DELAYED_WORK(&bdev->wq, ttm_bo_delayed_workqueue);
 	INIT_LIST_HEAD(&bdev->ddestroy);
+	init_llist_head(&bdev->ddestroy_ready);
+	INIT_WORK(&bdev->ddestroy_work, ttm_bo_ddestroy_work);
+	atomic_set(&bdev->ddestroy_pending, 0);
+	init_waitqueue_head(&bdev->ddestroy_idle);
+	bdev->ddestroy_blocked = false;
 	bdev->dev_mapping = mapping;
 	bdev->glob = glob;
 	bdev->need_dma32 = need_dma32;
@@ -38,6 +38,17 @@
 #include <linux/vmalloc.h>
 #include <linux/module.h>
 #include <linux/reservation.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
+
+#ifdef CONFIG_X86
+#include <asm/cpufeature.h>
+#include <asm/i387.h>
+#endif
+
+/* CPU moves at least this large are split across worker threads */
+#define TTM_MEMCPY_SPLIT_PAGES	1024
+#define TTM_MEMCPY_MAX_JOBS	4
 
 void ttm_bo_free_old_node(struct ttm_buffer_object *bo)
 {
@@ -234,6 +245,48 @@ static void ttm_mem_reg_iounmap(struct ttm_bo_device *bdev, struct ttm_mem_reg *
 	ttm_mem_io_unlock(man);
 }
 
+#ifdef CONFIG_X86
+/*
+ * Copy with streaming loads and stores. Reads from WC mappings like VRAM
+ * are uncached, movntdqa pulls in a whole line through the streaming load
+ * buffers instead of one bus access per word. The stores bypass the cache,
+ * nobody is going to look at the data of a buffer being moved soon.
+ *
+ * Both pointers and @len must be 16 byte aligned, the caller has to fence.
+ * Returns false if the CPU or context can't do it.
+ */
+static bool ttm_memcpy_stream(void *dst, const void *src, unsigned long len)
+{
+	if (!static_cpu_has(X86_FEATURE_XMM4_1) || !irq_fpu_usable() ||
+	    (((unsigned long)dst | (unsigned long)src | len) & 15))
+		return false;
+
+	kernel_fpu_begin();
+	for (; len >= 64; len -= 64, src += 64, dst += 64)
+		asm("movntdqa   (%0), %%xmm0\n"
+		    "movntdqa 16(%0), %%xmm1\n"
+		    "movntdqa 32(%0), %%xmm2\n"
+		    "movntdqa 48(%0), %%xmm3\n"
+		    "movntdq %%xmm0,   (%1)\n"
+		    "movntdq %%xmm1, 16(%1)\n"
+		    "movntdq %%xmm2, 32(%1)\n"
+		    "movntdq %%xmm3, 48(%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+	for (; len; len -= 16, src += 16, dst += 16)
+		asm("movntdqa (%0), %%xmm0\n"
+		    "movntdq %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+	kernel_fpu_end();
+
+	return true;
+}
+#else
+static bool ttm_memcpy_stream(void *dst, const void *src, unsigned long len)
+{
+	return false;
+}
+#endif
+
 static int ttm_copy_io_page(void *dst, void *src, unsigned long page)
 {
 	uint32_t *dstP =
@@ -242,6 +295,10 @@ static int ttm_copy_io_page(void *dst, void *src, unsigned long page)
 	    (uint32_t *) ((unsigned long)src + (page << PAGE_SHIFT));
 
 	int i;
+
+	if (ttm_memcpy_stream(dstP, srcP, PAGE_SIZE))
+		return 0;
+
 	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); ++i)
 		iowrite32(ioread32(srcP++), dstP++);
 	return 0;
@@ -270,7 +327,8 @@ static int ttm_copy_io_ttm_page(struct ttm_tt *ttm, void *src,
 	if (!dst)
 		return -ENOMEM;
 
-	memcpy_fromio(dst, src, PAGE_SIZE);
+	if (!ttm_memcpy_stream(dst, src, PAGE_SIZE))
+		memcpy_fromio(dst, src, PAGE_SIZE);
 
 #ifdef CONFIG_X86
 	kunmap_atomic(dst);
@@ -306,7 +364,8 @@ static int ttm_copy_ttm_io_page(struct ttm_tt *ttm, void *dst,
 	if (!src)
 		return -ENOMEM;
 
-	memcpy_toio(dst, src, PAGE_SIZE);
+	if (!ttm_memcpy_stream(dst, src, PAGE_SIZE))
+		memcpy_toio(dst, src, PAGE_SIZE);
 
 #ifdef CONFIG_X86
 	kunmap_atomic(src);
@@ -320,6 +379,112 @@ static int ttm_copy_ttm_io_page(struct ttm_tt *ttm, void *dst,
 	return 0;
 }
 
+/**
+ * struct ttm_memcpy_job - A range of pages to copy for ttm_bo_move_memcpy.
+ *
+ * @work: To run the job on a worker thread.
+ * @ttm: The ttm on the system memory side, if any.
+ * @old_iomap: Mapping of the old placement, NULL for a ttm.
+ * @new_iomap: Mapping of the new placement, NULL for a ttm.
+ * @prot: Page protection for mapping the ttm pages.
+ * @first: First page to copy.
+ * @count: Number of pages to copy.
+ * @dir: 1 to copy upwards from @first, -1 to copy downwards.
+ * @ret: Result of the copy.
+ */
+struct ttm_memcpy_job {
+	struct work_struct work;
+	struct ttm_tt *ttm;
+	void *old_iomap;
+	void *new_iomap;
+	pgprot_t prot;
+	unsigned long first;
+	unsigned long count;
+	int dir;
+	int ret;
+};
+
+static int ttm_memcpy_pages(struct ttm_memcpy_job *job)
+{
+	unsigned long i, page;
+	int ret = 0;
+
+	for (i = 0; i < job->count; ++i) {
+		page = job->first + i * job->dir;
+		if (job->old_iomap == NULL)
+			ret = ttm_copy_ttm_io_page(job->ttm, job->new_iomap,
+						   page, job->prot);
+		else if (job->new_iomap == NULL)
+			ret = ttm_copy_io_ttm_page(job->ttm, job->old_iomap,
+						   page, job->prot);
+		else
+			ret = ttm_copy_io_page(job->new_iomap, job->old_iomap,
+					       page);
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+static void ttm_memcpy_work(struct work_struct *work)
+{
+	struct ttm_memcpy_job *job =
+		container_of(work, struct ttm_memcpy_job, work);
+
+	job->ret = ttm_memcpy_pages(job);
+	/* Drain our streaming stores before the mover looks at the result */
+	wmb();
+}
+
+/*
+ * Copy @num_pages pages described by @tmpl. Large moves without overlap are
+ * split into ranges which are copied in parallel, since a single CPU can't
+ * saturate the bus on reads from VRAM.
+ */
+static int ttm_memcpy_split(struct ttm_memcpy_job *tmpl,
+			    unsigned long num_pages)
+{
+	struct ttm_memcpy_job jobs[TTM_MEMCPY_MAX_JOBS];
+	unsigned long chunk;
+	unsigned i, njobs = 1;
+	int ret;
+
+	if (tmpl->dir == 1 && num_pages >= TTM_MEMCPY_SPLIT_PAGES)
+		njobs = min_t(unsigned, num_online_cpus(),
+			      TTM_MEMCPY_MAX_JOBS);
+
+	if (njobs == 1) {
+		tmpl->count = num_pages;
+		return ttm_memcpy_pages(tmpl);
+	}
+
+	chunk = DIV_ROUND_UP(num_pages, njobs);
+	for (i = 0; i < njobs; ++i) {
+		jobs[i] = *tmpl;
+		jobs[i].first = i * chunk;
+		jobs[i].count = min(chunk, num_pages - jobs[i].first);
+		jobs[i].ret = 0;
+	}
+
+	/* Hand out all but the first range, which we copy ourselves */
+	for (i = 1; i < njobs; ++i) {
+		INIT_WORK_ONSTACK(&jobs[i].work, ttm_memcpy_work);
+		queue_work(system_unbound_wq, &jobs[i].work);
+	}
+
+	ret = ttm_memcpy_pages(&jobs[0]);
+
+	for (i = 1; i < njobs; ++i) {
+		flush_work(&jobs[i].work);
+		destroy_work_on_stack(&jobs[i].work);
+		if (!ret)
+			ret = jobs[i].ret;
+	}
+
+	return ret;
+}
+
 int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 		       bool evict, bool no_wait_gpu,
 		       struct ttm_mem_reg *new_mem)
@@ -329,13 +494,10 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 	struct ttm_tt *ttm = bo->ttm;
 	struct ttm_mem_reg *old_mem = &bo->mem;
 	struct ttm_mem_reg old_copy = *old_mem;
+	struct ttm_memcpy_job job;
 	void *old_iomap;
 	void *new_iomap;
 	int ret;
-	unsigned long i;
-	unsigned long page;
-	unsigned long add = 0;
-	int dir;
 
 	ret = ttm_mem_reg_ioremap(bdev, old_mem, &old_iomap);
 	if (ret)
@@ -369,32 +531,24 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 			goto out1;
 	}
 
-	add = 0;
-	dir = 1;
+	job.ttm = ttm;
+	job.old_iomap = old_iomap;
+	job.new_iomap = new_iomap;
+	job.prot = ttm_io_prot(old_iomap == NULL ? old_mem->placement :
+			       new_mem->placement, PAGE_KERNEL);
+	job.first = 0;
+	job.dir = 1;
 
 	if ((old_mem->mem_type == new_mem->mem_type) &&
 	    (new_mem->start < old_mem->start + old_mem->size)) {
-		dir = -1;
-		add = new_mem->num_pages - 1;
+		job.dir = -1;
+		job.first = new_mem->num_pages - 1;
 	}
 
-	for (i = 0; i < new_mem->num_pages; ++i) {
-		page = i * dir + add;
-		if (old_iomap == NULL) {
-			pgprot_t prot = ttm_io_prot(old_mem->placement,
-						    PAGE_KERNEL);
-			ret = ttm_copy_ttm_io_page(ttm, new_iomap, page,
-						   prot);
-		} else if (new_iomap == NULL) {
-			pgprot_t prot = ttm_io_prot(new_mem->placement,
-						    PAGE_KERNEL);
-			ret = ttm_copy_io_ttm_page(ttm, old_iomap, page,
-						   prot);
-		} else
-			ret = ttm_copy_io_page(new_iomap, old_iomap, page);
-		if (ret)
-			goto out1;
-	}
+	ret = ttm_memcpy_split(&job, new_mem->num_pages);
+	if (ret)
+		goto out1;
+	/* Also orders the streaming stores */
 	mb();
 out2:
 	old_copy = *old_mem;
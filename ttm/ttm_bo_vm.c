@@ -83,6 +83,44 @@ out_unlock:
 	return ret;
 }
 
+/*
+ * Number of pages to prefault from @page_offset on. When the faulting page
+ * is part of a physically contiguous, naturally aligned huge page run of the
+ * ttm which also lines up with the virtual address, the rest of the run is
+ * mapped in one go. We can't insert pmd entries for pfn mappings, so the run
+ * is still mapped with ptes, but it only costs a single fault.
+ */
+static unsigned long ttm_bo_vm_num_prefault(struct ttm_buffer_object *bo,
+					    unsigned long page_offset,
+					    unsigned long address)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	struct ttm_tt *ttm = bo->ttm;
+	unsigned long first = page_offset & ~(HPAGE_PMD_NR - 1);
+	unsigned long pfn, i;
+
+	if (bo->mem.bus.is_iomem ||
+	    ((address >> PAGE_SHIFT) ^ page_offset) & (HPAGE_PMD_NR - 1) ||
+	    first + HPAGE_PMD_NR > ttm->num_pages || !ttm->pages[first])
+		return TTM_BO_VM_NUM_PREFAULT;
+
+	pfn = page_to_pfn(ttm->pages[first]);
+	if (pfn & (HPAGE_PMD_NR - 1))
+		return TTM_BO_VM_NUM_PREFAULT;
+
+	for (i = 1; i < HPAGE_PMD_NR; ++i) {
+		if (!ttm->pages[first + i] ||
+		    page_to_pfn(ttm->pages[first + i]) != pfn + i)
+			return TTM_BO_VM_NUM_PREFAULT;
+	}
+
+	return max_t(unsigned long, first + HPAGE_PMD_NR - page_offset,
+		     TTM_BO_VM_NUM_PREFAULT);
+#else
+	return TTM_BO_VM_NUM_PREFAULT;
+#endif
+}
+
 static int ttm_bo_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct ttm_buffer_object *bo = (struct ttm_buffer_object *)
@@ -90,6 +128,7 @@ static int ttm_bo_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	struct ttm_bo_device *bdev = bo->bdev;
 	unsigned long page_offset;
 	unsigned long page_last;
+	unsigned long num_prefault;
 	unsigned long pfn;
 	struct ttm_tt *ttm = NULL;
 	struct page *page;
@@ -211,7 +250,8 @@ static int ttm_bo_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	 * Speculatively prefault a number of pages. Only error on
 	 * first page.
 	 */
-	for (i = 0; i < TTM_BO_VM_NUM_PREFAULT; ++i) {
+	num_prefault = ttm_bo_vm_num_prefault(bo, page_offset, address);
+	for (i = 0; i < num_prefault; ++i) {
 		if (bo->mem.bus.is_iomem)
 			pfn = ((bo->mem.bus.base + bo->mem.bus.offset) >> PAGE_SHIFT) + page_offset;
 		else {
@@ -54,26 +54,36 @@ static void ttm_eu_del_from_lru_locked(struct list_head *list)
 	}
 }
 
-void ttm_eu_backoff_reservation(struct ww_acquire_ctx *ticket,
-				struct list_head *list)
+/*
+ * Put all buffers of a reserved list back on the LRU tails with a single
+ * splice per LRU, then drop the reservations.
+ */
+static void ttm_eu_bulk_move_and_unreserve(struct list_head *list)
 {
+	struct ttm_lru_bulk_move bulk;
 	struct ttm_validate_buffer *entry;
-	struct ttm_bo_global *glob;
+	struct ttm_bo_device *bdev;
 
-	if (list_empty(list))
-		return;
+	ttm_lru_bulk_move_init(&bulk);
+	list_for_each_entry(entry, list, head)
+		ttm_bo_bulk_add_to_lru(entry->bo, &bulk);
 
-	entry = list_first_entry(list, struct ttm_validate_buffer, head);
-	glob = entry->bo->glob;
+	bdev = list_first_entry(list, struct ttm_validate_buffer, head)->bo->bdev;
+	spin_lock(&bdev->glob->lru_lock);
+	ttm_lru_bulk_move_tail(bdev, &bulk);
+	spin_unlock(&bdev->glob->lru_lock);
 
-	spin_lock(&glob->lru_lock);
-	list_for_each_entry(entry, list, head) {
-		struct ttm_buffer_object *bo = entry->bo;
+	list_for_each_entry(entry, list, head)
+		__ttm_bo_unreserve(entry->bo);
+}
 
-		ttm_bo_add_to_lru(bo);
-		__ttm_bo_unreserve(bo);
-	}
-	spin_unlock(&glob->lru_lock);
+void ttm_eu_backoff_reservation(struct ww_acquire_ctx *ticket,
+				struct list_head *list)
+{
+	if (list_empty(list))
+		return;
+
+	ttm_eu_bulk_move_and_unreserve(list);
 
 	if (ticket)
 		ww_acquire_fini(ticket);
@@ -184,30 +194,20 @@ void ttm_eu_fence_buffer_objects(struct ww_acquire_ctx *ticket,
 {
 	struct ttm_validate_buffer *entry;
 	struct ttm_buffer_object *bo;
-	struct ttm_bo_global *glob;
-	struct ttm_bo_device *bdev;
-	struct ttm_bo_driver *driver;
 
 	if (list_empty(list))
 		return;
 
-	bo = list_first_entry(list, struct ttm_validate_buffer, head)->bo;
-	bdev = bo->bdev;
-	driver = bdev->driver;
-	glob = bo->glob;
-
-	spin_lock(&glob->lru_lock);
-
+	/* The reservations protect the fences, no need for the lru_lock */
 	list_for_each_entry(entry, list, head) {
 		bo = entry->bo;
 		if (entry->shared)
 			reservation_object_add_shared_fence(bo->resv, fence);
 		else
 			reservation_object_add_excl_fence(bo->resv, fence);
-		ttm_bo_add_to_lru(bo);
-		__ttm_bo_unreserve(bo);
 	}
-	spin_unlock(&glob->lru_lock);
+
+	ttm_eu_bulk_move_and_unreserve(list);
 	if (ticket)
 		ww_acquire_fini(ticket);
 }
@@ -29,6 +29,12 @@
  * - Pool collects resently freed pages for reuse
  * - Use page->lru to keep a free list
  * - doesn't track currently in use pages
+ * - One set of pools per NUMA node, pages go back to the pool of their node
+ * - A small per-CPU magazine in front of the node pools keeps the common
+ *   single page populate/unpopulate off the shared pool locks
+ * - Large uc/wc ttms are backed by naturally aligned huge page runs where
+ *   possible. The runs are split into order 0 pages, changed to the right
+ *   caching in one go and pooled as a whole in the huge pools.
  */
 
 #define pr_fmt(fmt) "[TTM] " fmt
@@ -42,6 +48,9 @@
 #include <linux/seq_file.h> /* for seq_printf */
 #include <linux/slab.h>
 #include <linux/dma-mapping.h>
+#include <linux/percpu.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
 
 #include <linux/atomic.h>
 
@@ -57,6 +66,16 @@
 #define FREE_ALL_PAGES			(~0U)
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
+/* pages cached per CPU and pool type, moved to and from the pools in halves */
+#define MAGAZINE_SIZE			16
+#define MAGAZINE_BATCH			(MAGAZINE_SIZE / 2)
+/* huge page runs, only used when the kernel knows about PMD sized pages */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define HUGE_ORDER			HPAGE_PMD_ORDER
+#else
+#define HUGE_ORDER			0
+#endif
+#define HUGE_NR				(1U << HUGE_ORDER)
 
 /**
  * struct ttm_page_pool - Pool to reuse recently allocated uc/wc pages.
@@ -68,6 +87,7 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @nid: NUMA node the pages of this pool are allocated from.
  */
 struct ttm_page_pool {
 	spinlock_t		lock;
@@ -75,11 +95,41 @@ struct ttm_page_pool {
 	struct list_head	list;
 	gfp_t			gfp_flags;
 	unsigned		npages;
+	int			nid;
 	char			*name;
 	unsigned long		nfrees;
 	unsigned long		nrefills;
 };
 
+/**
+ * struct ttm_page_magazine - Per-CPU cache of pages in front of a pool.
+ *
+ * @lock: Protects the magazine. Only contended when the shrinker drains it.
+ * @npages: Number of pages in the magazine.
+ * @pages: The cached pages, all of them from the node of the CPU.
+ * @mag_hits: Pages handed out from the magazine.
+ * @pool_hits: Pages handed out from the node pool.
+ * @misses: Pages which had to be newly allocated.
+ * @remote: Newly allocated pages which came from another node.
+ * @huge_hits: Huge page runs handed out from a huge pool.
+ * @huge_allocs: Huge page runs newly allocated.
+ * @huge_fallbacks: Huge page runs which had to fall back to order 0 pages.
+ *
+ * The counters are only updated by the owning CPU.
+ */
+struct ttm_page_magazine {
+	spinlock_t		lock;
+	unsigned		npages;
+	struct page		*pages[MAGAZINE_SIZE];
+	unsigned long		mag_hits;
+	unsigned long		pool_hits;
+	unsigned long		misses;
+	unsigned long		remote;
+	unsigned long		huge_hits;
+	unsigned long		huge_allocs;
+	unsigned long		huge_fallbacks;
+};
+
 /**
  * Limits for the pool. They are handled without locks because only place where
  * they may change is in sysfs store. They won't have immediate effect anyway
@@ -93,6 +143,34 @@ struct ttm_pool_opts {
 };
 
 #define NUM_POOLS 4
+#define NUM_HUGE_POOLS 2
+
+/*
+ * The huge pools keep the head pages of whole runs on their list, npages
+ * still counts order 0 pages.
+ */
+struct ttm_node_pools {
+	union {
+		struct ttm_page_pool	pools[NUM_POOLS];
+		struct {
+			struct ttm_page_pool	wc_pool;
+			struct ttm_page_pool	uc_pool;
+			struct ttm_page_pool	wc_pool_dma32;
+			struct ttm_page_pool	uc_pool_dma32;
+		} ;
+	};
+	union {
+		struct ttm_page_pool	huge_pools[NUM_HUGE_POOLS];
+		struct {
+			struct ttm_page_pool	wc_pool_huge;
+			struct ttm_page_pool	uc_pool_huge;
+		} ;
+	};
+};
+
+struct ttm_cpu_magazines {
+	struct ttm_page_magazine	mag[NUM_POOLS];
+};
 
 /**
  * struct ttm_pool_manager - Holds memory pools for fst allocation
@@ -105,22 +183,16 @@ struct ttm_pool_opts {
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
  *
- * @pools: All pool objects in use.
+ * @magazines: Per-CPU page magazines, one per pool type.
+ * @nodes: Pool objects in use, one set per NUMA node.
  **/
 struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
 
-	union {
-		struct ttm_page_pool	pools[NUM_POOLS];
-		struct {
-			struct ttm_page_pool	wc_pool;
-			struct ttm_page_pool	uc_pool;
-			struct ttm_page_pool	wc_pool_dma32;
-			struct ttm_page_pool	uc_pool_dma32;
-		} ;
-	};
+	struct ttm_cpu_magazines __percpu *magazines;
+	struct ttm_node_pools	nodes[];
 };
 
 static struct attribute ttm_page_pool_max = {
@@ -147,6 +219,7 @@ static void ttm_pool_kobj_release(struct kobject *kobj)
 {
 	struct ttm_pool_manager *m =
 		container_of(kobj, struct ttm_pool_manager, kobj);
+	free_percpu(m->magazines);
 	kfree(m);
 }
 
@@ -252,14 +325,14 @@ static int set_pages_array_uc(struct page **pages, int addrinarray)
 #endif
 
 /**
- * Select the right pool or requested caching state and ttm flags. */
-static struct ttm_page_pool *ttm_get_pool(int flags,
-		enum ttm_caching_state cstate)
+ * Select the right pool type for requested caching state and ttm flags,
+ * -1 if there is no pool for it. */
+static int ttm_pool_index(int flags, enum ttm_caching_state cstate)
 {
 	int pool_index;
 
 	if (cstate == tt_cached)
-		return NULL;
+		return -1;
 
 	if (cstate == tt_wc)
 		pool_index = 0x0;
@@ -269,9 +342,36 @@ static struct ttm_page_pool *ttm_get_pool(int flags,
 	if (flags & TTM_PAGE_FLAG_DMA32)
 		pool_index |= 0x2;
 
-	return &_manager->pools[pool_index];
+	return pool_index;
+}
+
+/**
+ * Select the huge pool type for requested caching state and ttm flags, -1 if
+ * huge page runs aren't used for it. */
+static int ttm_huge_pool_index(int flags, enum ttm_caching_state cstate)
+{
+	if (!HUGE_ORDER || (flags & TTM_PAGE_FLAG_DMA32))
+		return -1;
+
+	return ttm_pool_index(flags, cstate);
 }
 
+/**
+ * Select the pool of node @nid for requested caching state and ttm flags. */
+static struct ttm_page_pool *ttm_get_pool(int flags,
+		enum ttm_caching_state cstate, int nid)
+{
+	int pool_index = ttm_pool_index(flags, cstate);
+
+	if (pool_index < 0)
+		return NULL;
+
+	return &_manager->nodes[nid].pools[pool_index];
+}
+
+#define ttm_pool_stat_add(index, stat, n) \
+	this_cpu_add(_manager->magazines->mag[index].stat, n)
+
 /* set memory back to wb and free the pages. */
 static void ttm_pages_put(struct page *pages[], unsigned npages)
 {
@@ -384,9 +484,150 @@ out:
 	return nr_free;
 }
 
+/*
+ * Put the pages in the array into @pool, all of them must be from pool->nid.
+ * @use_static is passed on to ttm_page_pool_free() for trimming the pool.
+ */
+static void ttm_page_pool_put(struct ttm_page_pool *pool, struct page **pages,
+			      unsigned npages, bool use_static)
+{
+	unsigned long irq_flags;
+	unsigned i;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	for (i = 0; i < npages; i++) {
+		if (pages[i]) {
+			if (page_count(pages[i]) != 1)
+				pr_err("Erroneous page count. Leaking pages.\n");
+			list_add_tail(&pages[i]->lru, &pool->list);
+			pages[i] = NULL;
+			pool->npages++;
+		}
+	}
+	/* Check that we don't go over the pool limit */
+	npages = 0;
+	if (pool->npages > _manager->options.max_size) {
+		npages = pool->npages - _manager->options.max_size;
+		/* free at least NUM_PAGES_TO_ALLOC number of pages
+		 * to reduce calls to set_memory_wb */
+		if (npages < NUM_PAGES_TO_ALLOC)
+			npages = NUM_PAGES_TO_ALLOC;
+	}
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	if (npages)
+		ttm_page_pool_free(pool, npages, use_static);
+}
+
+/* set a huge page run back to wb and free its pages. */
+static void ttm_huge_pages_put(struct page *p)
+{
+	struct page **pages;
+	unsigned i;
+
+	set_page_private(p, 0);
+	pages = kmalloc(HUGE_NR * sizeof(struct page *),
+			GFP_KERNEL | __GFP_NOWARN);
+	if (pages) {
+		for (i = 0; i < HUGE_NR; ++i)
+			pages[i] = p + i;
+		ttm_pages_put(pages, HUGE_NR);
+		kfree(pages);
+		return;
+	}
+
+	/* no memory for the array, change the caching page by page */
+	for (i = 0; i < HUGE_NR; ++i) {
+		struct page *page = p + i;
+
+		ttm_pages_put(&page, 1);
+	}
+}
+
+/**
+ * Free huge page runs from a huge pool, oldest first.
+ *
+ * Runs are only ever freed as a whole so this may free up to HUGE_NR - 1
+ * pages more than asked for.
+ *
+ * @return number of pages freed.
+ **/
+static unsigned ttm_huge_pool_free(struct ttm_page_pool *pool, unsigned nr_free)
+{
+	unsigned long irq_flags;
+	unsigned freed = 0;
+	struct page *p;
+
+	while (freed < nr_free) {
+		spin_lock_irqsave(&pool->lock, irq_flags);
+		if (list_empty(&pool->list)) {
+			spin_unlock_irqrestore(&pool->lock, irq_flags);
+			break;
+		}
+		p = list_last_entry(&pool->list, struct page, lru);
+		list_del(&p->lru);
+		ttm_pool_update_free_locked(pool, HUGE_NR);
+		spin_unlock_irqrestore(&pool->lock, irq_flags);
+
+		ttm_huge_pages_put(p);
+		freed += HUGE_NR;
+	}
+
+	return freed;
+}
+
+/* Put a whole huge page run, given by its head page, into the huge pool. */
+static void ttm_huge_pool_put(struct ttm_page_pool *pool, struct page *p)
+{
+	unsigned long irq_flags;
+	unsigned npages = 0;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	list_add(&p->lru, &pool->list);
+	pool->npages += HUGE_NR;
+	if (pool->npages > _manager->options.max_size)
+		npages = pool->npages - _manager->options.max_size;
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	if (npages)
+		ttm_huge_pool_free(pool, npages);
+}
+
+/*
+ * Move all pages cached by @cpu back into the pools of its node. Callers
+ * that own the static free buffer pass @use_static, so trimming the pools
+ * doesn't allocate; the shrinker must not recurse into reclaim.
+ */
+static unsigned ttm_pool_drain_magazines(int cpu, bool use_static)
+{
+	struct ttm_cpu_magazines *mags = per_cpu_ptr(_manager->magazines, cpu);
+	struct ttm_node_pools *node = &_manager->nodes[cpu_to_node(cpu)];
+	struct page *pages[MAGAZINE_SIZE];
+	unsigned long irq_flags;
+	unsigned i, npages, drained = 0;
+
+	for (i = 0; i < NUM_POOLS; ++i) {
+		struct ttm_page_magazine *mag = &mags->mag[i];
+
+		spin_lock_irqsave(&mag->lock, irq_flags);
+		npages = mag->npages;
+		memcpy(pages, mag->pages, npages * sizeof(struct page *));
+		mag->npages = 0;
+		spin_unlock_irqrestore(&mag->lock, irq_flags);
+
+		if (npages)
+			ttm_page_pool_put(&node->pools[i], pages, npages,
+					  use_static);
+		drained += npages;
+	}
+
+	return drained;
+}
+
 /**
  * Callback for mm to request pool to reduce number of page held.
  *
+ * The shrinker is NUMA aware: only the pools of sc->nid, and the magazines
+ * of the CPUs on that node, are shrunk.
+ *
  * XXX: (dchinner) Deadlock warning!
  *
  * This code is crying out for a shrinker per pool....
@@ -401,20 +642,37 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 	struct ttm_page_pool *pool;
 	int shrink_pages = sc->nr_to_scan;
 	unsigned long freed = 0;
+	int cpu;
 
 	if (!mutex_trylock(&lock))
 		return SHRINK_STOP;
+
+	for_each_possible_cpu(cpu) {
+		if (cpu_to_node(cpu) == sc->nid)
+			ttm_pool_drain_magazines(cpu, true);
+	}
+
 	pool_offset = ++start_pool % NUM_POOLS;
 	/* select start pool in round robin fashion */
 	for (i = 0; i < NUM_POOLS; ++i) {
 		unsigned nr_free = shrink_pages;
 		if (shrink_pages == 0)
 			break;
-		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		pool = &_manager->nodes[sc->nid].pools[(i + pool_offset)%NUM_POOLS];
 		/* OK to use static buffer since global mutex is held. */
 		shrink_pages = ttm_page_pool_free(pool, nr_free, true);
 		freed += nr_free - shrink_pages;
 	}
+	/* huge page runs are the most valuable, give them up last */
+	for (i = 0; i < NUM_HUGE_POOLS; ++i) {
+		unsigned nr_freed;
+		if (shrink_pages <= 0)
+			break;
+		pool = &_manager->nodes[sc->nid].huge_pools[i];
+		nr_freed = ttm_huge_pool_free(pool, shrink_pages);
+		freed += nr_freed;
+		shrink_pages -= nr_freed;
+	}
 	mutex_unlock(&lock);
 	return freed;
 }
@@ -425,9 +683,23 @@ ttm_pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 {
 	unsigned i;
 	unsigned long count = 0;
+	int cpu;
 
 	for (i = 0; i < NUM_POOLS; ++i)
-		count += _manager->pools[i].npages;
+		count += _manager->nodes[sc->nid].pools[i].npages;
+	for (i = 0; i < NUM_HUGE_POOLS; ++i)
+		count += _manager->nodes[sc->nid].huge_pools[i].npages;
+
+	for_each_possible_cpu(cpu) {
+		struct ttm_cpu_magazines *mags =
+			per_cpu_ptr(_manager->magazines, cpu);
+
+		if (cpu_to_node(cpu) != sc->nid)
+			continue;
+
+		for (i = 0; i < NUM_POOLS; ++i)
+			count += mags->mag[i].npages;
+	}
 
 	return count;
 }
@@ -437,6 +709,7 @@ static void ttm_pool_mm_shrink_init(struct ttm_pool_manager *manager)
 	manager->mm_shrink.count_objects = ttm_pool_shrink_count;
 	manager->mm_shrink.scan_objects = ttm_pool_shrink_scan;
 	manager->mm_shrink.seeks = 1;
+	manager->mm_shrink.flags = SHRINKER_NUMA_AWARE;
 	register_shrinker(&manager->mm_shrink);
 }
 
@@ -485,18 +758,19 @@ static void ttm_handle_caching_state_failure(struct list_head *pages,
 }
 
 /**
- * Allocate new pages with correct caching.
+ * Allocate new pages with correct caching, preferably from node @nid.
  *
  * This function is reentrant if caller updates count depending on number of
  * pages returned in pages array.
  */
 static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
-		int ttm_flags, enum ttm_caching_state cstate, unsigned count)
+		int ttm_flags, enum ttm_caching_state cstate, unsigned count,
+		int nid)
 {
 	struct page **caching_array;
 	struct page *p;
 	int r = 0;
-	unsigned i, cpages;
+	unsigned i, cpages, remote = 0;
 	unsigned max_cpages = min(count,
 			(unsigned)(PAGE_SIZE/sizeof(struct page *)));
 
@@ -509,7 +783,7 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 	}
 
 	for (i = 0, cpages = 0; i < count; ++i) {
-		p = alloc_page(gfp_flags);
+		p = alloc_pages_node(nid, gfp_flags, 0);
 
 		if (!p) {
 			pr_err("Unable to get page %u\n", i);
@@ -551,6 +825,8 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 		}
 
 		list_add(&p->lru, pages);
+		if (page_to_nid(p) != nid)
+			remote++;
 	}
 
 	if (cpages) {
@@ -561,6 +837,8 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 					caching_array, cpages);
 	}
 out:
+	ttm_pool_stat_add(ttm_pool_index(ttm_flags, cstate), misses, i);
+	ttm_pool_stat_add(ttm_pool_index(ttm_flags, cstate), remote, remote);
 	kfree(caching_array);
 
 	return r;
@@ -602,7 +880,7 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool,
 
 		INIT_LIST_HEAD(&new_pages);
 		r = ttm_alloc_new_pages(&new_pages, pool->gfp_flags, ttm_flags,
-				cstate,	alloc_size);
+				cstate,	alloc_size, pool->nid);
 		spin_lock_irqsave(&pool->lock, *irq_flags);
 
 		if (!r) {
@@ -676,11 +954,14 @@ out:
 static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			  enum ttm_caching_state cstate)
 {
+	int index = ttm_pool_index(flags, cstate);
+	struct ttm_page_magazine *mag;
+	struct page *spill[MAGAZINE_BATCH];
 	unsigned long irq_flags;
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
-	unsigned i;
+	unsigned i, nspill = 0;
+	int nid;
 
-	if (pool == NULL) {
+	if (index < 0) {
 		/* No pool for this memory type so free the pages */
 		for (i = 0; i < npages; i++) {
 			if (pages[i]) {
@@ -693,28 +974,89 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 		return;
 	}
 
-	spin_lock_irqsave(&pool->lock, irq_flags);
+	/* Local pages go into the magazine of this CPU first. */
+	mag = &get_cpu_ptr(_manager->magazines)->mag[index];
+	nid = numa_node_id();
+	spin_lock_irqsave(&mag->lock, irq_flags);
 	for (i = 0; i < npages; i++) {
-		if (pages[i]) {
-			if (page_count(pages[i]) != 1)
-				pr_err("Erroneous page count. Leaking pages.\n");
-			list_add_tail(&pages[i]->lru, &pool->list);
-			pages[i] = NULL;
-			pool->npages++;
+		if (!pages[i] || page_to_nid(pages[i]) != nid ||
+		    page_count(pages[i]) != 1)
+			continue;
+
+		if (mag->npages == MAGAZINE_SIZE) {
+			if (nspill)
+				break;
+			/* Make room by spilling the oldest half into the pool */
+			nspill = MAGAZINE_BATCH;
+			memcpy(spill, mag->pages, sizeof(spill));
+			mag->npages -= MAGAZINE_BATCH;
+			memmove(mag->pages, mag->pages + MAGAZINE_BATCH,
+				mag->npages * sizeof(struct page *));
 		}
+
+		mag->pages[mag->npages++] = pages[i];
+		pages[i] = NULL;
 	}
-	/* Check that we don't go over the pool limit */
-	npages = 0;
-	if (pool->npages > _manager->options.max_size) {
-		npages = pool->npages - _manager->options.max_size;
-		/* free at least NUM_PAGES_TO_ALLOC number of pages
-		 * to reduce calls to set_memory_wb */
-		if (npages < NUM_PAGES_TO_ALLOC)
-			npages = NUM_PAGES_TO_ALLOC;
+	spin_unlock_irqrestore(&mag->lock, irq_flags);
+	put_cpu_ptr(_manager->magazines);
+
+	if (nspill)
+		ttm_page_pool_put(ttm_get_pool(flags, cstate, nid),
+				  spill, nspill, false);
+
+	/* Everything else goes back to the pool of the node it came from. */
+	for (i = 0; i < npages; i++) {
+		if (pages[i])
+			ttm_page_pool_put(ttm_get_pool(flags, cstate,
+						       page_to_nid(pages[i])),
+					  &pages[i], 1, false);
+	}
+}
+
+/*
+ * Take up to @npages pages from the magazine of this CPU.
+ *
+ * @return number of pages taken.
+ */
+static unsigned ttm_magazine_get_pages(int index, struct page **pages,
+				       unsigned npages)
+{
+	struct ttm_page_magazine *mag;
+	unsigned long irq_flags;
+	unsigned count;
+
+	mag = &get_cpu_ptr(_manager->magazines)->mag[index];
+	spin_lock_irqsave(&mag->lock, irq_flags);
+	count = min(npages, mag->npages);
+	mag->npages -= count;
+	memcpy(pages, mag->pages + mag->npages, count * sizeof(struct page *));
+	spin_unlock_irqrestore(&mag->lock, irq_flags);
+	put_cpu_ptr(_manager->magazines);
+
+	return count;
+}
+
+/*
+ * Stash pages fetched from the pool in excess of a request into the magazine
+ * of this CPU, or return them to the pool if it's already full again.
+ */
+static void ttm_magazine_refill(int flags, enum ttm_caching_state cstate,
+				struct list_head *plist)
+{
+	struct page *pages[MAGAZINE_BATCH];
+	struct page *p, *tmp;
+	unsigned npages = 0;
+
+	list_for_each_entry_safe(p, tmp, plist, lru) {
+		list_del(&p->lru);
+		pages[npages++] = p;
+		if (npages == MAGAZINE_BATCH) {
+			ttm_put_pages(pages, npages, flags, cstate);
+			npages = 0;
+		}
 	}
-	spin_unlock_irqrestore(&pool->lock, irq_flags);
 	if (npages)
-		ttm_page_pool_free(pool, npages, false);
+		ttm_put_pages(pages, npages, flags, cstate);
 }
 
 /*
@@ -724,19 +1066,20 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 			 enum ttm_caching_state cstate)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	int index = ttm_pool_index(flags, cstate);
+	struct ttm_page_pool *pool;
 	struct list_head plist;
-	struct page *p = NULL;
+	struct page *p = NULL, *tmp;
 	gfp_t gfp_flags = GFP_USER;
-	unsigned count;
-	int r;
+	unsigned count, cached, want;
+	int r, nid;
 
 	/* set zero flag for page allocation if required */
 	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC)
 		gfp_flags |= __GFP_ZERO;
 
 	/* No pool for cached pages */
-	if (pool == NULL) {
+	if (index < 0) {
 		if (flags & TTM_PAGE_FLAG_DMA32)
 			gfp_flags |= GFP_DMA32;
 		else
@@ -755,20 +1098,37 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 		return 0;
 	}
 
-	/* combine zero flag to pool flags */
-	gfp_flags |= pool->gfp_flags;
+	/* First we take pages from the magazine of this CPU */
+	count = ttm_magazine_get_pages(index, pages, npages);
+	ttm_pool_stat_add(index, mag_hits, count);
 
-	/* First we take pages from the pool */
-	INIT_LIST_HEAD(&plist);
-	npages = ttm_page_pool_get_pages(pool, &plist, flags, cstate, npages);
-	count = 0;
-	list_for_each_entry(p, &plist, lru) {
-		pages[count++] = p;
+	/* then from the pool of this node, with some extra for the magazine
+	 * if the request is small */
+	nid = numa_node_id();
+	pool = ttm_get_pool(flags, cstate, nid);
+	if (count < npages) {
+		want = npages - count;
+		if (want < MAGAZINE_BATCH)
+			want += MAGAZINE_BATCH;
+
+		INIT_LIST_HEAD(&plist);
+		want -= ttm_page_pool_get_pages(pool, &plist, flags, cstate,
+						want);
+		ttm_pool_stat_add(index, pool_hits, min(want, npages - count));
+		list_for_each_entry_safe(p, tmp, &plist, lru) {
+			if (count == npages)
+				break;
+			list_del(&p->lru);
+			pages[count++] = p;
+		}
+		ttm_magazine_refill(flags, cstate, &plist);
 	}
+	cached = count;
 
 	/* clear the pages coming from the pool if requested */
 	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
-		list_for_each_entry(p, &plist, lru) {
+		for (r = 0; r < cached; ++r) {
+			p = pages[r];
 			if (PageHighMem(p))
 				clear_highpage(p);
 			else
@@ -776,13 +1136,18 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 		}
 	}
 
+	/* combine zero flag to pool flags */
+	gfp_flags |= pool->gfp_flags;
+
 	/* If pool didn't have enough pages allocate new one. */
+	npages -= count;
 	if (npages > 0) {
 		/* ttm_alloc_new_pages doesn't reference pool so we can run
 		 * multiple requests in parallel.
 		 **/
 		INIT_LIST_HEAD(&plist);
-		r = ttm_alloc_new_pages(&plist, gfp_flags, flags, cstate, npages);
+		r = ttm_alloc_new_pages(&plist, gfp_flags, flags, cstate,
+					npages, nid);
 		list_for_each_entry(p, &plist, lru) {
 			pages[count++] = p;
 		}
@@ -798,36 +1163,189 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 	return 0;
 }
 
+/**
+ * Fill @pages with a naturally aligned huge page run, taken from the huge pool
+ * of this node or newly allocated. The run is split into order 0 pages so
+ * the rest of ttm can keep treating them one by one, only the head page is
+ * marked so ttm_pool_unpopulate can recognize the run again.
+ */
+static int ttm_get_huge_pages(struct page **pages, int flags,
+			      enum ttm_caching_state cstate)
+{
+	int index = ttm_huge_pool_index(flags, cstate);
+	struct ttm_page_pool *pool;
+	unsigned long irq_flags;
+	struct page *p = NULL;
+	gfp_t gfp_flags;
+	unsigned i;
+	int nid;
+
+	if (index < 0)
+		return -EINVAL;
+
+	nid = numa_node_id();
+	pool = &_manager->nodes[nid].huge_pools[index];
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	if (!list_empty(&pool->list)) {
+		p = list_first_entry(&pool->list, struct page, lru);
+		list_del(&p->lru);
+		pool->npages -= HUGE_NR;
+	}
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+
+	if (p) {
+		for (i = 0; i < HUGE_NR; ++i) {
+			pages[i] = p + i;
+			if (flags & TTM_PAGE_FLAG_ZERO_ALLOC)
+				clear_page(page_address(pages[i]));
+		}
+		ttm_pool_stat_add(index, huge_hits, 1);
+		return 0;
+	}
+
+	gfp_flags = pool->gfp_flags;
+	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC)
+		gfp_flags |= __GFP_ZERO;
+
+	p = alloc_pages_node(nid, gfp_flags, HUGE_ORDER);
+	if (!p) {
+		ttm_pool_stat_add(index, huge_fallbacks, 1);
+		return -ENOMEM;
+	}
+	split_page(p, HUGE_ORDER);
+
+	for (i = 0; i < HUGE_NR; ++i)
+		pages[i] = p + i;
+
+	/* One caching change, and one flush, for the whole run */
+	if (ttm_set_pages_caching(pages, cstate, HUGE_NR)) {
+		for (i = 0; i < HUGE_NR; ++i) {
+			__free_page(pages[i]);
+			pages[i] = NULL;
+		}
+		ttm_pool_stat_add(index, huge_fallbacks, 1);
+		return -ENOMEM;
+	}
+
+	set_page_private(p, HUGE_ORDER);
+	ttm_pool_stat_add(index, huge_allocs, 1);
+	if (page_to_nid(p) != nid)
+		ttm_pool_stat_add(index, remote, HUGE_NR);
+	return 0;
+}
+
+/* Check whether @pages starts with a whole huge page run. */
+static bool ttm_is_huge_run(struct page **pages, unsigned npages)
+{
+	unsigned long pfn;
+	unsigned i;
+
+	if (!HUGE_ORDER || npages < HUGE_NR || !pages[0] ||
+	    page_private(pages[0]) != HUGE_ORDER)
+		return false;
+
+	pfn = page_to_pfn(pages[0]);
+	if (pfn & (HUGE_NR - 1))
+		return false;
+
+	for (i = 1; i < HUGE_NR; ++i)
+		if (page_to_pfn(pages[i]) != pfn + i)
+			return false;
+
+	return true;
+}
+
+/* Return the huge page run at the start of @pages to the pool of its node. */
+static void ttm_put_huge_pages(struct page **pages, int flags,
+			       enum ttm_caching_state cstate)
+{
+	int index = ttm_huge_pool_index(flags, cstate);
+	struct page *p = pages[0];
+	unsigned i;
+
+	memset(pages, 0, HUGE_NR * sizeof(struct page *));
+
+	if (index < 0) {
+		/* the ttm was switched to cached, nothing to undo */
+		set_page_private(p, 0);
+		for (i = 0; i < HUGE_NR; ++i)
+			__free_page(p + i);
+		return;
+	}
+
+	ttm_huge_pool_put(&_manager->nodes[page_to_nid(p)].huge_pools[index],
+			  p);
+}
+
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
-		char *name)
+		char *name, int nid)
 {
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
 	INIT_LIST_HEAD(&pool->list);
 	pool->npages = pool->nfrees = 0;
 	pool->gfp_flags = flags;
+	pool->nid = nid;
 	pool->name = name;
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 {
-	int ret;
+	int ret, nid, cpu;
+	unsigned i;
 
 	WARN_ON(_manager);
 
 	pr_info("Initializing pool allocator\n");
 
-	_manager = kzalloc(sizeof(*_manager), GFP_KERNEL);
+	_manager = kzalloc(sizeof(*_manager) +
+			   nr_node_ids * sizeof(struct ttm_node_pools),
+			   GFP_KERNEL);
+	if (!_manager)
+		return -ENOMEM;
+
+	_manager->magazines = alloc_percpu(struct ttm_cpu_magazines);
+	if (!_manager->magazines) {
+		kfree(_manager);
+		_manager = NULL;
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct ttm_cpu_magazines *mags =
+			per_cpu_ptr(_manager->magazines, cpu);
+
+		for (i = 0; i < NUM_POOLS; ++i)
+			spin_lock_init(&mags->mag[i].lock);
+	}
+
+	for (nid = 0; nid < nr_node_ids; ++nid) {
+		struct ttm_node_pools *node = &_manager->nodes[nid];
+
+		ttm_page_pool_init_locked(&node->wc_pool, GFP_HIGHUSER,
+					  "wc", nid);
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, "wc");
+		ttm_page_pool_init_locked(&node->uc_pool, GFP_HIGHUSER,
+					  "uc", nid);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER, "uc");
+		ttm_page_pool_init_locked(&node->wc_pool_dma32,
+					  GFP_USER | GFP_DMA32, "wc dma", nid);
 
-	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "wc dma");
+		ttm_page_pool_init_locked(&node->uc_pool_dma32,
+					  GFP_USER | GFP_DMA32, "uc dma", nid);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "uc dma");
+		/* huge page runs are opportunistic, don't try hard for them */
+		ttm_page_pool_init_locked(&node->wc_pool_huge,
+					  GFP_USER | __GFP_NORETRY |
+					  __GFP_NOWARN | __GFP_NO_KSWAPD,
+					  "wc huge", nid);
+
+		ttm_page_pool_init_locked(&node->uc_pool_huge,
+					  GFP_USER | __GFP_NORETRY |
+					  __GFP_NOWARN | __GFP_NO_KSWAPD,
+					  "uc huge", nid);
+	}
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
@@ -848,19 +1366,58 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 
 void ttm_page_alloc_fini(void)
 {
-	int i;
+	int i, nid, cpu;
 
 	pr_info("Finalizing pool allocator\n");
 	ttm_pool_mm_shrink_fini(_manager);
 
 	/* OK to use static buffer since global mutex is no longer used. */
-	for (i = 0; i < NUM_POOLS; ++i)
-		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES, true);
+	for_each_possible_cpu(cpu)
+		ttm_pool_drain_magazines(cpu, true);
+
+	for (nid = 0; nid < nr_node_ids; ++nid) {
+		for (i = 0; i < NUM_POOLS; ++i)
+			ttm_page_pool_free(&_manager->nodes[nid].pools[i],
+					   FREE_ALL_PAGES, true);
+		for (i = 0; i < NUM_HUGE_POOLS; ++i)
+			ttm_huge_pool_free(&_manager->nodes[nid].huge_pools[i],
+					   FREE_ALL_PAGES);
+	}
 
 	kobject_put(&_manager->kobj);
 	_manager = NULL;
 }
 
+/*
+ * Back the HUGE_NR pages of @ttm starting at @i with a huge page run. On
+ * failure nothing is left behind, the caller falls back to order 0 pages.
+ */
+static int ttm_pool_populate_huge(struct ttm_tt *ttm, unsigned i)
+{
+	struct ttm_mem_global *mem_glob = ttm->glob->mem_glob;
+	struct page **pages = &ttm->pages[i];
+	unsigned j;
+	int ret;
+
+	ret = ttm_get_huge_pages(pages, ttm->page_flags, ttm->caching_state);
+	if (ret != 0)
+		return ret;
+
+	for (j = 0; j < HUGE_NR; ++j) {
+		ret = ttm_mem_global_alloc_page(mem_glob, pages[j],
+						false, false);
+		if (unlikely(ret != 0)) {
+			while (j--)
+				ttm_mem_global_free_page(mem_glob, pages[j]);
+			ttm_put_huge_pages(pages, ttm->page_flags,
+					   ttm->caching_state);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 int ttm_pool_populate(struct ttm_tt *ttm)
 {
 	struct ttm_mem_global *mem_glob = ttm->glob->mem_glob;
@@ -871,6 +1428,14 @@ int ttm_pool_populate(struct ttm_tt *ttm)
 		return 0;
 
 	for (i = 0; i < ttm->num_pages; ++i) {
+		/* aligned stretches of large ttms get huge page runs */
+		if (HUGE_ORDER && !(i & (HUGE_NR - 1)) &&
+		    ttm->num_pages - i >= HUGE_NR &&
+		    ttm_pool_populate_huge(ttm, i) == 0) {
+			i += HUGE_NR - 1;
+			continue;
+		}
+
 		ret = ttm_get_pages(&ttm->pages[i], 1,
 				    ttm->page_flags,
 				    ttm->caching_state);
@@ -902,10 +1467,17 @@ EXPORT_SYMBOL(ttm_pool_populate);
 
 void ttm_pool_unpopulate(struct ttm_tt *ttm)
 {
-	unsigned i;
+	unsigned i, j;
 
 	for (i = 0; i < ttm->num_pages; ++i) {
-		if (ttm->pages[i]) {
+		if (ttm_is_huge_run(&ttm->pages[i], ttm->num_pages - i)) {
+			for (j = 0; j < HUGE_NR; ++j)
+				ttm_mem_global_free_page(ttm->glob->mem_glob,
+							 ttm->pages[i + j]);
+			ttm_put_huge_pages(&ttm->pages[i], ttm->page_flags,
+					   ttm->caching_state);
+			i += HUGE_NR - 1;
+		} else if (ttm->pages[i]) {
 			ttm_mem_global_free_page(ttm->glob->mem_glob,
 						 ttm->pages[i]);
 			ttm_put_pages(&ttm->pages[i], 1,
@@ -921,19 +1493,85 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
 	struct ttm_page_pool *p;
 	unsigned i;
-	char *h[] = {"pool", "refills", "pages freed", "size"};
+	int nid, cpu;
+	char *h[] = {"pool", "node", "refills", "pages freed", "size"};
+	char *hs[] = {"pool", "cached", "cpu hits", "pool hits", "misses",
+		      "remote", "avoided"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
 		return 0;
 	}
-	seq_printf(m, "%6s %12s %13s %8s\n",
-			h[0], h[1], h[2], h[3]);
+	seq_printf(m, "%6s %4s %12s %13s %8s\n",
+			h[0], h[1], h[2], h[3], h[4]);
+	for (nid = 0; nid < nr_node_ids; ++nid) {
+		if (!node_online(nid))
+			continue;
+
+		for (i = 0; i < NUM_POOLS; ++i) {
+			p = &_manager->nodes[nid].pools[i];
+
+			seq_printf(m, "%6s %4d %12ld %13ld %8d\n",
+					p->name, nid, p->nrefills,
+					p->nfrees, p->npages);
+		}
+
+		if (!HUGE_ORDER)
+			continue;
+
+		for (i = 0; i < NUM_HUGE_POOLS; ++i) {
+			p = &_manager->nodes[nid].huge_pools[i];
+
+			seq_printf(m, "%6s %4d %12ld %13ld %8d\n",
+					p->name, nid, p->nrefills,
+					p->nfrees, p->npages);
+		}
+	}
+
+	seq_printf(m, "\n%6s %8s %12s %12s %12s %12s %12s\n",
+			hs[0], hs[1], hs[2], hs[3], hs[4], hs[5], hs[6]);
 	for (i = 0; i < NUM_POOLS; ++i) {
-		p = &_manager->pools[i];
+		unsigned long cached = 0, mag_hits = 0, pool_hits = 0;
+		unsigned long misses = 0, remote = 0;
+
+		for_each_possible_cpu(cpu) {
+			struct ttm_page_magazine *mag =
+				&per_cpu_ptr(_manager->magazines, cpu)->mag[i];
+
+			cached += mag->npages;
+			mag_hits += mag->mag_hits;
+			pool_hits += mag->pool_hits;
+			misses += mag->misses;
+			remote += mag->remote;
+		}
+
+		/* Every page reused from a magazine or pool saved us a
+		 * caching transition */
+		seq_printf(m, "%6s %8lu %12lu %12lu %12lu %12lu %12lu\n",
+				_manager->nodes[0].pools[i].name, cached,
+				mag_hits, pool_hits, misses, remote,
+				mag_hits + pool_hits);
+	}
+
+	if (!HUGE_ORDER)
+		return 0;
+
+	seq_printf(m, "\n%8s %12s %12s %12s\n",
+			"pool", "huge hits", "huge allocs", "fallbacks");
+	for (i = 0; i < NUM_HUGE_POOLS; ++i) {
+		unsigned long hits = 0, allocs = 0, fallbacks = 0;
+
+		for_each_possible_cpu(cpu) {
+			struct ttm_page_magazine *mag =
+				&per_cpu_ptr(_manager->magazines, cpu)->mag[i];
+
+			hits += mag->huge_hits;
+			allocs += mag->huge_allocs;
+			fallbacks += mag->huge_fallbacks;
+		}
 
-		seq_printf(m, "%6s %12ld %13ld %8d\n",
-				p->name, p->nrefills,
-				p->nfrees, p->npages);
+		seq_printf(m, "%8s %12lu %12lu %12lu\n",
+				_manager->nodes[0].huge_pools[i].name,
+				hits, allocs, fallbacks);
 	}
 	return 0;
 }
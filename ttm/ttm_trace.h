@@ -0,0 +1,90 @@
+/**************************************************************************
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+#if !defined(_TTM_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _TTM_TRACE_H_
+
+#include <linux/stringify.h>
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+#include <drm/ttm/ttm_bo_api.h>
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ttm
+#define TRACE_SYSTEM_STRING __stringify(TRACE_SYSTEM)
+#define TRACE_INCLUDE_FILE ttm_trace
+
+TRACE_EVENT(ttm_bo_ddestroy_queue,
+	    TP_PROTO(struct ttm_buffer_object *bo, int pending),
+	    TP_ARGS(bo, pending),
+	    TP_STRUCT__entry(
+		    __field(struct ttm_buffer_object *, bo)
+		    __field(unsigned long, num_pages)
+		    __field(int, pending)
+		    ),
+	    TP_fast_assign(
+		    __entry->bo = bo;
+		    __entry->num_pages = bo->num_pages;
+		    __entry->pending = pending;
+		    ),
+	    TP_printk("bo=%p, pages=%lu, pending=%d",
+		      __entry->bo, __entry->num_pages, __entry->pending)
+);
+
+TRACE_EVENT(ttm_bo_ddestroy_release,
+	    TP_PROTO(struct ttm_buffer_object *bo, s64 latency_us),
+	    TP_ARGS(bo, latency_us),
+	    TP_STRUCT__entry(
+		    __field(struct ttm_buffer_object *, bo)
+		    __field(s64, latency_us)
+		    ),
+	    TP_fast_assign(
+		    __entry->bo = bo;
+		    __entry->latency_us = latency_us;
+		    ),
+	    TP_printk("bo=%p, latency=%lldus",
+		      __entry->bo, __entry->latency_us)
+);
+
+TRACE_EVENT(ttm_bo_ddestroy_batch,
+	    TP_PROTO(unsigned int released, unsigned int requeued),
+	    TP_ARGS(released, requeued),
+	    TP_STRUCT__entry(
+		    __field(unsigned int, released)
+		    __field(unsigned int, requeued)
+		    ),
+	    TP_fast_assign(
+		    __entry->released = released;
+		    __entry->requeued = requeued;
+		    ),
+	    TP_printk("released=%u, requeued=%u",
+		      __entry->released, __entry->requeued)
+);
+
+#endif /* _TTM_TRACE_H_ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#include <trace/define_trace.h>